@@ -0,0 +1,74 @@
+#include "BandwidthPlanner.h"
+#include <algorithm>
+#include <cmath>
+
+BandwidthPlan plan_bandwidth(const TimeLine &timeline, TxPacer &pacer)
+{
+    BandwidthPlan plan;
+    plan.measured = pacer.stats().n_samples > 0;
+    double write_ms = pacer.command_ms(14, 0);
+    double read_ms = pacer.command_ms(10, 8);
+    plan.command_ms = read_ms;
+    double control_budget = pacer.control_share * 1000;
+    double telemetry_budget = (1 - pacer.control_share) * 1000;
+
+    // Every channel is read on its own interval, the schedule never reads faster than every 100 ms
+    bool b_log = timeline.logging();
+    double log_rate = 0;
+    size_t n_channels = 0;
+    for (int c = 0; c < LOG_CHANNELS; c++)
+    {
+        if (b_log && timeline.logs(c))
+        {
+            double interval = std::max(0.1, static_cast<double>(timeline.logIntervals[c]));
+            log_rate += 1.0 / interval;
+            n_channels++;
+        }
+    }
+    // Wait-for-value polls up to three readings per 100 ms pause
+    double poll_rate = 3.0 / (0.1 + 3 * read_ms / 1000);
+
+    double worst_free_telemetry = telemetry_budget;
+    for (const Section &section : timeline.sections)
+    {
+        SectionLoad sl;
+        sl.control = section.set_value_rate() * write_ms;
+        // Adaptive logging samples faster while ramping and while adjusting to the set values
+        bool b_ramp = section.temperature[0] != section.temperature[1] || section.speed[0] != section.speed[1];
+        double boost = timeline.adaptiveLogging ? std::max(1.0f, timeline.logBoost) : 1.0;
+        sl.telemetry = log_rate * read_ms * (b_ramp ? boost : 1.0);
+        // Trigger channels are read at least every triggerReadInterval, the log readings count towards it
+        for (int c = 0; c < LOG_CHANNELS; c++)
+        {
+            bool used = std::any_of(section.triggers.begin(), section.triggers.end(), [c](const Trigger &trigger)
+                                    { return trigger.channel == c; });
+            double logged = b_log && timeline.logs(c) ? 1.0 / std::max(0.1, static_cast<double>(timeline.logIntervals[c])) : 0;
+            sl.telemetry += used ? std::max(0.0, 1.0 / triggerReadInterval - logged) * read_ms : 0;
+        }
+        sl.waiting = section.wait_value ? log_rate * read_ms * boost + poll_rate * read_ms : 0;
+        sl.load = std::max(sl.control / control_budget, std::max(sl.telemetry, sl.waiting) / telemetry_budget);
+        sl.overloaded = sl.load > 1.0;
+        plan.sections.push_back(sl);
+
+        double polling = section.wait_value ? poll_rate * read_ms : 0;
+        worst_free_telemetry = std::min(worst_free_telemetry, telemetry_budget - polling);
+    }
+
+    plan.min_log_interval = 0;
+    if (n_channels > 0)
+    {
+        // Scale all intervals by the same factor until the reads fit, reported for the shortest channel
+        double shortest = INFINITY;
+        for (int c = 0; c < LOG_CHANNELS; c++)
+        {
+            if (timeline.logs(c))
+            {
+                shortest = std::min(shortest, std::max(0.1, static_cast<double>(timeline.logIntervals[c])));
+            }
+        }
+        double free_budget = std::max(0.0, worst_free_telemetry);
+        double scale = free_budget > 0 ? log_rate * read_ms / free_budget : INFINITY;
+        plan.min_log_interval = std::ceil(shortest * std::max(scale, 1e-9) * 10) / 10;
+    }
+    return plan;
+}
@@ -0,0 +1,29 @@
+#ifndef BANDWIDTHPLANNER_H
+#define BANDWIDTHPLANNER_H
+
+#include <vector>
+#include "TimeLine.h"
+#include "TxPacer.h"
+
+// Serial line demand of one section, in ms of line time per second
+struct SectionLoad
+{
+    double control;   // Setpoint writes while the section runs
+    double telemetry; // Log reads while the section runs
+    double waiting;   // Log reads plus value polling while waiting for the set values
+    double load;      // Highest utilisation of the control or telemetry budget (1.0 = fully used)
+    bool overloaded;  // The schedule will fall behind
+};
+
+struct BandwidthPlan
+{
+    std::vector<SectionLoad> sections;
+    double command_ms;     // Line time of one command the estimate is based on
+    bool measured;         // command_ms comes from the connected device rather than the baud rate alone
+    double min_log_interval; // Shortest interval of the fastest channel that fits into every section, in seconds
+};
+
+// Checks a timeline against the serial budget of TxPacer before it is run
+BandwidthPlan plan_bandwidth(const TimeLine &timeline, TxPacer &pacer);
+
+#endif // BANDWIDTHPLANNER_H
@@ -0,0 +1,106 @@
+#include "DeviceProbe.h"
+#include "SerialPort.h"
+#include <algorithm>
+#include <cctype>
+
+std::string query_device_name(const std::string &path, uint32_t baudRate, int deadline_ms)
+{
+    SerialPort port(path, baudRate);
+    port.readTimeout_ms = deadline_ms;
+    if (!port.open())
+    {
+        return "";
+    }
+    port.flushInput();
+    if (!port.sendCommand("IN_NAME"))
+    {
+        return "";
+    }
+    std::string reply = port.readString();
+    reply.erase(std::remove_if(reply.begin(), reply.end(), [](char c)
+                               { return c == '\r' || c == '\n'; }),
+                reply.end());
+    // At a wrong baud rate the device answers with garbage, accept printable text only
+    bool printable = std::all_of(reply.begin(), reply.end(), [](char c)
+                                 { return std::isprint(static_cast<unsigned char>(c)) != 0; });
+    if (reply.empty() || !printable)
+    {
+        return "";
+    }
+    return reply;
+}
+
+DeviceProbe::DeviceProbe() : deadline_ms(300), workers(), found(), mutex(), n_done(0), n_total(0) {}
+
+DeviceProbe::~DeviceProbe()
+{
+    join();
+}
+
+void DeviceProbe::join()
+{
+    for (std::thread &worker : workers)
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+    workers.clear();
+}
+
+bool DeviceProbe::busy() const
+{
+    return n_done.load() < n_total;
+}
+
+float DeviceProbe::progress() const
+{
+    return n_total == 0 ? 1.0f : static_cast<float>(n_done.load()) / static_cast<float>(n_total);
+}
+
+std::vector<ProbeResult> DeviceProbe::results()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return found;
+}
+
+void DeviceProbe::start(const std::vector<PortInfo> &ports, const std::vector<uint32_t> &baudRates, const std::string &skipPath)
+{
+    if (busy())
+    {
+        return;
+    }
+    join();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        found.clear();
+    }
+    n_done = 0;
+    n_total = 0;
+    for (const PortInfo &port : ports)
+    {
+        // Do not disturb the port that is currently in use
+        if (port.path == skipPath)
+        {
+            continue;
+        }
+        n_total++;
+        workers.emplace_back(&DeviceProbe::probe_port, this, port, baudRates);
+    }
+}
+
+void DeviceProbe::probe_port(const PortInfo port, const std::vector<uint32_t> baudRates)
+{
+    for (uint32_t baudRate : baudRates)
+    {
+        std::string device = query_device_name(port.path, baudRate, deadline_ms);
+        if (!device.empty())
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            found.push_back({port, baudRate, device});
+            break;
+        }
+    }
+    n_done++;
+}
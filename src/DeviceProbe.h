@@ -0,0 +1,49 @@
+#ifndef DEVICEPROBE_H
+#define DEVICEPROBE_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "PortDiscovery.h"
+
+// Device that answered IN_NAME during a probe
+struct ProbeResult
+{
+    PortInfo port;
+    uint32_t baudRate;
+    std::string device; // Reply to IN_NAME
+};
+
+// Looks for RCT 5 devices on all candidate ports concurrently.
+// Every port gets its own worker that tries IN_NAME at each baud rate with a short deadline.
+class DeviceProbe
+{
+public:
+    DeviceProbe();
+    ~DeviceProbe();
+
+    void start(const std::vector<PortInfo> &ports, const std::vector<uint32_t> &baudRates, const std::string &skipPath = "");
+    bool busy() const;
+    float progress() const;             // Fraction of ports probed
+    std::vector<ProbeResult> results(); // Devices found so far
+
+    int deadline_ms; // Reply deadline per attempt
+
+private:
+    std::vector<std::thread> workers;
+    std::vector<ProbeResult> found;
+    std::mutex mutex;
+    std::atomic<size_t> n_done;
+    size_t n_total;
+
+    void probe_port(const PortInfo port, const std::vector<uint32_t> baudRates);
+    void join();
+};
+
+// Open a port and ask for the device name, returns an empty string if nothing sensible answers
+std::string query_device_name(const std::string &path, uint32_t baudRate, int deadline_ms);
+
+#endif // DEVICEPROBE_H
@@ -0,0 +1,349 @@
+#include "ExecutionPlan.h"
+#include "TimeLine.h"
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+static std::string format_value(float value)
+{
+    std::string text = std::to_string(value);
+    text.erase(text.find_last_not_of('0') + 1);
+    if (!text.empty() && text.back() == '.')
+    {
+        text.pop_back();
+    }
+    return text;
+}
+
+// Set value commands are checked like the section set values, other commands are sent as they are
+static bool check_command(const std::string &command, std::string &problem)
+{
+    struct Limit
+    {
+        const char *command;
+        float max;
+        const char *unit;
+    };
+    static const Limit limits[] = {{"OUT_SP_1 ", planMaxTemperature, " °C"}, {"OUT_SP_4 ", planMaxSpeed, " rpm"}};
+    for (const Limit &limit : limits)
+    {
+        if (command.rfind(limit.command, 0) != 0)
+        {
+            continue;
+        }
+        const char *begin = command.c_str() + std::char_traits<char>::length(limit.command);
+        char *end = nullptr;
+        float value = std::strtof(begin, &end);
+        if (end == begin || std::isnan(value))
+        {
+            problem = "\"" + command + "\" has no valid value";
+            return false;
+        }
+        if (value < 0 || value > limit.max)
+        {
+            problem = "\"" + command + "\" is outside of 0 - " + format_value(limit.max) + limit.unit;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Value of a profile within the device range, the ramp value where there is no profile
+static float profile_value(const Expression &expression, double t, double d, float ramp, float max)
+{
+    if (expression.empty())
+    {
+        return ramp;
+    }
+    double value = expression.eval(t, d);
+    return std::isfinite(value) ? static_cast<float>(std::min(std::max(value, 0.0), static_cast<double>(max))) : ramp;
+}
+
+// The profiles are sampled at the 100 ms grid of the executor, at most 100000 times
+static bool check_profile(const PlanProfile &profile, size_t duration, std::string &problem)
+{
+    size_t samples = std::max<size_t>(1, std::min<size_t>(duration * 10, 100000));
+    double d = static_cast<double>(duration);
+    for (size_t k = 0; k <= samples; k++)
+    {
+        double t = d * k / samples;
+        const Expression *expressions[2] = {&profile.temperature, &profile.speed};
+        for (int c = 0; c < 2; c++)
+        {
+            float max = c == 0 ? planMaxTemperature : planMaxSpeed;
+            if (expressions[c]->empty())
+            {
+                continue;
+            }
+            double value = expressions[c]->eval(t, d);
+            if (!std::isfinite(value) || value < 0 || value > max)
+            {
+                problem = std::string(c == 0 ? "temperature" : "speed") + " profile gives " + format_value(static_cast<float>(value)) +
+                          (c == 0 ? " °C" : " rpm") + " at t = " + format_value(static_cast<float>(std::round(t * 10) / 10)) + " s, the range is 0 - " + format_value(max);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<const ExecutionPlan> ExecutionPlan::compile(const TimeLine &timeline, std::string &error)
+{
+    auto plan = std::make_shared<ExecutionPlan>();
+    plan->total_ms = 0;
+    plan->waits = 0;
+    error.clear();
+    for (size_t i = 0; i < timeline.sections.size(); i++)
+    {
+        const Section &section = timeline.sections[i];
+        std::string label = "Section " + std::to_string(i + 1) + " (" + section.name + "): ";
+        for (int k = 0; k < 2; k++)
+        {
+            if (section.temperature[k] > planMaxTemperature)
+            {
+                error = label + "temperature " + std::to_string(section.temperature[k]) + " °C is above " + format_value(planMaxTemperature) + " °C";
+                return nullptr;
+            }
+            if (section.speed[k] > planMaxSpeed)
+            {
+                error = label + "speed " + std::to_string(section.speed[k]) + " rpm is above " + format_value(planMaxSpeed) + " rpm";
+                return nullptr;
+            }
+        }
+        if (section.duration > std::numeric_limits<uint32_t>::max() / 1000)
+        {
+            error = label + "duration is too long";
+            return nullptr;
+        }
+        std::string problem;
+        for (const std::string &command : section.preSectionCommands)
+        {
+            if (!check_command(command, problem))
+            {
+                error = label + problem;
+                return nullptr;
+            }
+        }
+        for (const std::string &command : section.postSectionCommands)
+        {
+            if (!check_command(command, problem))
+            {
+                error = label + problem;
+                return nullptr;
+            }
+        }
+
+        PlanSection ps;
+        ps.first = plan->actions.size();
+        ps.duration_ms = static_cast<uint32_t>(section.duration * 1000);
+        ps.waits = section.wait_user || section.wait_value;
+        ps.profile = -1;
+        ps.trigger_first = static_cast<uint32_t>(plan->triggers.size());
+        for (const Trigger &trigger : section.triggers)
+        {
+            bool relative = trigger.kind == TriggerKind::RiseAbove || trigger.kind == TriggerKind::FallBelow || trigger.kind == TriggerKind::RateBelow;
+            if (trigger.channel >= LOG_CHANNELS || trigger.kind >= TriggerKind::Count || !std::isfinite(trigger.value) ||
+                (relative && trigger.value <= 0) || !(trigger.hold >= 0 && trigger.hold <= 1e6f))
+            {
+                error = label + "invalid trigger \"" + TriggerSet::describe(trigger) + "\"";
+                return nullptr;
+            }
+            plan->triggers.push_back(trigger);
+        }
+        ps.trigger_end = static_cast<uint32_t>(plan->triggers.size());
+        if (section.wait_value && !(section.settleBand[0] > 0 && section.settleBand[1] > 0 && section.settleHold >= 0 && section.settleHold <= 86400))
+        {
+            error = label + "the settling band must be above 0 and the hold time within 0 - 86400 s";
+            return nullptr;
+        }
+        ps.settle_band[0] = section.settleBand[0];
+        ps.settle_band[1] = section.settleBand[1];
+        ps.settle_hold = section.settleHold;
+        ProfileSummary summary{0, {}, {}};
+        if (!section.temperatureProfile.empty() || !section.speedProfile.empty() || !section.profileFile.empty())
+        {
+            PlanProfile profile;
+            if (!section.profileFile.empty())
+            {
+                profile.file = ProfileFile::resolve(section.profileFile, timeline.filePath);
+                if (!ProfileFile::scan(profile.file, planMaxTemperature, planMaxSpeed, summary, problem))
+                {
+                    error = label + problem;
+                    return nullptr;
+                }
+            }
+            if (!profile.temperature.compile(section.temperatureProfile, problem))
+            {
+                error = label + "temperature profile: " + problem;
+                return nullptr;
+            }
+            if (!profile.speed.compile(section.speedProfile, problem))
+            {
+                error = label + "speed profile: " + problem;
+                return nullptr;
+            }
+            if (!check_profile(profile, section.duration, problem))
+            {
+                error = label + problem;
+                return nullptr;
+            }
+            ps.profile = static_cast<int32_t>(plan->profiles.size());
+            plan->profiles.push_back(profile);
+        }
+        auto add = [&plan](PlanOp op, uint32_t t_ms, uint32_t arg, float temperature, float speed)
+        {
+            plan->actions.push_back(PlanAction{t_ms, arg, temperature, speed, op});
+        };
+
+        add(PlanOp::SectionStart, 0, 0, 0, 0);
+        for (const std::string &command : section.preSectionCommands)
+        {
+            add(PlanOp::Command, 0, static_cast<uint32_t>(plan->commands.size()), 0, 0);
+            plan->commands.push_back(command);
+        }
+        const PlanProfile *profile = ps.profile >= 0 ? &plan->profiles[ps.profile] : nullptr;
+        float start_temperature = section.temperature[0], start_speed = section.speed[0];
+        float end_temperature = section.temperature[1], end_speed = section.speed[1];
+        if (profile != nullptr && !profile->file.empty())
+        {
+            // Points after the end of the section are never reached, the one at the end is interpolated
+            ProfileReader reader;
+            reader.open(profile->file);
+            reader.at(section.duration, end_temperature, end_speed);
+            start_temperature = summary.first.temperature;
+            start_speed = summary.first.speed;
+        }
+        if (profile != nullptr)
+        {
+            start_temperature = profile_value(profile->temperature, 0, section.duration, start_temperature, planMaxTemperature);
+            start_speed = profile_value(profile->speed, 0, section.duration, start_speed, planMaxSpeed);
+            end_temperature = profile_value(profile->temperature, section.duration, section.duration, end_temperature, planMaxTemperature);
+            end_speed = profile_value(profile->speed, section.duration, section.duration, end_speed, planMaxSpeed);
+        }
+        ps.end_temperature = end_temperature;
+        ps.end_speed = end_speed;
+        uint32_t start = (start_temperature != 0 ? 1 : 0) | (start_speed != 0 ? 2 : 0);
+        if (start != 0)
+        {
+            add(PlanOp::Start, 0, start, 0, 0);
+        }
+        // A ramp is its two ends, the values in between are computed when they are due
+        add(PlanOp::Setpoint, 0, 0, section.temperature[0], section.speed[0]);
+        add(PlanOp::Setpoint, ps.duration_ms, 0, section.temperature[1], section.speed[1]);
+        add(PlanOp::SectionEnd, ps.duration_ms, 0, 0, 0);
+        for (const std::string &command : section.postSectionCommands)
+        {
+            add(PlanOp::PostCommand, ps.duration_ms, static_cast<uint32_t>(plan->commands.size()), 0, 0);
+            plan->commands.push_back(command);
+        }
+        if (ps.waits)
+        {
+            add(PlanOp::Wait, ps.duration_ms, (section.wait_user ? 1 : 0) | (section.wait_value ? 2 : 0), end_temperature, end_speed);
+        }
+        ps.end = plan->actions.size();
+        plan->sections.push_back(ps);
+    }
+
+    // Repeats are expanded while the run goes on, here they only multiply the time of their sections
+    for (size_t r = 0; r < timeline.repeats.size(); r++)
+    {
+        const RepeatBlock &block = timeline.repeats[r];
+        std::string label = "Repeat " + std::to_string(r + 1) + ": ";
+        if (block.first > block.last || block.last >= timeline.sections.size())
+        {
+            error = label + "sections " + std::to_string(block.first + 1) + " - " + std::to_string(block.last + 1) + " do not exist";
+            return nullptr;
+        }
+        if (block.count == 0)
+        {
+            error = label + "count must be at least 1";
+            return nullptr;
+        }
+        for (const PlanRepeat &other : plan->repeats)
+        {
+            bool nested = (other.first <= block.first && block.last <= other.last) || (block.first <= other.first && other.last <= block.last);
+            bool apart = block.last < other.first || other.last < block.first;
+            if (!nested && !apart)
+            {
+                error = label + "overlaps sections " + std::to_string(other.first + 1) + " - " + std::to_string(other.last + 1) + " of another block";
+                return nullptr;
+            }
+        }
+        plan->repeats.push_back(PlanRepeat{block.first, block.last, block.count});
+    }
+    std::stable_sort(plan->repeats.begin(), plan->repeats.end(), [](const PlanRepeat &a, const PlanRepeat &b)
+                     { return a.last != b.last ? a.last < b.last : a.first > b.first; });
+    double total_ms = 0;
+    for (size_t i = 0; i < plan->sections.size(); i++)
+    {
+        double passes = 1;
+        for (const PlanRepeat &repeat : plan->repeats)
+        {
+            if (repeat.first <= i && i <= repeat.last)
+            {
+                passes *= repeat.count;
+            }
+        }
+        total_ms += passes * plan->sections[i].duration_ms;
+        plan->waits += plan->sections[i].waits ? static_cast<uint64_t>(std::min(passes, 1e18)) : 0;
+    }
+    if (total_ms > 1e15)
+    {
+        error = "The repeats make the run too long";
+        return nullptr;
+    }
+    plan->total_ms = static_cast<uint64_t>(total_ms);
+    return plan;
+}
+
+size_t ExecutionPlan::next_section(size_t index, std::vector<uint32_t> &iterations, int32_t &jumped) const
+{
+    // Blocks inside a repeated one have finished all their passes and start over from zero
+    jumped = -1;
+    for (size_t r = 0; r < repeats.size(); r++)
+    {
+        if (repeats[r].last != index)
+        {
+            continue;
+        }
+        if (++iterations[r] < repeats[r].count)
+        {
+            jumped = static_cast<int32_t>(r);
+            return repeats[r].first;
+        }
+        iterations[r] = 0;
+    }
+    return index + 1;
+}
+
+void ExecutionPlan::set_values(const PlanSection &section, size_t &point, uint32_t t_ms, float &temperature, float &speed, ProfileReader *reader) const
+{
+    while (point + 1 < actions.size() && actions[point + 1].op == PlanOp::Setpoint && actions[point + 1].t_ms <= t_ms)
+    {
+        point++;
+    }
+    const PlanAction &from = actions[point];
+    temperature = from.temperature;
+    speed = from.speed;
+    if (point + 1 < actions.size() && actions[point + 1].op == PlanOp::Setpoint && t_ms > from.t_ms)
+    {
+        const PlanAction &to = actions[point + 1];
+        float f = static_cast<float>(t_ms - from.t_ms) / static_cast<float>(to.t_ms - from.t_ms);
+        temperature += (to.temperature - from.temperature) * f;
+        speed += (to.speed - from.speed) * f;
+    }
+    if (section.profile >= 0)
+    {
+        const PlanProfile &profile = profiles[section.profile];
+        double t = t_ms / 1000.0, d = section.duration_ms / 1000.0;
+        float file_temperature, file_speed;
+        if (reader != nullptr && reader->at(t, file_temperature, file_speed))
+        {
+            temperature = std::min(std::max(file_temperature, 0.0f), planMaxTemperature);
+            speed = std::min(std::max(file_speed, 0.0f), planMaxSpeed);
+        }
+        temperature = profile_value(profile.temperature, t, d, temperature, planMaxTemperature);
+        speed = profile_value(profile.speed, t, d, speed, planMaxSpeed);
+    }
+}
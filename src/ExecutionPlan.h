@@ -0,0 +1,94 @@
+#ifndef EXECUTIONPLAN_H
+#define EXECUTIONPLAN_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "Expression.h"
+#include "ProfileFile.h"
+#include "Trigger.h"
+
+class TimeLine;
+
+// Set value ranges of the RCT 5 (OUT_SP_1, OUT_SP_4)
+static const float planMaxTemperature = 310;
+static const float planMaxSpeed = 1500;
+
+enum class PlanOp : uint8_t
+{
+    SectionStart, // Log marker and section header
+    Command,      // Pre-section command, commands[arg]
+    Start,        // Start heater (arg bit 0) and motor (arg bit 1)
+    Setpoint,     // Set values at t_ms, they move linearly to the next Setpoint of the section
+    SectionEnd,   // End of the timed part of the section, at t_ms
+    PostCommand,  // Post-section command, commands[arg]
+    Wait,         // Wait for the user (arg bit 0) or the set values (arg bit 1)
+};
+
+struct PlanAction
+{
+    uint32_t t_ms;     // Due time from the start of the section
+    uint32_t arg;
+    float temperature;
+    float speed;
+    PlanOp op;
+};
+
+struct PlanSection
+{
+    size_t first;      // First action of the section
+    size_t end;        // One past the last action
+    uint32_t duration_ms;
+    bool waits;        // Ends with an open ended wait
+    int32_t profile;   // Index into profiles, -1 for the linear ramps
+    uint32_t trigger_first; // Run of triggers
+    uint32_t trigger_end;
+    float settle_band[2];   // Wait for value, see SettlingDetector
+    float settle_hold;
+    float end_temperature;  // Set values at the end of the timed part
+    float end_speed;
+};
+
+// Repeat block of the timeline, the executor jumps back from last to first until count passes are done
+struct PlanRepeat
+{
+    uint32_t first;
+    uint32_t last;
+    uint32_t count;
+};
+
+// Profile file and expressions replacing the ramps of a section. The file replaces both channels,
+// a non-empty expression replaces its channel on top of the ramp or the file.
+struct PlanProfile
+{
+    Expression temperature;
+    Expression speed;
+    std::string file; // Resolved path, empty for none
+};
+
+// Everything a run does, in order, compiled from the timeline before the run starts. The plan is
+// not changed afterwards, edits of the timeline during the run do not reach the executor.
+class ExecutionPlan
+{
+public:
+    std::vector<PlanAction> actions;
+    std::vector<PlanSection> sections;
+    std::vector<std::string> commands;
+    std::vector<PlanProfile> profiles;
+    std::vector<Trigger> triggers;
+    std::vector<PlanRepeat> repeats; // Inner blocks before the outer ones that end with the same section
+    uint64_t total_ms; // Timed part of the whole run, repeats included
+    uint64_t waits;    // Open ended waits in the run, not part of total_ms
+
+    // Fails on set values outside of the device limits, in the sections and in OUT_SP commands
+    static std::shared_ptr<const ExecutionPlan> compile(const TimeLine &timeline, std::string &error);
+    // Set values t_ms into the section, point is the Setpoint at or before t_ms and only moves forward.
+    // reader streams the profile file of the section, if it has one (t_ms must not decrease then either).
+    void set_values(const PlanSection &section, size_t &point, uint32_t t_ms, float &temperature, float &speed, ProfileReader *reader = nullptr) const;
+    // Section to run after index; iterations holds the finished passes of every repeat block.
+    // jumped is the repeat block that jumps back, -1 if the run goes on with the next section.
+    size_t next_section(size_t index, std::vector<uint32_t> &iterations, int32_t &jumped) const;
+};
+
+#endif // EXECUTIONPLAN_H
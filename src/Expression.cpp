@@ -0,0 +1,447 @@
+#include "Expression.h"
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+#include <algorithm>
+
+struct ExprFunction
+{
+    const char *name;
+    int args;
+};
+
+static const ExprFunction functions[] = {
+    {"exp", 1}, {"log", 1}, {"sqrt", 1}, {"sin", 1}, {"cos", 1}, {"tan", 1}, {"tanh", 1}, {"abs", 1}, {"floor", 1}, {"ceil", 1},
+    {"min", 2}, {"max", 2}, {"pow", 2}, {"mod", 2}, {"clamp", 3}};
+
+static double call(uint8_t function, const double *a)
+{
+    switch (function)
+    {
+    case 0:
+        return std::exp(a[0]);
+    case 1:
+        return std::log(a[0]);
+    case 2:
+        return std::sqrt(a[0]);
+    case 3:
+        return std::sin(a[0]);
+    case 4:
+        return std::cos(a[0]);
+    case 5:
+        return std::tan(a[0]);
+    case 6:
+        return std::tanh(a[0]);
+    case 7:
+        return std::abs(a[0]);
+    case 8:
+        return std::floor(a[0]);
+    case 9:
+        return std::ceil(a[0]);
+    case 10:
+        return std::min(a[0], a[1]);
+    case 11:
+        return std::max(a[0], a[1]);
+    case 12:
+        return std::pow(a[0], a[1]);
+    case 13:
+        return std::fmod(a[0], a[1]);
+    default:
+        return std::min(std::max(a[0], a[1]), a[2]);
+    }
+}
+
+// Stack machine, the depth was checked when the code was compiled
+static double run(const ExprInstr *begin, const ExprInstr *end, double t, double d)
+{
+    double stack[Expression::maxDepth];
+    size_t sp = 0;
+    for (const ExprInstr *i = begin; i != end; ++i)
+    {
+        switch (i->op)
+        {
+        case ExprOp::Const:
+            stack[sp++] = i->value;
+            break;
+        case ExprOp::Time:
+            stack[sp++] = t;
+            break;
+        case ExprOp::Duration:
+            stack[sp++] = d;
+            break;
+        case ExprOp::Neg:
+            stack[sp - 1] = -stack[sp - 1];
+            break;
+        case ExprOp::Add:
+            sp--;
+            stack[sp - 1] += stack[sp];
+            break;
+        case ExprOp::Sub:
+            sp--;
+            stack[sp - 1] -= stack[sp];
+            break;
+        case ExprOp::Mul:
+            sp--;
+            stack[sp - 1] *= stack[sp];
+            break;
+        case ExprOp::Div:
+            sp--;
+            stack[sp - 1] /= stack[sp];
+            break;
+        case ExprOp::Pow:
+            sp--;
+            stack[sp - 1] = std::pow(stack[sp - 1], stack[sp]);
+            break;
+        case ExprOp::Less:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] < stack[sp];
+            break;
+        case ExprOp::Greater:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] > stack[sp];
+            break;
+        case ExprOp::LessEqual:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] <= stack[sp];
+            break;
+        case ExprOp::GreaterEqual:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] >= stack[sp];
+            break;
+        case ExprOp::Select:
+            sp -= 2;
+            stack[sp - 1] = stack[sp - 1] != 0 ? stack[sp] : stack[sp + 1];
+            break;
+        case ExprOp::Call:
+            sp -= functions[i->function].args - 1;
+            stack[sp - 1] = call(i->function, &stack[sp - 1]);
+            break;
+        }
+    }
+    return sp > 0 ? stack[sp - 1] : NAN;
+}
+
+// Recursive descent, lowest precedence first:
+//   select  = compare ['?' select ':' select]
+//   compare = sum [('<' | '>' | '<=' | '>=') sum]
+//   sum     = product {('+' | '-') product}
+//   product = unary {('*' | '/') unary}
+//   unary   = '-' unary | power
+//   power   = primary ['^' unary]
+//   primary = number | t | d | pi | e | function '(' select {',' select} ')' | '(' select ')'
+struct ExprParser
+{
+    const std::string &text;
+    size_t pos;
+    std::vector<ExprInstr> &code;
+    size_t depth;
+    size_t max_depth;
+    std::string error;
+    int nesting = 0; // Recursion of the parser, bounded for text from files
+
+    bool enter()
+    {
+        return ++nesting <= 256 || fail("Expression is nested too deeply");
+    }
+
+    void skip()
+    {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+        {
+            pos++;
+        }
+    }
+    bool accept(const char *token)
+    {
+        skip();
+        size_t n = std::char_traits<char>::length(token);
+        if (text.compare(pos, n, token) == 0)
+        {
+            pos += n;
+            return true;
+        }
+        return false;
+    }
+    bool fail(const std::string &message)
+    {
+        if (error.empty())
+        {
+            error = message + " at column " + std::to_string(pos + 1);
+        }
+        return false;
+    }
+    std::string identifier()
+    {
+        skip();
+        size_t start = pos;
+        while (pos < text.size() && (std::isalnum(static_cast<unsigned char>(text[pos])) || text[pos] == '_'))
+        {
+            pos++;
+        }
+        return text.substr(start, pos - start);
+    }
+    void push(ExprOp op, double value = 0)
+    {
+        code.push_back(ExprInstr{op, 0, value});
+        max_depth = std::max(max_depth, ++depth);
+    }
+    // Appends an operation on the last n values; on constants it is evaluated right away
+    void emit(ExprOp op, size_t n, uint8_t function = 0)
+    {
+        code.push_back(ExprInstr{op, function, 0});
+        depth -= n - 1;
+        size_t first = code.size() - 1 - n;
+        bool constant = code.size() > n && std::all_of(code.begin() + first, code.end() - 1, [](const ExprInstr &i)
+                                                       { return i.op == ExprOp::Const; });
+        if (constant)
+        {
+            double value = run(code.data() + first, code.data() + code.size(), 0, 0);
+            code.resize(first);
+            code.push_back(ExprInstr{ExprOp::Const, 0, value});
+        }
+    }
+
+    bool select()
+    {
+        if (!enter() || !compare())
+        {
+            return false;
+        }
+        if (accept("?"))
+        {
+            if (!select() || !accept(":"))
+            {
+                return fail("Expected ':'");
+            }
+            if (!select())
+            {
+                return false;
+            }
+            emit(ExprOp::Select, 3);
+        }
+        nesting--;
+        return true;
+    }
+    bool compare()
+    {
+        if (!sum())
+        {
+            return false;
+        }
+        ExprOp op;
+        if (accept("<="))
+            op = ExprOp::LessEqual;
+        else if (accept(">="))
+            op = ExprOp::GreaterEqual;
+        else if (accept("<"))
+            op = ExprOp::Less;
+        else if (accept(">"))
+            op = ExprOp::Greater;
+        else
+            return true;
+        if (!sum())
+        {
+            return false;
+        }
+        emit(op, 2);
+        return true;
+    }
+    bool sum()
+    {
+        if (!product())
+        {
+            return false;
+        }
+        while (true)
+        {
+            ExprOp op;
+            if (accept("+"))
+                op = ExprOp::Add;
+            else if (accept("-"))
+                op = ExprOp::Sub;
+            else
+                return true;
+            if (!product())
+            {
+                return false;
+            }
+            emit(op, 2);
+        }
+    }
+    bool product()
+    {
+        if (!unary())
+        {
+            return false;
+        }
+        while (true)
+        {
+            ExprOp op;
+            if (accept("*"))
+                op = ExprOp::Mul;
+            else if (accept("/"))
+                op = ExprOp::Div;
+            else
+                return true;
+            if (!unary())
+            {
+                return false;
+            }
+            emit(op, 2);
+        }
+    }
+    bool unary()
+    {
+        if (accept("-"))
+        {
+            if (!enter() || !unary())
+            {
+                return false;
+            }
+            emit(ExprOp::Neg, 1);
+            nesting--;
+            return true;
+        }
+        accept("+");
+        return power();
+    }
+    bool power()
+    {
+        if (!primary())
+        {
+            return false;
+        }
+        if (accept("^"))
+        {
+            if (!enter() || !unary())
+            {
+                return false;
+            }
+            emit(ExprOp::Pow, 2);
+            nesting--;
+        }
+        return true;
+    }
+    bool primary()
+    {
+        skip();
+        if (pos >= text.size())
+        {
+            return fail("Unexpected end");
+        }
+        if (std::isdigit(static_cast<unsigned char>(text[pos])) || text[pos] == '.')
+        {
+            const char *begin = text.c_str() + pos;
+            char *end = nullptr;
+            double value = std::strtod(begin, &end);
+            if (end == begin)
+            {
+                return fail("Invalid number");
+            }
+            pos += end - begin;
+            push(ExprOp::Const, value);
+            return true;
+        }
+        if (accept("("))
+        {
+            if (!select())
+            {
+                return false;
+            }
+            return accept(")") || fail("Expected ')'");
+        }
+        size_t start = pos;
+        std::string name = identifier();
+        if (name.empty())
+        {
+            return fail("Unexpected '" + std::string(1, text[pos]) + "'");
+        }
+        if (name == "t")
+        {
+            push(ExprOp::Time);
+            return true;
+        }
+        if (name == "d")
+        {
+            push(ExprOp::Duration);
+            return true;
+        }
+        if (name == "pi" || name == "e")
+        {
+            push(ExprOp::Const, name == "pi" ? 3.14159265358979323846 : 2.71828182845904523536);
+            return true;
+        }
+        for (size_t f = 0; f < sizeof(functions) / sizeof(functions[0]); f++)
+        {
+            if (name != functions[f].name)
+            {
+                continue;
+            }
+            if (!accept("("))
+            {
+                return fail("Expected '(' after " + name);
+            }
+            for (int a = 0; a < functions[f].args; a++)
+            {
+                if ((a > 0 && !accept(",")) || !select())
+                {
+                    return fail(name + " takes " + std::to_string(functions[f].args) + " argument(s)");
+                }
+            }
+            if (!accept(")"))
+            {
+                return fail(name + " takes " + std::to_string(functions[f].args) + " argument(s)");
+            }
+            emit(ExprOp::Call, functions[f].args, static_cast<uint8_t>(f));
+            return true;
+        }
+        pos = start;
+        return fail("Unknown name '" + name + "'");
+    }
+};
+
+Expression::Expression() : source(), code() {}
+
+bool Expression::compile(const std::string &text, std::string &error)
+{
+    source = text;
+    code.clear();
+    error.clear();
+    std::vector<ExprInstr> compiled;
+    ExprParser parser{text, 0, compiled, 0, 0, ""};
+    // An optional "T(t) =" in front, as the profile would be written on paper
+    parser.identifier();
+    if (!(parser.pos > 0 && parser.accept("(") && parser.accept("t") && parser.accept(")") && parser.accept("=") && !parser.accept("=")))
+    {
+        parser.pos = 0;
+    }
+    parser.skip();
+    if (parser.pos >= text.size())
+    {
+        return true; // Empty, no profile
+    }
+    if (!parser.select())
+    {
+        error = parser.error;
+        return false;
+    }
+    parser.skip();
+    if (parser.pos < text.size())
+    {
+        parser.fail("Unexpected '" + std::string(1, text[parser.pos]) + "'");
+        error = parser.error;
+        return false;
+    }
+    if (parser.max_depth > maxDepth)
+    {
+        error = "Expression is nested too deeply";
+        return false;
+    }
+    code.swap(compiled);
+    return true;
+}
+
+double Expression::eval(double t, double d) const
+{
+    return run(code.data(), code.data() + code.size(), t, d);
+}
@@ -0,0 +1,52 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+enum class ExprOp : uint8_t
+{
+    Const,
+    Time,     // t, seconds since the section start
+    Duration, // d, duration of the section in seconds
+    Neg,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Pow,
+    Less,
+    Greater,
+    LessEqual,
+    GreaterEqual,
+    Select, // c ? a : b
+    Call,   // Built-in function, see Expression.cpp
+};
+
+struct ExprInstr
+{
+    ExprOp op;
+    uint8_t function;
+    double value;
+};
+
+// Set value profile in t, e.g. "25 + 60*(1 - exp(-t/300))" or "t < 600 ? 80 : 80 + 5*sin(2*pi*t/120)".
+// compile() parses the text once into stack machine code with the constant parts folded, eval()
+// runs it without allocating. A leading "T(t) =" is accepted and ignored.
+class Expression
+{
+public:
+    Expression();
+    bool compile(const std::string &text, std::string &error);
+    double eval(double t, double d) const;
+    bool empty() const { return code.empty(); }
+    std::string source;
+
+    static const size_t maxDepth = 32;
+
+private:
+    std::vector<ExprInstr> code;
+};
+
+#endif // EXPRESSION_H
@@ -1,144 +1,326 @@
-
 #include "FileOperations.h"
+#include "LogJournal.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <fstream>
+#include <filesystem>
+#include <unordered_map>
 
-// Serialization for Section class
-void FileOperations::saveSection(const Section& section, std::ofstream& outFile) {
-    size_t nameLength = section.name.size();
-    outFile.write(reinterpret_cast<const char*>(&nameLength), sizeof(nameLength));
-    outFile.write(section.name.c_str(), nameLength);
-    
-    size_t descriptionLength = section.description.size();
-    outFile.write(reinterpret_cast<const char*>(&descriptionLength), sizeof(descriptionLength));
-    outFile.write(section.description.c_str(), descriptionLength);
-    
-    outFile.write(reinterpret_cast<const char*>(&section.duration), sizeof(section.duration));
-    outFile.write(reinterpret_cast<const char*>(section.temperature), sizeof(section.temperature));
-    outFile.write(reinterpret_cast<const char*>(section.speed), sizeof(section.speed));
-    
-    outFile.write(reinterpret_cast<const char*>(&section.wait_user), sizeof(section.wait_user));
-    outFile.write(reinterpret_cast<const char*>(&section.wait_value), sizeof(section.wait_value));
-    outFile.write(reinterpret_cast<const char*>(&section.b_beep), sizeof(section.b_beep));
-    
-    size_t preSectionCommandsSize = section.preSectionCommands.size();
-    outFile.write(reinterpret_cast<const char*>(&preSectionCommandsSize), sizeof(preSectionCommandsSize));
-    for (const auto& command : section.preSectionCommands) {
-        size_t commandLength = command.size();
-        outFile.write(reinterpret_cast<const char*>(&commandLength), sizeof(commandLength));
-        outFile.write(command.c_str(), commandLength);
-    }
+// Unversioned format of earlier releases: optional blocks after the sections, each one starts with its tag
+static const uint32_t logIntervalsTag = 0x5649474C; // "LGIV", per channel log intervals
+static const uint32_t adaptiveLogTag = 0x4441474C;  // "LGAD", adaptive sampling settings
+static const uint32_t logFlushTag = 0x4C46474C;     // "LGFL", log writer flush policy
+static const uint32_t logJournalTag = 0x4E4A474C;   // "LGJN", journal and group commit interval
+static const uint32_t logRotationTag = 0x5452474C;  // "LGRT", log segment rotation
 
-    size_t postSectionCommandsSize = section.postSectionCommands.size();
-    outFile.write(reinterpret_cast<const char*>(&postSectionCommandsSize), sizeof(postSectionCommandsSize));
-    for (const auto& command : section.postSectionCommands) {
-        size_t commandLength = command.size();
-        outFile.write(reinterpret_cast<const char*>(&commandLength), sizeof(commandLength));
-        outFile.write(command.c_str(), commandLength);
+// Bounded reader for the unversioned format: no length is trusted beyond the bytes left in the file
+struct LegacyReader {
+    const char *p;
+    const char *end;
+    bool ok;
+
+    template <typename T>
+    bool get(T &value) {
+        if (!ok || static_cast<size_t>(end - p) < sizeof(value)) {
+            ok = false;
+            return false;
+        }
+        std::memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        return true;
     }
-}
+    bool get(std::string &text) {
+        size_t length = 0;
+        if (!get(length) || length > static_cast<size_t>(end - p)) {
+            ok = false;
+            return false;
+        }
+        text.assign(p, length);
+        p += length;
+        return true;
+    }
+    // Element count of a list whose elements take at least min_bytes each
+    bool count(size_t &n, size_t min_bytes) {
+        if (get(n) && n > static_cast<size_t>(end - p) / min_bytes) {
+            ok = false;
+        }
+        return ok;
+    }
+};
 
 // Serialization for TimeLine class
-void FileOperations::saveTimeLine(const TimeLine &timeline, const std::string &filename) {
-    std::ofstream outFile(filename, std::ios::binary);
-    
-    size_t nameLength = timeline.name.size();
-    outFile.write(reinterpret_cast<const char*>(&nameLength), sizeof(nameLength));
-    outFile.write(timeline.name.c_str(), nameLength);
-    
-    size_t descriptionLength = timeline.description.size();
-    outFile.write(reinterpret_cast<const char*>(&descriptionLength), sizeof(descriptionLength));
-    outFile.write(timeline.description.c_str(), descriptionLength);
-    
-    outFile.write(reinterpret_cast<const char*>(&timeline.logInterval), sizeof(timeline.logInterval));
-    outFile.write(reinterpret_cast<const char*>(&timeline.logTemperaturePlate), sizeof(timeline.logTemperaturePlate));
-    outFile.write(reinterpret_cast<const char*>(&timeline.logSpeed), sizeof(timeline.logSpeed));
-    outFile.write(reinterpret_cast<const char*>(&timeline.logViscosity), sizeof(timeline.logViscosity));
-    outFile.write(reinterpret_cast<const char*>(&timeline.logTemperatureSensor), sizeof(timeline.logTemperatureSensor));
-    
-    
-    size_t logFilePathLength = timeline.logFilePath.size();
-    outFile.write(reinterpret_cast<const char*>(&logFilePathLength), sizeof(logFilePathLength));
-    outFile.write(timeline.logFilePath.c_str(), logFilePathLength);
-    
-    size_t sectionsSize = timeline.sections.size();
-    outFile.write(reinterpret_cast<const char*>(&sectionsSize), sizeof(sectionsSize));
-    for (const auto& section : timeline.sections) {
-        saveSection(section, outFile);
-    }
-}
+bool FileOperations::saveTimeLine(const TimeLine &timeline, const std::string &filename, std::string *error) {
+    // Repeated strings, commands above all, are stored once
+    std::string pool;
+    std::unordered_map<std::string, TmlString> interned;
+    auto intern = [&pool, &interned](const std::string &text) {
+        auto it = interned.find(text);
+        if (it != interned.end()) {
+            return it->second;
+        }
+        TmlString s{static_cast<uint32_t>(pool.size()), static_cast<uint32_t>(text.size())};
+        pool += text;
+        interned.emplace(text, s);
+        return s;
+    };
 
-// Deserialization for Section class
-void FileOperations::loadSection(Section& section, std::ifstream& inFile) {
-    size_t nameLength;
-    inFile.read(reinterpret_cast<char*>(&nameLength), sizeof(nameLength));
-    section.name.resize(nameLength);
-    inFile.read(&section.name[0], nameLength);
-    
-    size_t descriptionLength;
-    inFile.read(reinterpret_cast<char*>(&descriptionLength), sizeof(descriptionLength));
-    section.description.resize(descriptionLength);
-    inFile.read(&section.description[0], descriptionLength);
-    
-    inFile.read(reinterpret_cast<char*>(&section.duration), sizeof(section.duration));
-    inFile.read(reinterpret_cast<char*>(section.temperature), sizeof(section.temperature));
-    inFile.read(reinterpret_cast<char*>(section.speed), sizeof(section.speed));
-    
-    inFile.read(reinterpret_cast<char*>(&section.wait_user), sizeof(section.wait_user));
-    inFile.read(reinterpret_cast<char*>(&section.wait_value), sizeof(section.wait_value));
-    inFile.read(reinterpret_cast<char*>(&section.b_beep), sizeof(section.b_beep));
-    
-    size_t preSectionCommandsSize;
-    inFile.read(reinterpret_cast<char*>(&preSectionCommandsSize), sizeof(preSectionCommandsSize));
-    section.preSectionCommands.resize(preSectionCommandsSize);
-    for (auto& command : section.preSectionCommands) {
-        size_t commandLength;
-        inFile.read(reinterpret_cast<char*>(&commandLength), sizeof(commandLength));
-        command.resize(commandLength);
-        inFile.read(&command[0], commandLength);
+    std::vector<TmlString> commands;
+    std::vector<TmlSection> sections;
+    for (const Section &section : timeline.sections) {
+        TmlSection s{};
+        s.name = intern(section.name);
+        s.description = intern(section.description);
+        s.duration = static_cast<uint32_t>(std::min<size_t>(section.duration, UINT32_MAX));
+        std::copy(section.temperature, section.temperature + 2, s.temperature);
+        std::copy(section.speed, section.speed + 2, s.speed);
+        s.wait_user = section.wait_user;
+        s.wait_value = section.wait_value;
+        s.beep = section.b_beep;
+        s.pre_first = static_cast<uint32_t>(commands.size());
+        s.pre_count = static_cast<uint32_t>(section.preSectionCommands.size());
+        for (const std::string &command : section.preSectionCommands) {
+            commands.push_back(intern(command));
+        }
+        s.post_first = static_cast<uint32_t>(commands.size());
+        s.post_count = static_cast<uint32_t>(section.postSectionCommands.size());
+        for (const std::string &command : section.postSectionCommands) {
+            commands.push_back(intern(command));
+        }
+        s.temperature_profile = intern(section.temperatureProfile);
+        s.speed_profile = intern(section.speedProfile);
+        s.profile_file = intern(section.profileFile);
+        s.triggers = intern(TriggerSet::to_text(section.triggers));
+        std::copy(section.settleBand, section.settleBand + 2, s.settle_band);
+        s.settle_hold = section.settleHold;
+        sections.push_back(s);
+    }
+    std::vector<TmlRepeat> repeats;
+    for (const RepeatBlock &block : timeline.repeats) {
+        repeats.push_back(TmlRepeat{block.first, block.last, block.count, 0});
     }
 
-    size_t postSectionCommandsSize;
-    inFile.read(reinterpret_cast<char*>(&postSectionCommandsSize), sizeof(postSectionCommandsSize));
-    section.postSectionCommands.resize(postSectionCommandsSize);
-    for (auto& command : section.postSectionCommands) {
-        size_t commandLength;
-        inFile.read(reinterpret_cast<char*>(&commandLength), sizeof(commandLength));
-        command.resize(commandLength);
-        inFile.read(&command[0], commandLength);
+    TmlHeader header{};
+    std::memcpy(header.magic, tmlMagic, sizeof(tmlMagic));
+    // Readers of version 2 would skip the repeats
+    header.version = repeats.empty() ? tmlMinVersion : tmlRepeatVersion;
+    header.header_size = sizeof(TmlHeader);
+    header.byte_order = tmlByteOrder;
+    header.section_count = static_cast<uint32_t>(sections.size());
+    header.section_size = sizeof(TmlSection);
+    header.command_count = static_cast<uint32_t>(commands.size());
+    header.name = intern(timeline.name);
+    header.description = intern(timeline.description);
+    header.log_path = intern(timeline.logFilePath);
+    header.section_offset = sizeof(TmlHeader);
+    header.command_offset = header.section_offset + sections.size() * sizeof(TmlSection);
+    header.repeat_count = static_cast<uint32_t>(repeats.size());
+    header.pool_offset = header.command_offset + commands.size() * sizeof(TmlString) + repeats.size() * sizeof(TmlRepeat);
+    header.pool_size = pool.size();
+    header.file_size = header.pool_offset + pool.size();
+
+    TmlSettings &settings = header.settings;
+    std::copy(timeline.logIntervals, timeline.logIntervals + LOG_CHANNELS, settings.log_intervals);
+    std::copy(timeline.logDeadband, timeline.logDeadband + LOG_CHANNELS, settings.log_deadband);
+    settings.log_max_gap = timeline.logMaxGap;
+    settings.log_boost = timeline.logBoost;
+    settings.batch_records = timeline.logFlush.batch_records;
+    settings.max_delay_ms = timeline.logFlush.max_delay_ms;
+    settings.sync_interval_ms = timeline.logFlush.sync_interval_ms;
+    settings.rotation_seconds = timeline.logRotation.max_seconds;
+    settings.rotation_bytes = timeline.logRotation.max_bytes;
+    settings.log_channels = timeline.log_columns();
+    settings.adaptive = timeline.adaptiveLogging;
+    settings.journal = timeline.logFlush.journal;
+    settings.compress = timeline.logRotation.compress;
+
+    std::string file;
+    file.reserve(header.file_size);
+    file.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.append(reinterpret_cast<const char *>(sections.data()), sections.size() * sizeof(TmlSection));
+    file.append(reinterpret_cast<const char *>(commands.data()), commands.size() * sizeof(TmlString));
+    file.append(reinterpret_cast<const char *>(repeats.data()), repeats.size() * sizeof(TmlRepeat));
+    file += pool;
+    const size_t crc_end = offsetof(TmlHeader, crc) + sizeof(header.crc);
+    header.crc = crc32(file.data(), offsetof(TmlHeader, crc));
+    header.crc = crc32(file.data() + crc_end, file.size() - crc_end, header.crc);
+    std::memcpy(&file[offsetof(TmlHeader, crc)], &header.crc, sizeof(header.crc));
+
+    // A crash while saving leaves the previous version in place
+    std::string tmp = filename + ".tmp";
+    {
+        std::ofstream outFile(tmp, std::ios::binary | std::ios::trunc);
+        outFile.write(file.data(), file.size());
+        if (!outFile.good()) {
+            if (error) {
+                *error = "Could not write " + tmp;
+            }
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, filename, ec);
+    if (ec) {
+        if (error) {
+            *error = "Could not replace " + filename + ": " + ec.message();
+        }
+        return false;
     }
+    return true;
 }
 
 // Deserialization for TimeLine class
-void FileOperations::loadTimeLine(TimeLine& timeline, const std::string& filename) {
-    std::ifstream inFile(filename, std::ios::binary);
-    
-    size_t nameLength;
-    inFile.read(reinterpret_cast<char*>(&nameLength), sizeof(nameLength));
-    timeline.name.resize(nameLength);
-    inFile.read(&timeline.name[0], nameLength);
-    
-    size_t descriptionLength;
-    inFile.read(reinterpret_cast<char*>(&descriptionLength), sizeof(descriptionLength));
-    timeline.description.resize(descriptionLength);
-    inFile.read(&timeline.description[0], descriptionLength);
-    
-    inFile.read(reinterpret_cast<char*>(&timeline.logInterval), sizeof(timeline.logInterval));
-    inFile.read(reinterpret_cast<char*>(&timeline.logTemperaturePlate), sizeof(timeline.logTemperaturePlate));
-    inFile.read(reinterpret_cast<char*>(&timeline.logSpeed), sizeof(timeline.logSpeed));
-    inFile.read(reinterpret_cast<char*>(&timeline.logViscosity), sizeof(timeline.logViscosity));
-    inFile.read(reinterpret_cast<char*>(&timeline.logTemperatureSensor), sizeof(timeline.logTemperatureSensor));
-    
-    
-    size_t logFilePathLength;
-    inFile.read(reinterpret_cast<char*>(&logFilePathLength), sizeof(logFilePathLength));
-    timeline.logFilePath.resize(logFilePathLength);
-    inFile.read(&timeline.logFilePath[0], logFilePathLength);
-      
-    size_t sectionsSize;
-    inFile.read(reinterpret_cast<char*>(&sectionsSize), sizeof(sectionsSize));
+void FileOperations::fromView(TimeLine &timeline, const TimelineView &view) {
+    timeline.name = view.name();
+    timeline.description = view.description();
+    timeline.logFilePath = view.log_path();
+    const TmlSettings &settings = view.settings();
+    std::copy(settings.log_intervals, settings.log_intervals + LOG_CHANNELS, timeline.logIntervals);
+    std::copy(settings.log_deadband, settings.log_deadband + LOG_CHANNELS, timeline.logDeadband);
+    timeline.logMaxGap = settings.log_max_gap;
+    timeline.logBoost = settings.log_boost;
+    timeline.logFlush.batch_records = settings.batch_records;
+    timeline.logFlush.max_delay_ms = settings.max_delay_ms;
+    timeline.logFlush.sync_interval_ms = settings.sync_interval_ms;
+    timeline.logFlush.journal = settings.journal;
+    timeline.logRotation.max_seconds = settings.rotation_seconds;
+    timeline.logRotation.max_bytes = settings.rotation_bytes;
+    timeline.logRotation.compress = settings.compress;
+    timeline.adaptiveLogging = settings.adaptive;
+    timeline.logSpeed = settings.log_channels & (1 << LOG_SPEED);
+    timeline.logTemperaturePlate = settings.log_channels & (1 << LOG_T_PLATE);
+    timeline.logTemperatureSensor = settings.log_channels & (1 << LOG_T_SENSOR);
+    timeline.logViscosity = settings.log_channels & (1 << LOG_VISCOSITY);
+
+    timeline.sections.resize(view.sections());
+    for (uint32_t i = 0; i < view.sections(); i++) {
+        TmlSection s = view.section(i);
+        Section &section = timeline.sections[i];
+        section.timeline = &timeline;
+        section.name = view.string(s.name);
+        section.description = view.string(s.description);
+        section.duration = s.duration;
+        std::copy(s.temperature, s.temperature + 2, section.temperature);
+        std::copy(s.speed, s.speed + 2, section.speed);
+        section.wait_user = s.wait_user;
+        section.wait_value = s.wait_value;
+        section.b_beep = s.beep;
+        section.temperatureProfile = view.string(s.temperature_profile);
+        section.speedProfile = view.string(s.speed_profile);
+        section.profileFile = view.string(s.profile_file);
+        TriggerSet::from_text(std::string(view.string(s.triggers)), section.triggers); // Empty if a later version wrote kinds unknown here
+        bool settle_stored = s.settle_band[0] != 0 || s.settle_band[1] != 0 || s.settle_hold != 0;
+        section.settleBand[0] = settle_stored ? s.settle_band[0] : settleDefaultBand[0];
+        section.settleBand[1] = settle_stored ? s.settle_band[1] : settleDefaultBand[1];
+        section.settleHold = settle_stored ? s.settle_hold : settleDefaultHold;
+        section.preSectionCommands.clear();
+        for (uint32_t c = 0; c < s.pre_count; c++) {
+            section.preSectionCommands.emplace_back(view.command(s.pre_first + c));
+        }
+        section.postSectionCommands.clear();
+        for (uint32_t c = 0; c < s.post_count; c++) {
+            section.postSectionCommands.emplace_back(view.command(s.post_first + c));
+        }
+    }
+    timeline.repeats.clear();
+    for (uint32_t i = 0; i < view.repeats(); i++) {
+        TmlRepeat r = view.repeat(i);
+        timeline.repeats.push_back(RepeatBlock{r.first, r.last, r.count});
+    }
+}
+
+bool FileOperations::loadLegacy(TimeLine &timeline, const char *data, size_t size) {
+    LegacyReader in{data, data + size, true};
+    in.get(timeline.name);
+    in.get(timeline.description);
+
+    size_t logInterval = 10;
+    in.get(logInterval);
+    std::fill(timeline.logIntervals, timeline.logIntervals + LOG_CHANNELS, static_cast<float>(logInterval));
+    in.get(timeline.logTemperaturePlate);
+    in.get(timeline.logSpeed);
+    in.get(timeline.logViscosity);
+    in.get(timeline.logTemperatureSensor);
+    in.get(timeline.logFilePath);
+
+    // A section takes at least two string lengths, no count can ask for more than the file holds
+    size_t sectionsSize = 0;
+    if (!in.count(sectionsSize, 2 * sizeof(size_t))) {
+        return false;
+    }
     timeline.sections.resize(sectionsSize);
+    timeline.repeats.clear(); // Not part of the unversioned format
     for (auto& section : timeline.sections) {
         section.timeline = &timeline;
-        loadSection(section, inFile);
+        in.get(section.name);
+        in.get(section.description);
+        in.get(section.duration);
+        in.get(section.temperature);
+        in.get(section.speed);
+        in.get(section.wait_user);
+        in.get(section.wait_value);
+        in.get(section.b_beep);
+        size_t n = 0;
+        in.count(n, sizeof(size_t));
+        section.preSectionCommands.resize(in.ok ? n : 0);
+        for (auto& command : section.preSectionCommands) {
+            in.get(command);
+        }
+        n = 0;
+        in.count(n, sizeof(size_t));
+        section.postSectionCommands.resize(in.ok ? n : 0);
+        for (auto& command : section.postSectionCommands) {
+            in.get(command);
+        }
+        if (!in.ok) {
+            return false;
+        }
+    }
+
+    // Files of older versions end here, unknown blocks end the optional part
+    uint32_t tag = 0;
+    while (in.get(tag)) {
+        if (tag == logIntervalsTag) {
+            float logIntervals[LOG_CHANNELS];
+            if (in.get(logIntervals)) {
+                std::copy(logIntervals, logIntervals + LOG_CHANNELS, timeline.logIntervals);
+            }
+        } else if (tag == adaptiveLogTag) {
+            in.get(timeline.adaptiveLogging);
+            in.get(timeline.logDeadband);
+            in.get(timeline.logMaxGap);
+            in.get(timeline.logBoost);
+        } else if (tag == logFlushTag) {
+            in.get(timeline.logFlush.batch_records);
+            in.get(timeline.logFlush.max_delay_ms);
+        } else if (tag == logJournalTag) {
+            in.get(timeline.logFlush.journal);
+            in.get(timeline.logFlush.sync_interval_ms);
+        } else if (tag == logRotationTag) {
+            in.get(timeline.logRotation.max_bytes);
+            in.get(timeline.logRotation.max_seconds);
+            in.get(timeline.logRotation.compress);
+        } else {
+            break;
+        }
+    }
+    return true;
+}
+
+bool FileOperations::loadTimeLine(TimeLine& timeline, const std::string& filename, std::string *error) {
+    TimelineView view;
+    if (view.open(filename)) {
+        fromView(timeline, view);
+    } else {
+        MappedFile file;
+        bool legacy = file.open(filename) && !TimelineView::is_tml(file.data(), file.size());
+        if (!legacy || !loadLegacy(timeline, file.data(), file.size())) {
+            if (error) {
+                *error = legacy ? "Damaged timeline file " + filename : view.error;
+            }
+            return false;
+        }
     }
     timeline.current_section = 0;
     timeline.running = false;
@@ -146,4 +328,5 @@ void FileOperations::loadTimeLine(TimeLine& timeline, const std::string& filenam
     timeline.adjusting = false;
     timeline.b_stop = false;
     timeline.logData = LogData();
-}
\ No newline at end of file
+    return true;
+}
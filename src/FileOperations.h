@@ -1,12 +1,15 @@
 #include "TimeLine.h"
+#include "TimelineFile.h"
 
 class FileOperations
 {
 private:
-    static void saveSection(const Section &section, std::ofstream &outFile);
-    static void loadSection(Section &section, std::ifstream &inFile);
+    static bool loadLegacy(TimeLine &timeline, const char *data, size_t size);
 
 public:
-    static void saveTimeLine(const TimeLine &timeline, const std::string &filename);
-    static void loadTimeLine(TimeLine &timeline, const std::string &filename);
+    // Writes the version 2 format (TimelineFile.h) through a temporary file
+    static bool saveTimeLine(const TimeLine &timeline, const std::string &filename, std::string *error = nullptr);
+    // Reads version 2 files and the unversioned format of earlier releases; on error the timeline is left unchanged
+    static bool loadTimeLine(TimeLine &timeline, const std::string &filename, std::string *error = nullptr);
+    static void fromView(TimeLine &timeline, const TimelineView &view);
 };
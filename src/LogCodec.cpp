@@ -0,0 +1,210 @@
+#include "LogCodec.h"
+#include "LogJournal.h"
+#include <fstream>
+#include <vector>
+#include <cstring>
+
+static const char codecMagic[4] = {'R', 'L', 'Z', '1'};
+static const size_t chunkSize = 1 << 20;
+static const size_t minMatch = 4;
+static const size_t maxOffset = 65535;
+static const int hashBits = 14;
+
+static uint32_t read32(const char *p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash4(const char *p)
+{
+    return (read32(p) * 2654435761u) >> (32 - hashBits);
+}
+
+static void put_length(std::string &out, size_t length)
+{
+    while (length >= 255)
+    {
+        out += static_cast<char>(255);
+        length -= 255;
+    }
+    out += static_cast<char>(length);
+}
+
+std::string LogCodec::compress(const std::string &input)
+{
+    std::string out;
+    out.reserve(input.size() / 2 + 16);
+    std::vector<uint32_t> table(1 << hashBits, UINT32_MAX);
+    const char *src = input.data();
+    size_t n = input.size();
+    size_t anchor = 0; // Start of the pending literals
+    size_t pos = 0;
+
+    auto emit = [&](size_t literal_end, size_t match_length, size_t offset)
+    {
+        size_t literals = literal_end - anchor;
+        size_t ml = match_length >= minMatch ? match_length - minMatch : 0;
+        uint8_t token = static_cast<uint8_t>((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(ml, 15));
+        out += static_cast<char>(token);
+        if (literals >= 15)
+        {
+            put_length(out, literals - 15);
+        }
+        out.append(src + anchor, literals);
+        if (match_length == 0)
+        {
+            return; // Last sequence, literals only
+        }
+        out += static_cast<char>(offset & 0xFF);
+        out += static_cast<char>(offset >> 8);
+        if (ml >= 15)
+        {
+            put_length(out, ml - 15);
+        }
+    };
+
+    while (n >= minMatch && pos + minMatch <= n)
+    {
+        uint32_t h = hash4(src + pos);
+        uint32_t candidate = table[h];
+        table[h] = static_cast<uint32_t>(pos);
+        if (candidate != UINT32_MAX && pos - candidate <= maxOffset && read32(src + candidate) == read32(src + pos))
+        {
+            size_t length = minMatch;
+            while (pos + length < n && src[candidate + length] == src[pos + length])
+            {
+                length++;
+            }
+            emit(pos, length, pos - candidate);
+            pos += length;
+            anchor = pos;
+        }
+        else
+        {
+            pos++;
+        }
+    }
+    emit(n, 0, 0);
+    return out;
+}
+
+bool LogCodec::decompress(const std::string &input, size_t raw_size, std::string &output)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(input.data());
+    const uint8_t *end = p + input.size();
+    size_t start = output.size();
+    output.reserve(start + raw_size);
+
+    auto get_length = [&](size_t &length) -> bool
+    {
+        uint8_t b;
+        do
+        {
+            if (p >= end)
+            {
+                return false;
+            }
+            b = *p++;
+            length += b;
+        } while (b == 255);
+        return true;
+    };
+
+    while (p < end)
+    {
+        uint8_t token = *p++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !get_length(literals))
+        {
+            return false;
+        }
+        if (static_cast<size_t>(end - p) < literals)
+        {
+            return false;
+        }
+        output.append(reinterpret_cast<const char *>(p), literals);
+        p += literals;
+        if (p == end)
+        {
+            break;
+        }
+        if (end - p < 2)
+        {
+            return false;
+        }
+        size_t offset = p[0] | (p[1] << 8);
+        p += 2;
+        size_t length = token & 0x0F;
+        if (length == 15 && !get_length(length))
+        {
+            return false;
+        }
+        length += minMatch;
+        if (offset == 0 || offset > output.size() - start)
+        {
+            return false;
+        }
+        // Byte by byte, matches may overlap the bytes they produce
+        size_t from = output.size() - offset;
+        for (size_t i = 0; i < length; i++)
+        {
+            output += output[from + i];
+        }
+    }
+    return output.size() - start == raw_size;
+}
+
+bool LogCodec::compress_file(const std::string &source, const std::string &target)
+{
+    std::ifstream in(source, std::ios::binary);
+    std::ofstream out(target, std::ios::binary | std::ios::trunc);
+    if (!in.is_open() || !out.is_open())
+    {
+        return false;
+    }
+    out.write(codecMagic, sizeof(codecMagic));
+    std::string chunk(chunkSize, '\0');
+    while (in)
+    {
+        in.read(&chunk[0], chunkSize);
+        size_t got = static_cast<size_t>(in.gcount());
+        if (got == 0)
+        {
+            break;
+        }
+        std::string raw = chunk.substr(0, got);
+        std::string packed = compress(raw);
+        uint32_t header[3] = {static_cast<uint32_t>(got), static_cast<uint32_t>(packed.size()), crc32(raw.data(), raw.size())};
+        out.write(reinterpret_cast<const char *>(header), sizeof(header));
+        out.write(packed.data(), packed.size());
+    }
+    out.flush();
+    return in.eof() && out.good();
+}
+
+bool LogCodec::decompress_file(const std::string &source, std::string &output)
+{
+    std::ifstream in(source, std::ios::binary);
+    char magic[4];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, codecMagic, sizeof(magic)) != 0)
+    {
+        return false;
+    }
+    uint32_t header[3];
+    while (in.read(reinterpret_cast<char *>(header), sizeof(header)))
+    {
+        std::string packed(header[1], '\0');
+        if (!in.read(&packed[0], header[1]))
+        {
+            return false;
+        }
+        size_t start = output.size();
+        if (!decompress(packed, header[0], output) || crc32(output.data() + start, header[0]) != header[2])
+        {
+            return false;
+        }
+    }
+    return in.eof();
+}
@@ -0,0 +1,20 @@
+#ifndef LOGCODEC_H
+#define LOGCODEC_H
+
+#include <string>
+#include <cstdint>
+
+// Small built-in LZ77 codec for closed log segments, byte oriented like LZ4:
+// each sequence is a token (literal length, match length), the literals, and a
+// 16 bit offset back into the last 64 KiB. Text logs shrink to roughly a fifth.
+namespace LogCodec
+{
+    std::string compress(const std::string &input);
+    bool decompress(const std::string &input, size_t raw_size, std::string &output);
+
+    // File format: "RLZ1", then chunks of raw size (u32), compressed size (u32), CRC-32 of the raw data (u32), data
+    bool compress_file(const std::string &source, const std::string &target);
+    bool decompress_file(const std::string &source, std::string &output);
+}
+
+#endif // LOGCODEC_H
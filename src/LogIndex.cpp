@@ -0,0 +1,181 @@
+#include "LogIndex.h"
+#include "LogJournal.h"
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+static const uint32_t zoneMagic = 0x5A544352; // "RCTZ"
+
+static uint32_t entry_crc(const ZoneEntry &entry)
+{
+    return crc32(&entry, offsetof(ZoneEntry, crc));
+}
+
+ZoneBuilder::ZoneBuilder(uint32_t zone_rows) : zone_rows(zone_rows), zone(), open(false), rows(0), run(-1), run_start(0), section(-1) {}
+
+void ZoneBuilder::resume(const std::vector<ZoneEntry> &entries)
+{
+    if (!entries.empty())
+    {
+        run = entries.back().run;
+        run_start = entries.back().run_start;
+        section = entries.back().section;
+    }
+}
+
+void ZoneBuilder::add(const LogRecord &record, uint64_t block, uint32_t index, std::vector<ZoneEntry> &closed)
+{
+    // Zones never span a boundary, so a run or a section is always a set of whole zones
+    if (record.type == LogRecordType::Marker)
+    {
+        finish(closed);
+        if (record.marker == LogMarker::RunStart)
+        {
+            run++;
+            run_start = record.stamp;
+            section = -1;
+        }
+        else
+        {
+            section = record.index;
+        }
+    }
+    if (!open)
+    {
+        std::memset(&zone, 0, sizeof(zone));
+        zone.magic = zoneMagic;
+        zone.run = run;
+        zone.run_start = run_start;
+        zone.section = section;
+        zone.begin_block = block;
+        zone.begin_index = index;
+        open = true;
+        rows = 0;
+    }
+    zone.records++;
+    zone.end_block = block;
+    zone.end_index = index + 1;
+    if (record.type != LogRecordType::Row)
+    {
+        return;
+    }
+    for (int c = 0; c < LOG_MAX_COLUMNS; c++)
+    {
+        if (!(record.filled & (1 << c)) || std::isnan(record.value[c]))
+        {
+            continue;
+        }
+        ZoneChannel &ch = zone.channel[c];
+        float v = record.value[c];
+        if (ch.count == 0)
+        {
+            ch.min = ch.max = ch.first = v;
+            ch.t_first = record.t[c];
+        }
+        ch.min = std::min(ch.min, v);
+        ch.max = std::max(ch.max, v);
+        ch.last = v;
+        ch.t_last = record.t[c];
+        ch.sum += v;
+        ch.count++;
+    }
+    if (++rows >= zone_rows)
+    {
+        finish(closed);
+    }
+}
+
+void ZoneBuilder::finish(std::vector<ZoneEntry> &closed)
+{
+    if (!open)
+    {
+        return;
+    }
+    zone.crc = entry_crc(zone);
+    closed.push_back(zone);
+    open = false;
+}
+
+std::string ZoneMap::path(const std::string &log)
+{
+    return log + ".zones";
+}
+
+bool ZoneMap::load(const std::string &log, uint64_t journal_size, bool repair)
+{
+    file = path(log);
+    entries.clear();
+    rebuilt = 0;
+    error.clear();
+    {
+        std::ifstream in(file, std::ios::binary);
+        ZoneEntry entry;
+        while (in.read(reinterpret_cast<char *>(&entry), sizeof(entry)))
+        {
+            // The block holding the last record has to be intact
+            if (entry.magic != zoneMagic || entry.crc != entry_crc(entry) || entry.end_block >= journal_size)
+            {
+                break;
+            }
+            entries.push_back(entry);
+        }
+    }
+    std::error_code ec;
+    if (repair && std::filesystem::exists(file, ec) && std::filesystem::file_size(file, ec) != entries.size() * sizeof(ZoneEntry))
+    {
+        std::filesystem::resize_file(file, entries.size() * sizeof(ZoneEntry), ec);
+        if (ec)
+        {
+            error = "Could not repair zone map: " + ec.message();
+            return false;
+        }
+    }
+
+    // Index what the journal holds after the last zone
+    uint64_t from = entries.empty() ? 0 : entries.back().end_block;
+    uint32_t skip = entries.empty() ? 0 : entries.back().end_index;
+    if (from < journal_size)
+    {
+        ZoneBuilder builder;
+        builder.resume(entries);
+        std::vector<ZoneEntry> closed;
+        LogJournal::read(log + ".journal", from, journal_size - 1, [&](uint64_t block, uint32_t index, const LogRecord &record)
+                         {
+                             if (block > from || index >= skip)
+                             {
+                                 builder.add(record, block, index, closed);
+                             } });
+        builder.finish(closed);
+        rebuilt = closed.size();
+        if (repair && !append(closed))
+        {
+            return false;
+        }
+        if (!repair)
+        {
+            entries.insert(entries.end(), closed.begin(), closed.end());
+        }
+    }
+    return true;
+}
+
+bool ZoneMap::append(const std::vector<ZoneEntry> &closed)
+{
+    if (closed.empty())
+    {
+        return true;
+    }
+    std::ofstream out(file, std::ios::binary | std::ios::app);
+    out.write(reinterpret_cast<const char *>(closed.data()), closed.size() * sizeof(ZoneEntry));
+    out.flush();
+    if (!out.good())
+    {
+        error = "Could not write zone map " + file;
+        return false;
+    }
+    entries.insert(entries.end(), closed.begin(), closed.end());
+    return true;
+}
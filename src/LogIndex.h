@@ -0,0 +1,82 @@
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "LogWriter.h"
+
+// Summary of one channel within a zone
+struct ZoneChannel
+{
+    uint32_t count;        // Readings, NaN is not counted
+    float min, max;
+    float first, last;     // Values of the first and last reading
+    float t_first, t_last; // Their time stamps in seconds since the run start
+    uint32_t reserved;
+    double sum;
+};
+
+// Zone map entry: a run of consecutive journal records (at most zone_rows rows) that belong
+// to one section of one run. The records are addressed by the offset of the journal block they
+// start in and their position in it, so the zone can be decoded without reading anything else.
+struct ZoneEntry
+{
+    uint32_t magic;
+    int32_t run;          // Runs counted from the start of the journal, -1 before the first run marker
+    int64_t run_start;    // Unix time of the run start
+    int32_t section;      // -1 for the records before the first section
+    uint32_t records;     // Records of any type
+    uint64_t begin_block; // First record
+    uint32_t begin_index;
+    uint32_t end_index;   // One past the last record
+    uint64_t end_block;
+    ZoneChannel channel[LOG_MAX_COLUMNS];
+    uint32_t reserved;
+    uint32_t crc;         // CRC-32 of everything before it
+};
+
+static_assert(sizeof(ZoneEntry) == 376, "ZoneEntry is written to disk as is");
+
+// Cuts the record stream of the journal into zones, in the order the records were appended
+class ZoneBuilder
+{
+public:
+    explicit ZoneBuilder(uint32_t zone_rows = 4096);
+    void resume(const std::vector<ZoneEntry> &entries); // Continues the run numbering after these zones
+    void add(const LogRecord &record, uint64_t block, uint32_t index, std::vector<ZoneEntry> &closed);
+    void finish(std::vector<ZoneEntry> &closed); // Closes the open zone, if it has records
+
+private:
+    uint32_t zone_rows;
+    ZoneEntry zone;
+    bool open;
+    uint32_t rows;
+    int32_t run;
+    int64_t run_start;
+    int32_t section;
+};
+
+// Zone map of a log (<log>.zones): fixed size entries with a CRC, appended after the journal
+// block holding their last record. It can always be rebuilt from the journal, so it is never
+// synced; entries that are damaged or point past the intact journal are dropped on load, and
+// journal blocks without an entry are indexed again.
+class ZoneMap
+{
+public:
+    static std::string path(const std::string &log);
+
+    // journal_size: bytes of intact journal blocks. With repair the file is cut back to its valid
+    // entries and the rebuilt ones are appended, otherwise they are only kept in memory
+    bool load(const std::string &log, uint64_t journal_size, bool repair);
+    bool append(const std::vector<ZoneEntry> &closed);
+
+    std::vector<ZoneEntry> entries;
+    size_t rebuilt; // Entries indexed from the journal on load
+    std::string error;
+
+private:
+    std::string file;
+};
+
+#endif // LOGINDEX_H
@@ -0,0 +1,354 @@
+#include "LogJournal.h"
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <cerrno>
+#include <array>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t journalMagic = 0x4A544352; // "RCTJ"
+static const size_t headerSize = 4 + 8 + 4 + 4;
+static const uint32_t maxPayload = 64 * 1024 * 1024; // Anything larger is a corrupt length field
+
+uint32_t crc32(const void *data, size_t size, uint32_t crc)
+{
+    static const std::array<uint32_t, 256> table = []
+    {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t block_crc(uint64_t sequence, uint32_t length, const char *payload)
+{
+    uint32_t crc = crc32(&sequence, sizeof(sequence));
+    crc = crc32(&length, sizeof(length), crc);
+    return crc32(payload, length, crc);
+}
+
+template <typename T>
+static void put(std::string &out, const T &value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool get(const char *&p, const char *end, T &value)
+{
+    if (static_cast<size_t>(end - p) < sizeof(value))
+    {
+        return false;
+    }
+    std::memcpy(&value, p, sizeof(value));
+    p += sizeof(value);
+    return true;
+}
+
+LogJournal::LogJournal() : sequence(0), durable(0), recovered(0), truncated(0), size(0), error(), fd(-1) {}
+
+LogJournal::~LogJournal()
+{
+    close();
+}
+
+void LogJournal::encode(const LogRecord &record, std::string &payload)
+{
+    put(payload, static_cast<uint8_t>(record.type));
+    if (record.type == LogRecordType::Row)
+    {
+        put(payload, record.columns);
+        put(payload, record.filled);
+        for (int c = 0; c < LOG_MAX_COLUMNS; c++)
+        {
+            if (record.filled & (1 << c))
+            {
+                put(payload, record.t[c]);
+                put(payload, record.value[c]);
+            }
+        }
+    }
+    else
+    {
+        if (record.type == LogRecordType::Marker)
+        {
+            put(payload, static_cast<uint8_t>(record.marker));
+            put(payload, record.index);
+            put(payload, record.stamp);
+        }
+        put(payload, static_cast<uint32_t>(record.text.size()));
+        payload += record.text;
+    }
+}
+
+bool LogJournal::decode(const char *data, size_t size, std::vector<LogRecord> &records)
+{
+    const char *p = data;
+    const char *end = data + size;
+    while (p < end)
+    {
+        LogRecord record{};
+        uint8_t type;
+        if (!get(p, end, type) || type > static_cast<uint8_t>(LogRecordType::Marker))
+        {
+            return false;
+        }
+        record.type = static_cast<LogRecordType>(type);
+        if (record.type == LogRecordType::Row)
+        {
+            if (!get(p, end, record.columns) || !get(p, end, record.filled))
+            {
+                return false;
+            }
+            for (int c = 0; c < LOG_MAX_COLUMNS; c++)
+            {
+                if ((record.filled & (1 << c)) && (!get(p, end, record.t[c]) || !get(p, end, record.value[c])))
+                {
+                    return false;
+                }
+            }
+        }
+        else
+        {
+            uint8_t marker = 0;
+            if (record.type == LogRecordType::Marker &&
+                (!get(p, end, marker) || marker > static_cast<uint8_t>(LogMarker::SectionStart) || !get(p, end, record.index) || !get(p, end, record.stamp)))
+            {
+                return false;
+            }
+            record.marker = static_cast<LogMarker>(marker);
+            uint32_t length;
+            if (!get(p, end, length) || static_cast<size_t>(end - p) < length)
+            {
+                return false;
+            }
+            record.text.assign(p, length);
+            p += length;
+        }
+        records.push_back(std::move(record));
+    }
+    return true;
+}
+
+bool LogJournal::next_block(std::istream &in, uint64_t &sequence, std::vector<char> &payload)
+{
+    char header[headerSize];
+    if (!in.read(header, headerSize))
+    {
+        return false;
+    }
+    uint32_t magic, length, crc;
+    std::memcpy(&magic, header, 4);
+    std::memcpy(&sequence, header + 4, 8);
+    std::memcpy(&length, header + 12, 4);
+    std::memcpy(&crc, header + 16, 4);
+    if (magic != journalMagic || length > maxPayload)
+    {
+        return false;
+    }
+    payload.resize(length);
+    return in.read(payload.data(), length) && block_crc(sequence, length, payload.data()) == crc;
+}
+
+bool LogJournal::scan(const std::string &path, uint64_t &last_sequence, uint64_t &blocks, uint64_t &valid_end, std::vector<LogRecord> *records)
+{
+    last_sequence = 0;
+    blocks = 0;
+    valid_end = 0;
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open())
+    {
+        return false;
+    }
+    std::vector<char> payload;
+    uint64_t seq;
+    while (next_block(in, seq, payload))
+    {
+        // Sequence numbers start at 1 and have no gaps, a stale block from an older run breaks the chain
+        if (seq != last_sequence + 1)
+        {
+            break;
+        }
+        if (records != nullptr && !decode(payload.data(), payload.size(), *records))
+        {
+            break;
+        }
+        last_sequence = seq;
+        blocks++;
+        valid_end += headerSize + payload.size();
+    }
+    return true;
+}
+
+bool LogJournal::read(const std::string &path, uint64_t from, uint64_t to,
+                      const std::function<void(uint64_t block, uint32_t index, const LogRecord &record)> &record)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open() || !in.seekg(static_cast<std::streamoff>(from)))
+    {
+        return false;
+    }
+    std::vector<char> payload;
+    std::vector<LogRecord> records;
+    uint64_t seq;
+    uint64_t block = from;
+    while (block <= to && next_block(in, seq, payload))
+    {
+        records.clear();
+        if (!decode(payload.data(), payload.size(), records))
+        {
+            break;
+        }
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            record(block, static_cast<uint32_t>(i), records[i]);
+        }
+        block += headerSize + payload.size();
+    }
+    return true;
+}
+
+bool LogJournal::replay(const std::string &path, std::vector<LogRecord> &records)
+{
+    uint64_t last_sequence, blocks, valid_end;
+    return scan(path, last_sequence, blocks, valid_end, &records);
+}
+
+bool LogJournal::open(const std::string &path)
+{
+    close();
+    error.clear();
+    // Recovery: everything after the last intact block is a torn write of a crashed run
+    std::error_code ec;
+    uint64_t valid_end = 0;
+    if (scan(path, sequence, recovered, valid_end, nullptr))
+    {
+        uint64_t bytes = std::filesystem::file_size(path, ec);
+        if (!ec && bytes > valid_end)
+        {
+            std::filesystem::resize_file(path, valid_end, ec);
+            if (ec)
+            {
+                error = "Could not truncate damaged journal: " + ec.message();
+                return false;
+            }
+            truncated = bytes - valid_end;
+        }
+    }
+    size = valid_end;
+    durable = sequence;
+#ifdef _WIN32
+    fd = _open(path.c_str(), _O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+#endif
+    if (fd < 0)
+    {
+        error = "Could not open journal: " + std::string(std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool LogJournal::append(const std::string &payload)
+{
+    if (fd < 0)
+    {
+        return false;
+    }
+    uint64_t seq = sequence + 1;
+    uint32_t length = static_cast<uint32_t>(payload.size());
+    std::string block;
+    block.reserve(headerSize + length);
+    put(block, journalMagic);
+    put(block, seq);
+    put(block, length);
+    put(block, block_crc(seq, length, payload.data()));
+    block += payload;
+
+    // One write per block; a crash in the middle leaves a torn block that recovery cuts off
+    size_t done = 0;
+    while (done < block.size())
+    {
+#ifdef _WIN32
+        int n = _write(fd, block.data() + done, static_cast<unsigned int>(block.size() - done));
+#else
+        ssize_t n = ::write(fd, block.data() + done, block.size() - done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+#endif
+        if (n <= 0)
+        {
+            // Blocks after a torn one would be cut off by recovery anyway, stop appending
+            error = "Journal write failed: " + std::string(std::strerror(errno));
+            close();
+            return false;
+        }
+        done += n;
+    }
+    sequence = seq;
+    size += block.size();
+    return true;
+}
+
+bool LogJournal::sync()
+{
+    if (fd < 0 || durable == sequence)
+    {
+        return fd >= 0;
+    }
+#ifdef _WIN32
+    int result = _commit(fd);
+#elif defined(__APPLE__)
+    int result = fcntl(fd, F_FULLFSYNC);
+#else
+    int result = fdatasync(fd);
+#endif
+    if (result != 0)
+    {
+        error = "Journal sync failed: " + std::string(std::strerror(errno));
+        return false;
+    }
+    durable = sequence;
+    return true;
+}
+
+void LogJournal::close()
+{
+    if (fd < 0)
+    {
+        return;
+    }
+    sync();
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+    fd = -1;
+}
@@ -0,0 +1,54 @@
+#ifndef LOGJOURNAL_H
+#define LOGJOURNAL_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "LogWriter.h"
+
+// Append-only binary journal of log records, written next to the text log.
+// Every block holds one batch of records:
+//   magic (u32) | sequence (u64) | payload length (u32) | CRC-32 of sequence, length and payload (u32) | payload
+// Blocks become durable in groups: sync() is called every few seconds rather than per block,
+// so a crash loses at most the blocks written since the last sync. Opening the journal
+// truncates it after the last block with a valid CRC and sequence number.
+class LogJournal
+{
+public:
+    LogJournal();
+    ~LogJournal();
+    LogJournal(const LogJournal &) = delete;
+    LogJournal &operator=(const LogJournal &) = delete;
+
+    bool open(const std::string &path); // Recovers the file, then appends to it
+    bool append(const std::string &payload);
+    bool sync(); // fdatasync, everything appended so far is on disk afterwards
+    void close();
+
+    uint64_t sequence;    // Last block appended
+    uint64_t durable;     // Last block known to be on disk
+    uint64_t recovered;   // Valid blocks found on open
+    uint64_t truncated;   // Bytes of torn or corrupt blocks cut off on open
+    uint64_t size;        // Bytes of intact blocks, the offset of the next block
+    std::string error;    // Empty unless open, append or sync failed
+
+    static void encode(const LogRecord &record, std::string &payload);
+    // Reads all valid blocks of a journal, stops at the first damaged one
+    static bool replay(const std::string &path, std::vector<LogRecord> &records);
+    // Records of the blocks starting between the byte offsets from and to, with the offset of their
+    // block and their position in it; stops at the first damaged block
+    static bool read(const std::string &path, uint64_t from, uint64_t to,
+                     const std::function<void(uint64_t block, uint32_t index, const LogRecord &record)> &record);
+
+private:
+    int fd;
+
+    static bool scan(const std::string &path, uint64_t &last_sequence, uint64_t &blocks, uint64_t &valid_end, std::vector<LogRecord> *records);
+    static bool decode(const char *data, size_t size, std::vector<LogRecord> &records);
+    static bool next_block(std::istream &in, uint64_t &sequence, std::vector<char> &payload);
+};
+
+uint32_t crc32(const void *data, size_t size, uint32_t crc = 0); // CRC-32 (IEEE 802.3)
+
+#endif // LOGJOURNAL_H
@@ -0,0 +1,171 @@
+#include "LogQuery.h"
+#include "LogJournal.h"
+#include <filesystem>
+#include <algorithm>
+
+bool LogQuery::open(const std::string &log)
+{
+    journal = log + ".journal";
+    run_list.clear();
+    error.clear();
+    zones_summarized = zones_decoded = 0;
+    std::error_code ec;
+    uint64_t journal_size = std::filesystem::file_size(journal, ec);
+    if (ec)
+    {
+        error = "No journal for " + log;
+        return false;
+    }
+    // Read only: a log that is being written is indexed up to its last complete block
+    if (!map.load(log, journal_size, false))
+    {
+        error = map.error;
+        return false;
+    }
+    for (const ZoneEntry &zone : map.entries)
+    {
+        if (run_list.empty() || run_list.back().number != zone.run)
+        {
+            LogRun run{zone.run, zone.run_start, "", 0, 0, 0};
+            // The run marker is the first record of the first zone of a run
+            LogJournal::read(journal, zone.begin_block, zone.begin_block, [&](uint64_t, uint32_t index, const LogRecord &record)
+                             {
+                                 if (index == zone.begin_index && record.type == LogRecordType::Marker)
+                                 {
+                                     run.name = record.text;
+                                 } });
+            run_list.push_back(run);
+        }
+        LogRun &run = run_list.back();
+        run.sections = std::max(run.sections, zone.section + 1);
+        run.records += zone.records;
+        for (const ZoneChannel &ch : zone.channel)
+        {
+            if (ch.count > 0)
+            {
+                run.t_end = std::max(run.t_end, ch.t_last);
+            }
+        }
+    }
+    return true;
+}
+
+const std::vector<LogRun> &LogQuery::runs() const
+{
+    return run_list;
+}
+
+bool LogQuery::matches(const ZoneEntry &zone, const LogRange &range) const
+{
+    return (range.run < 0 || zone.run == range.run) &&
+           (range.section < 0 || zone.section == range.section) &&
+           zone.run_start >= range.since && zone.run_start <= range.until;
+}
+
+void LogQuery::decode(const ZoneEntry &zone, int channel, const std::function<void(float t, float v)> &reading)
+{
+    zones_decoded++;
+    LogJournal::read(journal, zone.begin_block, zone.end_block, [&](uint64_t block, uint32_t index, const LogRecord &record)
+                     {
+                         // The first and last block may hold records of the neighbouring zones
+                         bool inside = (block > zone.begin_block || index >= zone.begin_index) &&
+                                       (block < zone.end_block || index < zone.end_index);
+                         if (inside && record.type == LogRecordType::Row && (record.filled & (1 << channel)) && !std::isnan(record.value[channel]))
+                         {
+                             reading(record.t[channel], record.value[channel]);
+                         } });
+}
+
+LogAggregate LogQuery::aggregate(int channel, const LogRange &range)
+{
+    zones_summarized = zones_decoded = 0;
+    LogAggregate result;
+    if (channel < 0 || channel >= LOG_MAX_COLUMNS)
+    {
+        return result;
+    }
+    auto merge = [&result](uint64_t count, float min, float max, double sum)
+    {
+        result.min = result.count > 0 ? std::min(result.min, min) : min;
+        result.max = result.count > 0 ? std::max(result.max, max) : max;
+        result.sum += sum;
+        result.count += count;
+    };
+    for (const ZoneEntry &zone : map.entries)
+    {
+        const ZoneChannel &ch = zone.channel[channel];
+        if (!matches(zone, range) || ch.count == 0 || ch.t_last < range.t_from || ch.t_first > range.t_to)
+        {
+            continue;
+        }
+        if (ch.t_first >= range.t_from && ch.t_last <= range.t_to)
+        {
+            merge(ch.count, ch.min, ch.max, ch.sum);
+            zones_summarized++;
+            continue;
+        }
+        decode(zone, channel, [&](float t, float v)
+               {
+                   if (t >= range.t_from && t <= range.t_to)
+                   {
+                       merge(1, v, v, v);
+                   } });
+    }
+    return result;
+}
+
+std::vector<LogCrossing> LogQuery::crossings(int channel, float threshold, const LogRange &range)
+{
+    zones_summarized = zones_decoded = 0;
+    std::vector<LogCrossing> result;
+    if (channel < 0 || channel >= LOG_MAX_COLUMNS)
+    {
+        return result;
+    }
+    bool has_previous = false; // Crossings are only counted between readings that follow each other in the range
+    bool below = false;
+    int32_t run = 0;
+    auto step = [&](const ZoneEntry &zone, float t, float v)
+    {
+        bool b = v < threshold;
+        if (has_previous && b != below)
+        {
+            result.push_back(LogCrossing{zone.run, zone.section, t, v, !b});
+        }
+        below = b;
+        has_previous = true;
+    };
+    for (const ZoneEntry &zone : map.entries)
+    {
+        const ZoneChannel &ch = zone.channel[channel];
+        if (zone.run != run)
+        {
+            has_previous = false;
+            run = zone.run;
+        }
+        if (ch.count == 0)
+        {
+            continue;
+        }
+        if (!matches(zone, range) || ch.t_last < range.t_from || ch.t_first > range.t_to)
+        {
+            has_previous = false;
+            continue;
+        }
+        // A zone entirely on one side can only cross at its first reading
+        bool inside = ch.t_first >= range.t_from && ch.t_last <= range.t_to;
+        if (inside && (ch.max < threshold || ch.min >= threshold))
+        {
+            step(zone, ch.t_first, ch.first);
+            zones_summarized++;
+            continue;
+        }
+        decode(zone, channel, [&](float t, float v)
+               {
+                   if (t >= range.t_from && t <= range.t_to)
+                   {
+                       step(zone, t, v);
+                   } });
+    }
+    return result;
+}
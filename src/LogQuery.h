@@ -0,0 +1,75 @@
+#ifndef LOGQUERY_H
+#define LOGQUERY_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <functional>
+#include "LogIndex.h"
+
+// Which part of the logged history a query covers
+struct LogRange
+{
+    int32_t run = -1;                                         // -1 for every run
+    int32_t section = -1;                                     // -1 for every section
+    int64_t since = std::numeric_limits<int64_t>::min();      // Run start, unix time
+    int64_t until = std::numeric_limits<int64_t>::max();
+    float t_from = -std::numeric_limits<float>::infinity();   // Seconds since the run start
+    float t_to = std::numeric_limits<float>::infinity();
+};
+
+struct LogAggregate
+{
+    uint64_t count = 0;
+    float min = NAN, max = NAN;
+    double sum = 0;
+    double mean() const { return count > 0 ? sum / count : NAN; }
+};
+
+struct LogCrossing
+{
+    int32_t run;
+    int32_t section;
+    float t;     // First reading on the other side
+    float value;
+    bool rising;
+};
+
+struct LogRun
+{
+    int32_t number;
+    int64_t start; // Unix time
+    std::string name;
+    int32_t sections;
+    float t_end;   // Last time stamp of any channel
+    uint64_t records;
+};
+
+// Range queries over the journal of a log that read the zone map and decode only the zones
+// at the edges of the range: zones completely inside it are answered from their summary.
+class LogQuery
+{
+public:
+    bool open(const std::string &log); // Loads the zone map, blocks written since are indexed in memory
+    const std::vector<LogRun> &runs() const;
+    LogAggregate aggregate(int channel, const LogRange &range);
+    // Readings where the channel passes the threshold, rising means from below to at or above
+    std::vector<LogCrossing> crossings(int channel, float threshold, const LogRange &range);
+
+    uint64_t zones_summarized = 0; // Statistics of the last query
+    uint64_t zones_decoded = 0;
+    std::string error;
+
+private:
+    std::string journal;
+    ZoneMap map;
+    std::vector<LogRun> run_list;
+
+    bool matches(const ZoneEntry &zone, const LogRange &range) const;
+    // Readings of one channel in a zone, in the order they were logged
+    void decode(const ZoneEntry &zone, int channel, const std::function<void(float t, float v)> &reading);
+};
+
+#endif // LOGQUERY_H
@@ -0,0 +1,267 @@
+#include "LogSegments.h"
+#include "LogCodec.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static std::mutex index_mutex; // Writers and the compressor update the same index files
+
+static const char *state_names[] = {"open", "closed", "compressed"};
+
+std::string LogSegments::index_path(const std::string &log)
+{
+    return log + ".index";
+}
+
+std::string LogSegments::segment_path(const std::string &log, const LogSegment &segment)
+{
+    return (std::filesystem::path(log).parent_path() / segment.file).string();
+}
+
+static std::vector<LogSegment> read_index(const std::string &log)
+{
+    std::vector<LogSegment> segments;
+    std::ifstream in(LogSegments::index_path(log));
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        // Tab separated, file names may contain spaces
+        std::vector<std::string> fields;
+        std::istringstream in_line(line);
+        std::string field;
+        while (std::getline(in_line, field, '\t'))
+        {
+            fields.push_back(field);
+        }
+        if (fields.size() < 6)
+        {
+            continue;
+        }
+        LogSegment segment{};
+        std::string state = fields[5];
+        try
+        {
+            segment.number = static_cast<uint32_t>(std::stoul(fields[0]));
+            segment.file = fields[1];
+            segment.t_start = std::stoll(fields[2]);
+            segment.t_end = std::stoll(fields[3]);
+            segment.bytes = std::stoull(fields[4]);
+        }
+        catch (const std::exception &)
+        {
+            continue;
+        }
+        segment.state = LogSegment::Open;
+        for (int s = 0; s < 3; s++)
+        {
+            if (state == state_names[s])
+            {
+                segment.state = static_cast<LogSegment::State>(s);
+            }
+        }
+        segments.push_back(segment);
+    }
+    return segments;
+}
+
+static void write_index(const std::string &log, const std::vector<LogSegment> &segments)
+{
+    std::string path = LogSegments::index_path(log);
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << "# segment\tfile\tstart\tend\tbytes\tstate" << std::endl;
+        for (const LogSegment &s : segments)
+        {
+            out << s.number << "\t" << s.file << "\t" << s.t_start << "\t" << s.t_end << "\t" << s.bytes << "\t" << state_names[s.state] << std::endl;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+}
+
+std::vector<LogSegment> LogSegments::load_index(const std::string &log)
+{
+    std::lock_guard<std::mutex> lock(index_mutex);
+    return read_index(log);
+}
+
+void LogSegments::update(const std::string &log, const LogSegment &segment)
+{
+    std::lock_guard<std::mutex> lock(index_mutex);
+    std::vector<LogSegment> segments = read_index(log);
+    auto it = std::find_if(segments.begin(), segments.end(), [&segment](const LogSegment &s)
+                           { return s.number == segment.number; });
+    if (it != segments.end())
+    {
+        *it = segment;
+    }
+    else
+    {
+        segments.push_back(segment);
+        std::sort(segments.begin(), segments.end(), [](const LogSegment &a, const LogSegment &b)
+                  { return a.number < b.number; });
+    }
+    write_index(log, segments);
+}
+
+LogSegment LogSegments::next_segment(const std::string &log)
+{
+    std::vector<LogSegment> segments = load_index(log);
+    LogSegment segment{};
+    segment.number = segments.empty() ? 1 : segments.back().number + 1;
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), ".%04u", segment.number);
+    segment.file = std::filesystem::path(log).filename().string() + suffix;
+    segment.state = LogSegment::Open;
+    return segment;
+}
+
+static void read_lines(std::istream &in, const std::function<void(const std::string &line)> &line)
+{
+    std::string text;
+    while (std::getline(in, text))
+    {
+        line(text);
+    }
+}
+
+bool LogSegments::read(const std::string &log, const std::function<void(const std::string &line)> &line)
+{
+    bool found = false;
+    std::ifstream plain(log);
+    if (plain.is_open())
+    {
+        read_lines(plain, line);
+        found = true;
+    }
+    for (const LogSegment &segment : load_index(log))
+    {
+        std::string path = segment_path(log, segment);
+        std::string text;
+        // A segment stays readable while it is being compressed: the plain file is removed last
+        if (segment.state == LogSegment::Compressed && LogCodec::decompress_file(path + ".rlz", text))
+        {
+            std::istringstream in(text);
+            read_lines(in, line);
+            found = true;
+            continue;
+        }
+        std::ifstream in(path);
+        if (in.is_open())
+        {
+            read_lines(in, line);
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool LogSegments::export_log(const std::string &log, const std::string &target)
+{
+    std::ofstream out(target, std::ios::trunc);
+    if (!out.is_open())
+    {
+        return false;
+    }
+    bool found = read(log, [&out](const std::string &line)
+                      { out << line << '\n'; });
+    return found && out.good();
+}
+
+LogCompressor &LogCompressor::instance()
+{
+    static LogCompressor compressor;
+    return compressor;
+}
+
+LogCompressor::LogCompressor() : jobs(), mutex(), wake(), running(true), worker()
+{
+    worker = std::thread([this]
+                         { compress_thread(); });
+}
+
+LogCompressor::~LogCompressor()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_one();
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+void LogCompressor::enqueue(const std::string &log, const LogSegment &segment)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.emplace_back(log, segment);
+    }
+    wake.notify_one();
+}
+
+size_t LogCompressor::pending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return jobs.size();
+}
+
+void LogCompressor::compress_thread()
+{
+    // Compression must never compete with the control loop or the log writer
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#else
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+#endif
+    while (true)
+    {
+        std::pair<std::string, LogSegment> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]
+                      { return !running || !jobs.empty(); });
+            if (!running)
+            {
+                return; // Segments left behind stay readable uncompressed and are picked up by the next run
+            }
+            job = jobs.front();
+            jobs.pop_front();
+        }
+        const std::string &log = job.first;
+        LogSegment segment = job.second;
+        std::string path = LogSegments::segment_path(log, segment);
+        std::error_code ec;
+        // Written under a temporary name, the index only points to complete files
+        if (!LogCodec::compress_file(path, path + ".rlz.tmp"))
+        {
+            std::filesystem::remove(path + ".rlz.tmp", ec);
+            continue;
+        }
+        std::filesystem::rename(path + ".rlz.tmp", path + ".rlz", ec);
+        if (ec)
+        {
+            continue;
+        }
+        segment.state = LogSegment::Compressed;
+        LogSegments::update(log, segment);
+        std::filesystem::remove(path, ec);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef LOGSEGMENTS_H
+#define LOGSEGMENTS_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+// When the log writer starts a new segment; with both limits at 0 the log is one file as before
+struct LogRotation
+{
+    uint64_t max_bytes = 0;   // Segment size limit
+    uint32_t max_seconds = 0; // Wall clock period of a segment
+    bool compress = true;     // Compress closed segments in the background
+    bool enabled() const { return max_bytes > 0 || max_seconds > 0; }
+};
+
+struct LogSegment
+{
+    enum State
+    {
+        Open,
+        Closed,
+        Compressed
+    };
+    uint32_t number;
+    std::string file; // File name next to the index, without directory
+    int64_t t_start;  // Unix time of the first and last write
+    int64_t t_end;
+    uint64_t bytes;   // Uncompressed size
+    State state;
+};
+
+// Segmented log: <log>.index lists the segments <log>.0001, <log>.0002, ... in order.
+// Compressed segments get the extension .rlz. The index is rewritten as a whole through
+// a temporary file, so it is never half written.
+namespace LogSegments
+{
+    std::string index_path(const std::string &log);
+    std::string segment_path(const std::string &log, const LogSegment &segment);
+    std::vector<LogSegment> load_index(const std::string &log);
+    void update(const std::string &log, const LogSegment &segment); // Adds or replaces the segment in the index
+    LogSegment next_segment(const std::string &log);                 // Numbered after the last one in the index
+
+    // Lines of the whole log: the plain file (written before rotation was enabled), then every segment
+    bool read(const std::string &log, const std::function<void(const std::string &line)> &line);
+    bool export_log(const std::string &log, const std::string &target); // One plain text file
+}
+
+// Compresses closed segments on a low priority thread, one for the whole program
+class LogCompressor
+{
+public:
+    static LogCompressor &instance();
+    void enqueue(const std::string &log, const LogSegment &segment);
+    size_t pending();
+    ~LogCompressor();
+
+private:
+    LogCompressor();
+    std::deque<std::pair<std::string, LogSegment>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool running;
+    std::thread worker;
+    void compress_thread();
+};
+
+#endif // LOGSEGMENTS_H
@@ -0,0 +1,361 @@
+#include "LogWriter.h"
+#include "LogJournal.h"
+#include "LogIndex.h"
+#include "Utilities.h"
+#include <chrono>
+
+static int64_t unix_time()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+LogWriter::LogWriter(const std::string &path, LogFlushPolicy policy, LogRotation rotation, size_t capacity)
+    : path(path), policy(policy), rotation(rotation), high_water(0), dropped(0), written(0), batches(0), max_write_ms(0), failed(false),
+      journal_seq(0), durable_seq(0), syncs(0), segment(0), queue(capacity), writer(), wake_mutex(), wake(), closing(false),
+      journal(), zones(), status_mutex(), status()
+{
+    writer = std::thread([this]
+                         { writer_thread(); });
+}
+
+LogWriter::~LogWriter()
+{
+    close();
+}
+
+std::string LogWriter::journal_status()
+{
+    std::lock_guard<std::mutex> lock(status_mutex);
+    return status;
+}
+
+size_t LogWriter::depth() const
+{
+    return queue.size();
+}
+
+size_t LogWriter::capacity() const
+{
+    return queue.capacity();
+}
+
+bool LogWriter::push(LogRecord &&record)
+{
+    if (!queue.try_push(std::move(record)))
+    {
+        dropped++;
+        return false;
+    }
+    size_t d = queue.size();
+    size_t hw = high_water.load();
+    while (d > hw && !high_water.compare_exchange_weak(hw, d))
+    {
+    }
+    // A full batch wakes the writer early, otherwise it comes around after max_delay_ms
+    if (d >= policy.batch_records)
+    {
+        wake.notify_one();
+    }
+    return true;
+}
+
+bool LogWriter::text(const std::string &line)
+{
+    LogRecord record{};
+    record.type = LogRecordType::Text;
+    record.text = line;
+    return push(std::move(record));
+}
+
+bool LogWriter::event(const std::string &text)
+{
+    LogRecord record{};
+    record.type = LogRecordType::Event;
+    record.text = text;
+    return push(std::move(record));
+}
+
+bool LogWriter::row(uint8_t columns, uint8_t filled, const float *t, const float *value)
+{
+    LogRecord record{};
+    record.type = LogRecordType::Row;
+    record.columns = columns;
+    record.filled = filled;
+    for (int c = 0; c < LOG_MAX_COLUMNS; c++)
+    {
+        if (filled & (1 << c))
+        {
+            record.t[c] = t[c];
+            record.value[c] = value[c];
+        }
+    }
+    return push(std::move(record));
+}
+
+bool LogWriter::marker(LogMarker kind, int32_t index, const std::string &name)
+{
+    LogRecord record{};
+    record.type = LogRecordType::Marker;
+    record.marker = kind;
+    record.index = index;
+    record.stamp = unix_time();
+    record.text = name;
+    return push(std::move(record));
+}
+
+void LogWriter::close()
+{
+    closing = true;
+    wake.notify_one();
+    if (writer.joinable())
+    {
+        writer.join();
+    }
+}
+
+void LogWriter::format(const LogRecord &record, std::string &out)
+{
+    switch (record.type)
+    {
+    case LogRecordType::Text:
+        out += record.text;
+        break;
+    case LogRecordType::Event:
+        out += "# " + record.text;
+        break;
+    case LogRecordType::Row:
+        // Every logged channel has a time and a value column, empty if it has no reading
+        for (int c = 0; c < LOG_MAX_COLUMNS; c++)
+        {
+            if (!(record.columns & (1 << c)))
+            {
+                continue;
+            }
+            if (record.filled & (1 << c))
+            {
+                out += ftos(record.t[c], 2) + "\t" + ftos(record.value[c], 1) + "\t";
+            }
+            else
+            {
+                out += "\t\t";
+            }
+        }
+        break;
+    case LogRecordType::Marker:
+        return; // Not part of the text log
+    }
+    out += '\n';
+}
+
+bool LogWriter::open_segment(std::ofstream &file, LogSegment &current)
+{
+    current = LogSegments::next_segment(path);
+    current.t_start = current.t_end = unix_time();
+    file.open(LogSegments::segment_path(path, current), std::ios::app);
+    LogSegments::update(path, current);
+    segment = current.number;
+    return file.is_open();
+}
+
+void LogWriter::close_segment(std::ofstream &file, LogSegment &current)
+{
+    file.close();
+    current.t_end = unix_time();
+    current.state = LogSegment::Closed;
+    LogSegments::update(path, current);
+    if (rotation.compress)
+    {
+        LogCompressor::instance().enqueue(path, current);
+    }
+}
+
+void LogWriter::writer_thread()
+{
+    std::ofstream file;
+    LogSegment current{};
+    if (rotation.enabled())
+    {
+        // Segments a crashed or earlier run left uncompressed
+        for (LogSegment s : LogSegments::load_index(path))
+        {
+            if (s.state != LogSegment::Compressed)
+            {
+                s.state = LogSegment::Closed;
+                LogSegments::update(path, s);
+                if (rotation.compress)
+                {
+                    LogCompressor::instance().enqueue(path, s);
+                }
+            }
+        }
+        failed = !open_segment(file, current);
+    }
+    else
+    {
+        file.open(path, std::ios::app);
+        failed = !file.is_open();
+    }
+    if (policy.journal)
+    {
+        journal.reset(new LogJournal());
+        bool opened = journal->open(path + ".journal");
+        std::lock_guard<std::mutex> lock(status_mutex);
+        if (!opened)
+        {
+            status = journal->error;
+            journal.reset();
+        }
+        else if (journal->truncated > 0)
+        {
+            status = "Journal recovered: " + std::to_string(journal->recovered) + " blocks kept, " + std::to_string(journal->truncated) + " damaged bytes cut off";
+        }
+        journal_seq = durable_seq = opened ? journal->sequence : 0;
+    }
+    // The zone map indexes journal blocks, it exists only with the journal
+    ZoneBuilder builder;
+    std::vector<ZoneEntry> closed;
+    if (journal)
+    {
+        zones.reset(new ZoneMap());
+        if (zones->load(path, journal->size, true))
+        {
+            builder.resume(zones->entries);
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(status_mutex);
+            status = zones->error;
+            zones.reset();
+        }
+    }
+    std::string buffer;
+    std::string payload;
+    LogRecord record;
+    auto t_first = std::chrono::steady_clock::now(); // Oldest record not written yet
+    auto t_sync = std::chrono::steady_clock::now();  // Last group commit
+    auto sync_interval = std::chrono::milliseconds(std::max<uint32_t>(policy.sync_interval_ms, 1));
+    bool pending = false;
+
+    while (true)
+    {
+        bool stop = closing.load();
+        auto t_now = std::chrono::steady_clock::now();
+        size_t waiting = queue.size();
+        if (waiting > 0 && !pending)
+        {
+            pending = true;
+            t_first = t_now;
+        }
+        // Group commit: one fdatasync for everything appended since the last one
+        bool unsynced = journal && journal->durable != journal->sequence;
+        if (unsynced && (stop || t_now - t_sync >= sync_interval))
+        {
+            if (journal->sync())
+            {
+                durable_seq = journal->durable;
+                syncs++;
+            }
+            t_sync = t_now;
+        }
+        auto age = t_now - t_first;
+        bool due = stop || waiting >= policy.batch_records || (pending && age >= std::chrono::milliseconds(policy.max_delay_ms));
+        if (!due)
+        {
+            // The producers never take this lock, a missed notify only delays the write until the timeout
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            auto timeout = pending ? std::chrono::milliseconds(policy.max_delay_ms) - std::chrono::duration_cast<std::chrono::milliseconds>(age)
+                                   : std::chrono::milliseconds(policy.max_delay_ms);
+            if (unsynced)
+            {
+                timeout = std::min(timeout, std::chrono::duration_cast<std::chrono::milliseconds>(sync_interval - (t_now - t_sync)));
+            }
+            wake.wait_for(lock, std::max(timeout, std::chrono::milliseconds(1)));
+            continue;
+        }
+
+        buffer.clear();
+        payload.clear();
+        size_t n = 0;
+        uint64_t block = journal ? journal->size : 0; // Offset the batch is appended at
+        while (queue.try_pop(record))
+        {
+            format(record, buffer);
+            if (journal)
+            {
+                LogJournal::encode(record, payload);
+            }
+            if (zones)
+            {
+                builder.add(record, block, static_cast<uint32_t>(n), closed);
+            }
+            n++;
+        }
+        pending = false;
+        if (n > 0)
+        {
+            auto t_write = std::chrono::steady_clock::now();
+            if (journal && !journal->append(payload))
+            {
+                std::lock_guard<std::mutex> lock(status_mutex);
+                status = journal->error;
+                journal.reset();
+                zones.reset();
+            }
+            if (journal)
+            {
+                journal_seq = journal->sequence;
+            }
+            // Zones are written after the block holding their last record
+            if (zones && !zones->append(closed))
+            {
+                std::lock_guard<std::mutex> lock(status_mutex);
+                status = zones->error;
+                zones.reset();
+            }
+            closed.clear();
+            // A batch goes into one segment as a whole, rows are never split
+            if (rotation.enabled() && current.bytes > 0 &&
+                ((rotation.max_bytes > 0 && current.bytes + buffer.size() > rotation.max_bytes) ||
+                 (rotation.max_seconds > 0 && unix_time() - current.t_start >= rotation.max_seconds)))
+            {
+                close_segment(file, current);
+                failed = !open_segment(file, current);
+            }
+            if (failed)
+            {
+                dropped += n;
+            }
+            else
+            {
+                current.bytes += buffer.size();
+                file.write(buffer.data(), buffer.size());
+                file.flush();
+                written += n;
+                batches++;
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_write).count();
+            if (ms > max_write_ms.load())
+            {
+                max_write_ms = ms;
+            }
+        }
+        if (stop && queue.size() == 0)
+        {
+            if (rotation.enabled() && file.is_open())
+            {
+                close_segment(file, current);
+            }
+            if (zones)
+            {
+                builder.finish(closed);
+                zones->append(closed);
+            }
+            if (journal)
+            {
+                journal->close();
+                durable_seq = journal->durable;
+            }
+            break;
+        }
+    }
+}
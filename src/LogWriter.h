@@ -0,0 +1,108 @@
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <fstream>
+#include <cstdint>
+#include <memory>
+#include "MpmcQueue.h"
+#include "LogSegments.h"
+
+static const int LOG_MAX_COLUMNS = 8; // Channels one log row can hold
+
+enum class LogRecordType
+{
+    Text,  // Line written as is
+    Event, // Connection event, written as a "# " comment
+    Row,   // Readings, formatted by the writer thread
+    Marker // Run or section boundary, only in the journal and the zone map
+};
+
+enum class LogMarker : uint8_t
+{
+    RunStart,
+    SectionStart
+};
+
+struct LogRecord
+{
+    LogRecordType type;
+    std::string text;             // Text and Event, Marker: run or section name
+    uint8_t columns;              // Row: channels with a column in the log, one bit per channel
+    uint8_t filled;               // Row: channels with a reading in this row
+    float t[LOG_MAX_COLUMNS];     // Row: time stamp per channel in seconds
+    float value[LOG_MAX_COLUMNS]; // Row: reading per channel
+    LogMarker marker;             // Marker: kind
+    int32_t index;                // Marker: section index
+    int64_t stamp;                // Marker: unix time
+};
+
+// When the writer thread goes to the disk
+struct LogFlushPolicy
+{
+    uint32_t batch_records = 64;  // Write as soon as this many records are waiting
+    uint32_t max_delay_ms = 1000; // Longest time a record waits for the disk
+    bool journal = true;              // Also append every batch to the crash safe journal (<log>.journal) and index it (<log>.zones)
+    uint32_t sync_interval_ms = 2000; // Group commit: the journal is synced to disk this often
+};
+
+class LogJournal;
+class ZoneMap;
+
+// Appends log records to a file on its own thread. Producers never block and never
+// touch the disk: records go into a bounded lock-free queue, a full queue drops the
+// record and counts it.
+class LogWriter
+{
+public:
+    LogWriter(const std::string &path, LogFlushPolicy policy, LogRotation rotation = LogRotation(), size_t capacity = 4096);
+    ~LogWriter();
+    LogWriter(const LogWriter &) = delete;
+    LogWriter &operator=(const LogWriter &) = delete;
+
+    bool push(LogRecord &&record); // false if the queue was full and the record was dropped
+    bool text(const std::string &line);
+    bool event(const std::string &text);
+    bool row(uint8_t columns, uint8_t filled, const float *t, const float *value);
+    bool marker(LogMarker kind, int32_t index, const std::string &name);
+    void close(); // Writes everything queued and stops the thread
+
+    const std::string path;
+    const LogFlushPolicy policy;
+    const LogRotation rotation;
+    size_t depth() const;                     // Records waiting
+    size_t capacity() const;                  // Queue size
+    std::atomic<size_t> high_water;           // Deepest the queue has been
+    std::atomic<uint64_t> dropped;            // Records lost to a full queue or an unwritable file
+    std::atomic<uint64_t> written;            // Records written
+    std::atomic<uint64_t> batches;            // Writes to the file
+    std::atomic<double> max_write_ms;         // Slowest write and flush
+    std::atomic<bool> failed;                 // The file could not be opened
+    std::atomic<uint64_t> journal_seq;        // Last journal block written
+    std::atomic<uint64_t> durable_seq;        // Last journal block synced to disk, a crash loses nothing up to here
+    std::atomic<uint64_t> syncs;              // Group commits
+    std::string journal_status();             // Recovery result or journal error
+    std::atomic<uint32_t> segment;            // Number of the segment being written, 0 without rotation
+
+private:
+    MpmcQueue<LogRecord> queue;
+    std::thread writer;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::atomic<bool> closing;
+    std::unique_ptr<LogJournal> journal;
+    std::unique_ptr<ZoneMap> zones;
+    std::mutex status_mutex;
+    std::string status;
+
+    void writer_thread();
+    bool open_segment(std::ofstream &file, LogSegment &current);
+    void close_segment(std::ofstream &file, LogSegment &current);
+    static void format(const LogRecord &record, std::string &out);
+};
+
+#endif // LOGWRITER_H
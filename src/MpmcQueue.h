@@ -0,0 +1,118 @@
+#ifndef MPMCQUEUE_H
+#define MPMCQUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock-free multi-producer multi-consumer queue (D. Vyukov's ring buffer).
+// Each cell carries a sequence number telling producers and consumers whose turn it is,
+// so push and pop never take a lock and never block; a full or empty queue just fails.
+template <typename T>
+class MpmcQueue
+{
+public:
+    explicit MpmcQueue(size_t capacity) : cells(), mask(0), head(0), tail(0)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    MpmcQueue(const MpmcQueue &) = delete;
+    MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+    bool try_push(T &&item)
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;)
+        {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (dif == 0)
+            {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (dif < 0)
+            {
+                return false; // Full
+            }
+            else
+            {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(item);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &item)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;)
+        {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (dif == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (dif < 0)
+            {
+                return false; // Empty
+            }
+            else
+            {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->data);
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+    // Only a snapshot while other threads push or pop
+    size_t size() const
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_relaxed);
+        return h > t ? h - t : 0;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head; // Next position to push
+    alignas(64) std::atomic<size_t> tail; // Next position to pop
+};
+
+#endif // MPMCQUEUE_H
@@ -0,0 +1,405 @@
+#include "PortDiscovery.h"
+#include "SerialPort.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+#ifndef _WIN32
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <climits>
+#endif
+
+std::string PortInfo::label() const
+{
+    if (vid.empty())
+    {
+        return path;
+    }
+    std::string text = path + "  (" + (product.empty() ? vid + ":" + pid : product);
+    if (!serial.empty())
+    {
+        text += ", S/N " + serial;
+    }
+    return text + ")";
+}
+
+PortDiscovery::PortDiscovery() : list(), events(), mutex(), watcher(), running(false), gen(0), wake_fd{-1, -1} {}
+
+PortDiscovery::~PortDiscovery()
+{
+    stop();
+}
+
+uint64_t PortDiscovery::generation() const
+{
+    return gen.load();
+}
+
+std::vector<PortInfo> PortDiscovery::ports()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return list;
+}
+
+std::vector<PortEvent> PortDiscovery::poll_events()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<PortEvent> pending;
+    pending.swap(events);
+    return pending;
+}
+
+int PortDiscovery::find(const std::vector<PortInfo> &ports, const std::string &key)
+{
+    int prefixed = -1;
+    int n_prefixed = 0;
+    for (size_t i = 0; i < ports.size(); i++)
+    {
+        if (ports[i].key == key)
+        {
+            return static_cast<int>(i);
+        }
+        // Keys saved before the interface number was part of them
+        if (!key.empty() && ports[i].key.size() > key.size() && ports[i].key.compare(0, key.size(), key) == 0 && ports[i].key[key.size()] == ':')
+        {
+            prefixed = static_cast<int>(i);
+            n_prefixed++;
+        }
+    }
+    return n_prefixed == 1 ? prefixed : -1;
+}
+
+void PortDiscovery::remove_port(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = std::find_if(list.begin(), list.end(), [&path](const PortInfo &p)
+                           { return p.path == path; });
+    if (it == list.end())
+    {
+        return;
+    }
+    events.push_back({false, *it});
+    list.erase(it);
+    gen++;
+}
+
+#ifdef _WIN32
+
+void PortDiscovery::add_port(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const PortInfo &p : list)
+    {
+        if (p.path == path)
+        {
+            return;
+        }
+    }
+    PortInfo info;
+    info.key = path;
+    info.path = path;
+    list.push_back(info);
+    events.push_back({true, info});
+    gen++;
+}
+
+void PortDiscovery::refresh_links() {}
+
+void PortDiscovery::rescan()
+{
+    std::vector<std::string> present = listSerialPorts();
+    for (const PortInfo &p : ports())
+    {
+        if (std::find(present.begin(), present.end(), p.path) == present.end())
+        {
+            remove_port(p.path);
+        }
+    }
+    for (const std::string &path : present)
+    {
+        add_port(path);
+    }
+}
+
+void PortDiscovery::watch_thread()
+{
+    // No change notifications for COM ports without a message loop, poll instead
+    while (running)
+    {
+        for (int i = 0; i < 10 && running; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        if (running)
+        {
+            rescan();
+        }
+    }
+}
+
+void PortDiscovery::start()
+{
+    if (running)
+    {
+        return;
+    }
+    rescan();
+    running = true;
+    watcher = std::thread([this]
+                          { watch_thread(); });
+}
+
+void PortDiscovery::stop()
+{
+    running = false;
+    if (watcher.joinable())
+    {
+        watcher.join();
+    }
+}
+
+#else
+
+static bool is_serial_node(const std::string &name)
+{
+    return name.rfind("ttyUSB", 0) == 0 || name.rfind("ttyACM", 0) == 0 || name.rfind("ttyS", 0) == 0;
+}
+
+static std::string read_sysfs(const std::filesystem::path &file)
+{
+    std::ifstream in(file);
+    std::string value;
+    std::getline(in, value);
+    return value;
+}
+
+// Look up the USB device behind a tty node. The key prefers the serial number and falls
+// back to the physical USB port, so it does not change when the node is renumbered.
+// The interface number tells the ports of a multi-port adapter (FT2232, FT4232) apart.
+static PortInfo describe(const std::string &path)
+{
+    PortInfo info;
+    info.path = path;
+    info.key = path;
+    std::error_code ec;
+    std::string name = std::filesystem::path(path).filename().string();
+    std::filesystem::path dev = std::filesystem::canonical("/sys/class/tty/" + name + "/device", ec);
+    if (ec)
+    {
+        return info;
+    }
+    std::string interface;
+    for (std::filesystem::path p = dev; p != p.parent_path(); p = p.parent_path())
+    {
+        if (interface.empty() && std::filesystem::exists(p / "bInterfaceNumber", ec))
+        {
+            interface = read_sysfs(p / "bInterfaceNumber");
+        }
+        if (std::filesystem::exists(p / "idVendor", ec))
+        {
+            info.vid = read_sysfs(p / "idVendor");
+            info.pid = read_sysfs(p / "idProduct");
+            info.serial = read_sysfs(p / "serial");
+            info.product = read_sysfs(p / "product");
+            info.key = "usb:" + info.vid + ":" + info.pid + ":" + (info.serial.empty() ? "@" + p.filename().string() : info.serial);
+            if (!interface.empty())
+            {
+                info.key += ":" + interface;
+            }
+            break;
+        }
+    }
+    return info;
+}
+
+void PortDiscovery::add_port(const std::string &path)
+{
+    PortInfo info = describe(path);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const PortInfo &p : list)
+        {
+            if (p.path == path)
+            {
+                return;
+            }
+        }
+        list.push_back(info);
+        std::sort(list.begin(), list.end(), [](const PortInfo &a, const PortInfo &b)
+                  { return a.path < b.path; });
+        gen++;
+    }
+    // udev may already have created the by-id link
+    refresh_links();
+    std::lock_guard<std::mutex> lock(mutex);
+    int idx = find(list, info.key);
+    events.push_back({true, idx >= 0 ? list[idx] : info});
+}
+
+void PortDiscovery::refresh_links()
+{
+    std::vector<std::pair<std::string, std::string>> links; // (node, link)
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator("/dev/serial/by-id", ec))
+    {
+        std::error_code ec_link;
+        std::filesystem::path node = std::filesystem::canonical(entry.path(), ec_link);
+        if (!ec_link)
+        {
+            links.emplace_back(node.string(), entry.path().string());
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (PortInfo &p : list)
+    {
+        std::string byId;
+        for (const auto &link : links)
+        {
+            if (link.first == p.path)
+            {
+                byId = link.second;
+            }
+        }
+        if (byId != p.byId)
+        {
+            p.byId = byId;
+            gen++;
+        }
+    }
+}
+
+void PortDiscovery::rescan()
+{
+    std::vector<std::string> present;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator("/dev/", ec))
+    {
+        if (is_serial_node(entry.path().filename().string()))
+        {
+            present.push_back(entry.path().string());
+        }
+    }
+    for (const PortInfo &p : ports())
+    {
+        if (std::find(present.begin(), present.end(), p.path) == present.end())
+        {
+            remove_port(p.path);
+        }
+    }
+    for (const std::string &path : present)
+    {
+        add_port(path);
+    }
+    refresh_links();
+}
+
+void PortDiscovery::watch_thread()
+{
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+    int wd_dev = inotify_add_watch(fd, "/dev", IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+    int wd_by_id = -1;
+    alignas(struct inotify_event) char buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+
+    while (running)
+    {
+        // The by-id directory only exists while at least one USB serial device is present
+        if (wd_by_id < 0)
+        {
+            wd_by_id = inotify_add_watch(fd, "/dev/serial/by-id", IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF);
+            if (wd_by_id >= 0)
+            {
+                refresh_links();
+            }
+        }
+
+        struct pollfd pfd[2] = {{fd, POLLIN, 0}, {wake_fd[0], POLLIN, 0}};
+        if (poll(pfd, 2, wd_by_id < 0 ? 1000 : -1) <= 0 || (pfd[1].revents & POLLIN))
+        {
+            continue;
+        }
+
+        bool links_changed = false;
+        ssize_t len;
+        while ((len = read(fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char *ptr = buffer; ptr < buffer + len;)
+            {
+                const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+                ptr += sizeof(struct inotify_event) + event->len;
+                if (event->wd == wd_by_id)
+                {
+                    links_changed = true;
+                    if (event->mask & (IN_IGNORED | IN_DELETE_SELF))
+                    {
+                        wd_by_id = -1;
+                    }
+                }
+                else if (event->wd == wd_dev && event->len > 0 && is_serial_node(event->name))
+                {
+                    std::string path = std::string("/dev/") + event->name;
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    {
+                        add_port(path);
+                    }
+                    else
+                    {
+                        remove_port(path);
+                    }
+                }
+            }
+        }
+        if (links_changed)
+        {
+            refresh_links();
+        }
+    }
+    close(fd);
+}
+
+void PortDiscovery::start()
+{
+    if (running)
+    {
+        return;
+    }
+    rescan();
+    if (pipe(wake_fd) != 0)
+    {
+        wake_fd[0] = wake_fd[1] = -1;
+    }
+    running = true;
+    watcher = std::thread([this]
+                          { watch_thread(); });
+}
+
+void PortDiscovery::stop()
+{
+    running = false;
+    if (wake_fd[1] >= 0)
+    {
+        char c = 0;
+        (void)!write(wake_fd[1], &c, 1);
+    }
+    if (watcher.joinable())
+    {
+        watcher.join();
+    }
+    for (int &fd : wake_fd)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+}
+
+#endif
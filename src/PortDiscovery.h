@@ -0,0 +1,62 @@
+#ifndef PORTDISCOVERY_H
+#define PORTDISCOVERY_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+// Serial device as seen by the discovery service
+struct PortInfo
+{
+    std::string key;     // Stable identity of the physical port (USB VID:PID:serial:interface, else the node path)
+    std::string path;    // Current device node, e.g. /dev/ttyUSB0 or COM3
+    std::string byId;    // /dev/serial/by-id link pointing to the node (Linux, may be empty)
+    std::string vid;     // USB vendor ID (hex, empty for non-USB ports)
+    std::string pid;     // USB product ID
+    std::string serial;  // USB serial number
+    std::string product; // USB product string
+    std::string label() const; // Text for the port selection combo
+};
+
+struct PortEvent
+{
+    bool added;    // true: device appeared, false: device removed
+    PortInfo port;
+};
+
+// Background service keeping a live list of serial ports.
+// Linux: inotify on /dev and /dev/serial/by-id, device details from sysfs.
+// Windows: polls the COM ports once per second.
+class PortDiscovery
+{
+public:
+    PortDiscovery();
+    ~PortDiscovery();
+
+    void start();
+    void stop();
+    void rescan();                        // Full enumeration, e.g. on "Refresh Ports"
+    std::vector<PortInfo> ports();        // Snapshot of the current device list
+    std::vector<PortEvent> poll_events(); // Add/remove events since the last call
+    uint64_t generation() const;          // Incremented on every change of the list
+    static int find(const std::vector<PortInfo> &ports, const std::string &key); // Index of key or -1
+
+private:
+    std::vector<PortInfo> list;
+    std::vector<PortEvent> events;
+    std::mutex mutex;
+    std::thread watcher;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> gen;
+    int wake_fd[2]; // Pipe to interrupt the watcher on stop
+
+    void watch_thread();
+    void add_port(const std::string &path);
+    void remove_port(const std::string &path);
+    void refresh_links();
+};
+
+#endif // PORTDISCOVERY_H
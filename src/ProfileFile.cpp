@@ -0,0 +1,268 @@
+#include "ProfileFile.h"
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+
+const char ProfileFile::binaryMagic[8] = {'R', 'C', 'T', 'P', 'R', 'F', '1', '\0'};
+
+ProfileReader::ProfileReader() : error(), row(0), in(), binary(false), previous(), following(), started(false), has_previous(false), has_following(false) {}
+
+bool ProfileReader::open(const std::string &path)
+{
+    error.clear();
+    row = 0;
+    started = false;
+    has_previous = false;
+    has_following = false;
+    in.close();
+    in.clear();
+    in.open(path, std::ios::binary);
+    if (!in)
+    {
+        error = "Could not open profile " + path;
+        return false;
+    }
+    char magic[sizeof(ProfileFile::binaryMagic)] = {};
+    in.read(magic, sizeof(magic));
+    binary = in.gcount() == sizeof(magic) && std::memcmp(magic, ProfileFile::binaryMagic, sizeof(magic)) == 0;
+    if (!binary)
+    {
+        in.clear();
+        in.seekg(0);
+    }
+    return true;
+}
+
+static bool separator(char c)
+{
+    return c == ',' || c == ';' || std::isspace(static_cast<unsigned char>(c));
+}
+
+bool ProfileReader::next(ProfilePoint &point)
+{
+    if (binary)
+    {
+        in.read(reinterpret_cast<char *>(&point), sizeof(point));
+        if (in.gcount() == sizeof(point))
+        {
+            row++;
+            return true;
+        }
+        if (in.gcount() != 0)
+        {
+            error = "Profile ends within record " + std::to_string(row + 1);
+        }
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        row++;
+        const char *p = line.c_str();
+        while (*p != '\0' && std::isspace(static_cast<unsigned char>(*p)))
+        {
+            p++;
+        }
+        if (!(std::isdigit(static_cast<unsigned char>(*p)) || *p == '.' || *p == '-' || *p == '+'))
+        {
+            continue;
+        }
+        double values[3];
+        for (double &value : values)
+        {
+            char *end = nullptr;
+            value = std::strtod(p, &end);
+            if (end == p)
+            {
+                error = "Profile row " + std::to_string(row) + ": expected t, temperature and speed";
+                return false;
+            }
+            p = end;
+            while (*p != '\0' && separator(*p))
+            {
+                p++;
+            }
+        }
+        point = ProfilePoint{values[0], static_cast<float>(values[1]), static_cast<float>(values[2])};
+        return true;
+    }
+    return false;
+}
+
+bool ProfileReader::at(double t, float &temperature, float &speed)
+{
+    if (!started)
+    {
+        started = true;
+        has_following = next(following);
+    }
+    while (has_following && following.t <= t)
+    {
+        previous = following;
+        has_previous = true;
+        has_following = next(following) && following.t >= previous.t;
+    }
+    if (!has_previous)
+    {
+        if (!has_following)
+        {
+            return false;
+        }
+        // Before the first point its values hold
+        temperature = following.temperature;
+        speed = following.speed;
+        return true;
+    }
+    temperature = previous.temperature;
+    speed = previous.speed;
+    if (has_following && following.t > previous.t)
+    {
+        float f = static_cast<float>((t - previous.t) / (following.t - previous.t));
+        temperature += (following.temperature - previous.temperature) * f;
+        speed += (following.speed - previous.speed) * f;
+    }
+    return true;
+}
+
+bool ProfileFile::scan(const std::string &path, float max_temperature, float max_speed, ProfileSummary &summary, std::string &error)
+{
+    ProfileReader reader;
+    if (!reader.open(path))
+    {
+        error = reader.error;
+        return false;
+    }
+    summary = ProfileSummary{0, {}, {}};
+    ProfilePoint point;
+    while (reader.next(point))
+    {
+        std::string where = "Profile row " + std::to_string(reader.row) + ": ";
+        if (!std::isfinite(point.t) || point.t < 0 || (summary.points > 0 && point.t < summary.last.t))
+        {
+            error = where + "t must not decrease";
+            return false;
+        }
+        if (!(point.temperature >= 0 && point.temperature <= max_temperature))
+        {
+            error = where + "temperature outside of 0 - " + std::to_string(static_cast<int>(max_temperature)) + " °C";
+            return false;
+        }
+        if (!(point.speed >= 0 && point.speed <= max_speed))
+        {
+            error = where + "speed outside of 0 - " + std::to_string(static_cast<int>(max_speed)) + " rpm";
+            return false;
+        }
+        if (summary.points == 0)
+        {
+            summary.first = point;
+        }
+        summary.last = point;
+        summary.points++;
+    }
+    if (!reader.error.empty())
+    {
+        error = reader.error;
+        return false;
+    }
+    if (summary.points == 0)
+    {
+        error = "No points in profile " + path;
+        return false;
+    }
+    return true;
+}
+
+bool ProfileFile::preview(const std::string &path, size_t buckets, ProfilePreview &preview, std::string &error)
+{
+    // The first pass finds the length, the second one keeps the extremes of every bucket
+    buckets = std::max<size_t>(buckets, 1);
+    ProfileReader reader;
+    if (!reader.open(path))
+    {
+        error = reader.error;
+        return false;
+    }
+    double t_end = 0;
+    ProfilePoint point;
+    while (reader.next(point))
+    {
+        t_end = std::max(t_end, point.t);
+    }
+    struct Extremes
+    {
+        double t_low, t_high;
+        double low, high;
+        bool used;
+    };
+    std::vector<Extremes> extremes[2];
+    extremes[0].assign(buckets, Extremes{0, 0, 0, 0, false});
+    extremes[1].assign(buckets, Extremes{0, 0, 0, 0, false});
+    if (!reader.open(path))
+    {
+        error = reader.error;
+        return false;
+    }
+    while (reader.next(point))
+    {
+        size_t b = t_end > 0 ? std::min(buckets - 1, static_cast<size_t>(point.t / t_end * buckets)) : 0;
+        double values[2] = {point.temperature, point.speed};
+        for (int c = 0; c < 2; c++)
+        {
+            Extremes &e = extremes[c][b];
+            if (!e.used || values[c] < e.low)
+            {
+                e.low = values[c];
+                e.t_low = point.t;
+            }
+            if (!e.used || values[c] > e.high)
+            {
+                e.high = values[c];
+                e.t_high = point.t;
+            }
+            e.used = true;
+        }
+    }
+
+    std::vector<double> *t_out[2] = {&preview.t_temperature, &preview.t_speed};
+    std::vector<double> *v_out[2] = {&preview.temperature, &preview.speed};
+    for (int c = 0; c < 2; c++)
+    {
+        t_out[c]->clear();
+        v_out[c]->clear();
+        for (const Extremes &e : extremes[c])
+        {
+            if (!e.used)
+            {
+                continue;
+            }
+            bool low_first = e.t_low <= e.t_high;
+            t_out[c]->push_back(low_first ? e.t_low : e.t_high);
+            v_out[c]->push_back(low_first ? e.low : e.high);
+            if (e.low != e.high)
+            {
+                t_out[c]->push_back(low_first ? e.t_high : e.t_low);
+                v_out[c]->push_back(low_first ? e.high : e.low);
+            }
+        }
+    }
+    error = reader.error;
+    return error.empty();
+}
+
+std::string ProfileFile::resolve(const std::string &file, const std::string &timeline_path)
+{
+    std::error_code ec;
+    std::filesystem::path path(file);
+    if (path.is_relative() && !timeline_path.empty())
+    {
+        std::filesystem::path beside = std::filesystem::path(timeline_path).parent_path() / path;
+        if (std::filesystem::exists(beside, ec))
+        {
+            return beside.string();
+        }
+    }
+    return file;
+}
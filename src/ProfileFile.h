@@ -0,0 +1,69 @@
+#ifndef PROFILEFILE_H
+#define PROFILEFILE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+struct ProfilePoint
+{
+    double t; // Seconds from the section start
+    float temperature;
+    float speed;
+};
+
+// Set value profile in a file, one point per row, t not decreasing:
+//  - text: "t, temperature, speed" separated by commas, semicolons, tabs or blanks; rows that do not
+//    start with a number (column names, comments) are skipped
+//  - binary: "RCTPRF1\0" followed by ProfilePoint records in the byte order of the machine
+// Profiles are only ever streamed, memory does not grow with the number of points.
+class ProfileReader
+{
+public:
+    ProfileReader();
+    bool open(const std::string &path);
+    bool next(ProfilePoint &point); // Next point in file order, false at the end or on a damaged row (see error)
+    // Values interpolated at t; t must not decrease from call to call. After the last point its values hold.
+    bool at(double t, float &temperature, float &speed);
+    std::string error;
+    size_t row; // Row or record of the last point, for messages
+
+private:
+    std::ifstream in;
+    bool binary;
+    ProfilePoint previous;
+    ProfilePoint following;
+    bool started;
+    bool has_previous;
+    bool has_following;
+};
+
+struct ProfileSummary
+{
+    size_t points;
+    ProfilePoint first;
+    ProfilePoint last;
+};
+
+// Decimated profile for plotting, the lowest and highest value of every bucket in time order
+struct ProfilePreview
+{
+    std::vector<double> t_temperature;
+    std::vector<double> temperature;
+    std::vector<double> t_speed;
+    std::vector<double> speed;
+};
+
+class ProfileFile
+{
+public:
+    static const char binaryMagic[8];
+    // Reads the whole profile once and checks the order of t and the set value ranges
+    static bool scan(const std::string &path, float max_temperature, float max_speed, ProfileSummary &summary, std::string &error);
+    static bool preview(const std::string &path, size_t buckets, ProfilePreview &preview, std::string &error);
+    // A relative path is looked up next to the timeline file first, then in the working directory
+    static std::string resolve(const std::string &file, const std::string &timeline_path);
+};
+
+#endif // PROFILEFILE_H
@@ -8,12 +8,19 @@
 #include "implot.h"
 #include "imfilebrowser.h"
 #include "FileOperations.h"
+#include "BandwidthPlanner.h"
 
 #include "ImGuiINI.hpp"
 #define MINI_CASE_SENSITIVE
 #include "ini.h"
 #include "Utilities.h"
 #include "imgui_stdlib.h"
+#include <cmath>
+#include <ctime>
+#include <filesystem>
+#include <sstream>
+#include <iomanip>
+#include <limits>
 
 #if defined(__GNUC__)
 #pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
@@ -23,7 +30,9 @@
 RCT_5_Control::RCT_5_Control()
 {
     serialPort = nullptr;
-    availablePorts = listSerialPorts();
+    discovery.start();
+    availablePorts = discovery.ports();
+    ports_generation = discovery.generation();
     device = "No device detected";
     connected = false;
     rct_detected = false;
@@ -31,6 +40,26 @@ RCT_5_Control::RCT_5_Control()
     baudRates = {4800, 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600};
     selectedBaudRateIndex = 2;
     auto_connect = false;
+    link_down = false;
+    port_generation = 0;
+    reconnect_timeout_ms = 60000;
+    max_read_retries = 3;
+    last_error = SerialError::None;
+    catalog_generation = UINT64_MAX;
+    library_generation = UINT64_MAX;
+    RunCatalog::instance().open("runs.catalog");
+    tx_thread = std::thread([this]
+                            { tx_dispatch(); });
+}
+
+RCT_5_Control::~RCT_5_Control()
+{
+    tx_queue.close();
+    if (tx_thread.joinable())
+    {
+        tx_thread.join();
+    }
+    delete serialPort;
 }
 
 static std::string statusMessage = "No serial port connected";
@@ -46,102 +75,359 @@ static ImGuiTreeNodeFlags tree_flags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTre
 static ImGui::FileBrowser fileDialog(ImGuiFileBrowserFlags_EnterNewFilename);
 static ImGui::FileBrowser fileDialogLoad;
 
+// Adaptive logs are step-held: each value holds until the next one, the last one until the last reading.
+// Only the part of the series inside the plot window is decoded.
+static void plot_series(const char *label, const LogSeries &series, bool step_hold)
+{
+    ImPlotRect limits = ImPlot::GetPlotLimits();
+    const SeriesView &view = series.window(limits.X.Min, limits.X.Max);
+    if (!step_hold)
+    {
+        ImPlot::PlotLine(label, view.time.data(), view.value.data(), view.time.size());
+        return;
+    }
+    ImPlot::PlotStairs(label, view.time.data(), view.value.data(), view.time.size());
+    float t_last = series.last_time();
+    float t_held = series.held_until();
+    if (series.size() > 0 && t_held > t_last)
+    {
+        float t_tail[2] = {t_last, t_held};
+        float v_tail[2] = {series.last_value(), series.last_value()};
+        ImPlot::PlotLine(label, t_tail, v_tail, 2);
+    }
+}
+
 void RCT_5_Control::checkAvailablePorts()
 {
-    availablePorts = listSerialPorts();
+    discovery.rescan();
+    update_ports();
+}
+void RCT_5_Control::update_ports()
+{
+    for (const PortEvent &event : discovery.poll_events())
+    {
+        if (event.port.key == selectedPortKey)
+        {
+            statusMessage = event.added ? "Selected device plugged in (" + event.port.path + ")" : "Selected device unplugged";
+        }
+    }
+    if (discovery.generation() != ports_generation)
+    {
+        ports_generation = discovery.generation();
+        availablePorts = discovery.ports();
+    }
+    // The list is re-sorted on every change, the selection follows the device, not the index
+    int idx = PortDiscovery::find(availablePorts, selectedPortKey);
+    selectedPortIndex = idx < 0 ? -1 : static_cast<size_t>(idx);
 }
 void RCT_5_Control::connectPort()
 {
-    if (selectedPortIndex > availablePorts.size())
+    update_ports();
+    if (selectedPortIndex >= availablePorts.size())
     {
         statusMessage = "No port selected";
         connected = false;
         return;
     }
-    if (serialPort)
+    if (pending_connect.valid())
     {
-        delete serialPort;
+        // Already connecting
+        return;
     }
-    serialPort = new SerialPort(availablePorts[selectedPortIndex], baudRates[selectedBaudRateIndex]);
-    if (serialPort->open())
+    std::string path = availablePorts[selectedPortIndex].path;
+    uint32_t baudRate = baudRates[selectedBaudRateIndex];
+    statusMessage = "Connecting to " + path + " ...";
+    pending_connect = std::async(std::launch::async, [path, baudRate]()
+                                 {
+        ConnectResult result = {new SerialPort(path, baudRate), false, ""};
+        result.opened = result.port->open();
+        if (result.opened)
+        {
+            // A silent port must not hold up the connect for the full read timeout
+            int readTimeout_ms = result.port->readTimeout_ms;
+            result.port->readTimeout_ms = 1000;
+            if (result.port->sendCommand("IN_NAME"))
+            {
+                result.device = result.port->readString();
+            }
+            result.port->readTimeout_ms = readTimeout_ms;
+        }
+        return result; });
+}
+void RCT_5_Control::poll_connect()
+{
+    if (!pending_connect.valid() || pending_connect.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
     {
-        statusMessage = "Connected to serial port";
-        connected = true;
+        return;
     }
-    else
+    ConnectResult result = pending_connect.get();
+    std::lock_guard<std::mutex> lock(serial_mutex);
+    if (serialPort)
     {
-        statusMessage = "Failed to connect to serial port";
-        connected = false;
+        delete serialPort;
     }
+    replay_state.clear();
+    link_down = false;
+    serialPort = result.port;
+    port_generation++;
+    connected = result.opened;
+    tx_pacer.configure(serialPort->baudRate);
+    statusMessage = connected ? "Connected to serial port" : "Failed to connect to serial port";
+    result.device.erase(std::remove_if(result.device.begin(), result.device.end(), [](char c)
+                                       { return c == '\r' || c == '\n'; }),
+                        result.device.end());
+    rct_detected = connected && result.device.size() > 0;
+    device = rct_detected ? result.device : "No device detected";
 }
-void RCT_5_Control::get_device_name()
+void RCT_5_Control::poll_command()
 {
-    device = "No device detected";
-    rct_detected = false;
-    if (serialPort && connected)
+    if (!pending_command.valid() || pending_command.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
     {
-        if (serialPort->sendCommand("IN_NAME"))
-        {
-            std::string temp_device = serialPort->readString();
-            if (temp_device.size() > 0)
-            {
-                device = temp_device;
-                rct_detected = true;
-            }
-        }
+        return;
     }
+    TxResult reply = pending_command.get();
+    namur.responseText = reply.response;
+    last_error = reply.error;
 }
-float RCT_5_Control::get_numeric_value()
+float RCT_5_Control::parse_numeric(const std::string &response)
 {
-    if (namur.responseText.size() > 0)
+    if (response.size() > 0)
     {
-        std::string value = namur.responseText;
+        std::string value = response;
         value.erase(std::find_if(value.begin(), value.end(), [](char c)
                                  { return std::isspace(c); }),
                     value.end());
-        return std::stof(value);
+        try
+        {
+            return std::stof(value);
+        }
+        catch (const std::exception &)
+        {
+            // Error message instead of a reading, e.g. while the link is down
+            return NAN;
+        }
     }
     else
     {
         return 0.0f;
     }
 }
-void RCT_5_Control::send_signal(const std::string &command)
+float RCT_5_Control::get_numeric_value()
+{
+    return parse_numeric(namur.responseText);
+}
+void RCT_5_Control::log_link_event(const std::string &event)
+{
+    std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    char time_str[32];
+    std::strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+    std::cerr << time_str << " " << event << std::endl;
+    std::lock_guard<std::mutex> lock(event_mutex);
+    // Nobody drains the events if logging is disabled, keep the backlog bounded
+    if (link_events.size() >= 1024)
+    {
+        link_events.erase(link_events.begin());
+    }
+    link_events.push_back(std::string(time_str) + " " + event);
+}
+std::vector<std::string> RCT_5_Control::drain_link_events()
+{
+    std::lock_guard<std::mutex> lock(event_mutex);
+    std::vector<std::string> events;
+    events.swap(link_events);
+    return events;
+}
+void RCT_5_Control::remember_state(const std::string &base_command, const std::string &command)
+{
+    // Everything needed to bring a re-plugged device back to where it was
+    if (base_command == "OUT_SP_1" || base_command == "OUT_SP_4")
+    {
+        replay_state[base_command] = command;
+    }
+    else if (base_command == "START_1" || base_command == "STOP_1")
+    {
+        replay_state["RUN_1"] = command;
+    }
+    else if (base_command == "START_4" || base_command == "STOP_4")
+    {
+        replay_state["RUN_4"] = command;
+    }
+}
+SerialError RCT_5_Control::get_last_error()
+{
+    return last_error;
+}
+std::string RCT_5_Control::get_device()
+{
+    return rct_detected ? device : "";
+}
+SerialError RCT_5_Control::transfer(const std::string &command, const std::string &base_command, bool returnsValue, std::string &response)
+{
+    // Reads are idempotent and are repeated on a lost reply, everything else is sent exactly once
+    int attempts = base_command.rfind("IN_", 0) == 0 ? 1 + max_read_retries : 1;
+    std::string reply;
+    SerialError error = SerialError::None;
+    for (int attempt = 0; attempt < attempts; attempt++)
+    {
+        if (attempt > 0)
+        {
+            // A late reply to the previous attempt must not be taken for this one
+            serialPort->flushInput();
+            log_link_event("Retrying " + command + " (" + serial_error_text(error) + ", deadline " + std::to_string(serialPort->rtt.rto_ms()) + " ms)");
+        }
+        error = serialPort->transact(command, reply, returnsValue);
+        if (error != SerialError::Timeout)
+        {
+            break;
+        }
+    }
+    if (error != SerialError::None)
+    {
+        response = serial_error_text(error);
+        return error;
+    }
+    response = reply;
+    if (returnsValue && base_command != "IN_NAME")
+    {
+        response = ftos(parse_numeric(reply), 1);
+    }
+    return error;
+}
+bool RCT_5_Control::reconnect(std::unique_lock<std::mutex> &lock, size_t timeout_ms)
+{
+    if (!link_down)
+    {
+        link_down = true;
+        t_link_lost = std::chrono::steady_clock::now();
+        log_link_event("Link lost on " + serialPort->portName + " (error " + std::to_string(serialPort->lastError) + ")");
+    }
+    auto t_give_up = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    int backoff_ms = 250;
+    while (true)
+    {
+        if (serialPort->reopen())
+        {
+            // The port may open while the device is still booting, make sure it answers
+            std::string reply;
+            if (serialPort->transact("IN_NAME", reply, true) == SerialError::None)
+            {
+                break;
+            }
+            serialPort->linkLost = true;
+        }
+        if (std::chrono::steady_clock::now() + std::chrono::milliseconds(backoff_ms) > t_give_up)
+        {
+            return false;
+        }
+        // A connect from the GUI must not wait for the back-off
+        uint64_t generation = port_generation;
+        lock.unlock();
+        sleep(backoff_ms);
+        lock.lock();
+        if (port_generation != generation)
+        {
+            log_link_event("Reconnect abandoned, a new connection replaced the lost one");
+            return false;
+        }
+        backoff_ms = std::min(backoff_ms * 2, 2000);
+    }
+    link_down = false;
+    float gap = std::chrono::duration<float>(std::chrono::steady_clock::now() - t_link_lost).count();
+    log_link_event("Reconnected via " + serialPort->stablePath + " after " + ftos(gap, 1) + " s");
+    statusMessage = "Connected to serial port";
+
+    // Setpoints first, so the heater and motor do not start with stale values
+    for (const char *key : {"OUT_SP_1", "OUT_SP_4", "RUN_1", "RUN_4"})
+    {
+        auto it = replay_state.find(key);
+        if (it != replay_state.end())
+        {
+            bool ok = serialPort->sendCommand(it->second);
+            log_link_event((ok ? "Replayed " : "Failed to replay ") + it->second);
+        }
+    }
+    return true;
+}
+std::future<TxResult> RCT_5_Control::queue_signal(const std::string &command)
 {
     std::string base_command = namur.get_base_command(command);
     NamurCommands::CommandDetails comDetails = namur.getCommandDetails(base_command);
 
+    auto done = std::make_shared<std::promise<TxResult>>();
+    std::future<TxResult> result = done->get_future();
+    tx_queue.push({command, base_command, comDetails.returnsValue, false, done, std::chrono::steady_clock::now()});
+    return result;
+}
+std::string RCT_5_Control::send_signal(const std::string &command)
+{
+    // The Direct Interface owns namur.responseText, poll_command() fills it on the GUI thread
+    return queue_signal(command).get().response;
+}
+void RCT_5_Control::post_signal(const std::string &command)
+{
+    std::string base_command = namur.get_base_command(command);
+    NamurCommands::CommandDetails comDetails = namur.getCommandDetails(base_command);
+    tx_queue.push({command, base_command, comDetails.returnsValue, true, nullptr, std::chrono::steady_clock::now()});
+}
+void RCT_5_Control::tx_dispatch()
+{
+    TxRequest request;
+    // Control goes first, a read still waiting for budget is passed over
+    auto wait_ms = [this](const TxRequest &next)
+    {
+        return tx_pacer.try_acquire(next.command, TxQueue::is_telemetry(next.base_command));
+    };
+    while (tx_queue.pop(request, wait_ms))
+    {
+        TxResult result = execute_command(request);
+        if (request.done)
+        {
+            request.done->set_value(result);
+        }
+    }
+}
+TxResult RCT_5_Control::execute_command(const TxRequest &request)
+{
+    std::unique_lock<std::mutex> lock(serial_mutex);
+    const std::string &command = request.command;
+    const std::string &base_command = request.base_command;
+    TxResult result = {SerialError::NotOpen, "Serial port not connected"};
+
     if (serialPort && connected)
     {
-        if (serialPort->sendCommand(command))
+        result.error = SerialError::LinkLost;
+        if (!link_down)
         {
-            if (comDetails.returnsValue)
+            result.error = transfer(command, base_command, request.returnsValue, result.response);
+            if (result.error == SerialError::None && request.returnsValue)
             {
-                namur.responseText = serialPort->readString();
-                if (namur.responseText.size() <= 0)
-                {
-                    namur.responseText = "Failed to read from serial port";
-                }
-                else if (base_command != "IN_NAME")
-                {
-                    float responseFloat = get_numeric_value();
-                    namur.responseText = ftos(responseFloat, 1);
-                }
+                tx_pacer.record(command, result.response.size() + 2, serialPort->lastRtt_ms);
+            }
+        }
+        if (result.error == SerialError::LinkLost)
+        {
+            // Full retry budget when the link just dropped, a single attempt while it stays down
+            if (reconnect(lock, link_down ? 0 : reconnect_timeout_ms))
+            {
+                log_link_event("Retrying " + command);
+                result.error = transfer(command, base_command, request.returnsValue, result.response);
             }
             else
             {
-                namur.responseText = "";
+                result.response = serial_error_text(SerialError::LinkLost);
             }
         }
-        else
+        if (result.error != SerialError::None)
         {
-            namur.responseText = "Failed to send signal";
+            log_link_event("Dropped " + command + " (" + serial_error_text(result.error) + ")");
+        }
+        if (result.error == SerialError::None || link_down)
+        {
+            // Remember what was requested even if it could not be delivered, it is replayed on reconnect
+            remember_state(base_command, command);
         }
     }
-    else
-    {
-        namur.responseText = "Serial port not connected";
-    }
+    return result;
 }
 void RCT_5_Control::show_connection_ui(mINI::INIStructure &config)
 {
@@ -149,19 +435,24 @@ void RCT_5_Control::show_connection_ui(mINI::INIStructure &config)
     {
         checkAvailablePorts();
     }
-    if (ImGui::BeginCombo("Serial Ports", selectedPortIndex < availablePorts.size() ? availablePorts[selectedPortIndex].c_str() : "Select a port"))
+    if (ImGui::BeginCombo("Serial Ports", selectedPortIndex < availablePorts.size() ? availablePorts[selectedPortIndex].label().c_str() : "Select a port"))
     {
         for (size_t i = 0; i < availablePorts.size(); ++i)
         {
             bool isSelected = (selectedPortIndex == i);
-            if (ImGui::Selectable(availablePorts[i].c_str(), isSelected))
+            if (ImGui::Selectable(availablePorts[i].label().c_str(), isSelected))
             {
                 selectedPortIndex = i;
+                selectedPortKey = availablePorts[i].key;
             }
             if (isSelected)
             {
                 ImGui::SetItemDefaultFocus();
-                config["Settings"]["COM-Port"] = std::to_string(selectedPortIndex);
+                config["Settings"]["Port-Id"] = selectedPortKey;
+            }
+            if (ImGui::IsItemHovered() && !availablePorts[i].byId.empty())
+            {
+                ImGui::SetTooltip(availablePorts[i].byId.c_str());
             }
         }
         ImGui::EndCombo();
@@ -185,11 +476,12 @@ void RCT_5_Control::show_connection_ui(mINI::INIStructure &config)
         ImGui::EndCombo();
     }
     // Connect button
+    ImGui::BeginDisabled(pending_connect.valid());
     if (ImGui::Button("Connect"))
     {
         connectPort();
-        get_device_name();
     }
+    ImGui::EndDisabled();
     ImGui::SameLine();
     if (ImGui::Checkbox("Reconnect on startup", &auto_connect))
     {
@@ -208,6 +500,42 @@ void RCT_5_Control::show_connection_ui(mINI::INIStructure &config)
     {
         draw_circle('r', "RCT 5  not connected");
     }
+    show_probe_ui(config);
+}
+void RCT_5_Control::show_probe_ui(mINI::INIStructure &config)
+{
+    ImGui::SeparatorText("Find Devices");
+    ImGui::BeginDisabled(probe.busy());
+    if (ImGui::Button("Probe all ports", ImVec2(-1, 0)))
+    {
+        // Most likely baud rate first
+        std::vector<uint32_t> order = baudRates;
+        std::rotate(order.begin(), order.begin() + selectedBaudRateIndex, order.begin() + selectedBaudRateIndex + 1);
+        probe.start(availablePorts, order, (serialPort && connected) ? serialPort->portName : "");
+    }
+    ImGui::EndDisabled();
+    ImGui::SetItemTooltip("Ask every serial port for its device name at all baud rates");
+    if (probe.busy())
+    {
+        ImGui::ProgressBar(probe.progress(), ImVec2(-1, 0), "Probing ports...");
+    }
+    for (const ProbeResult &result : probe.results())
+    {
+        std::string label = result.device + " on " + result.port.label() + " @ " + std::to_string(result.baudRate) + " baud";
+        if (ImGui::Selectable(label.c_str(), false, ImGuiSelectableFlags_DontClosePopups))
+        {
+            selectedPortKey = result.port.key;
+            config["Settings"]["Port-Id"] = selectedPortKey;
+            auto it = std::find(baudRates.begin(), baudRates.end(), result.baudRate);
+            if (it != baudRates.end())
+            {
+                selectedBaudRateIndex = it - baudRates.begin();
+                config["Settings"]["Baud-Rate"] = std::to_string(selectedBaudRateIndex);
+            }
+            connectPort();
+        }
+        ImGui::SetItemTooltip("Connect to this device");
+    }
 }
 void RCT_5_Control::show_command_ui()
 {
@@ -241,6 +569,55 @@ void RCT_5_Control::show_command_ui()
         }
     }
 }
+// Repeat blocks refer to sections by number, the sections themselves are not copied
+static void show_repeat_ui(TimeLine &timeline)
+{
+    int n_sections = static_cast<int>(timeline.sections.size());
+    for (size_t r = 0; r < timeline.repeats.size(); r++)
+    {
+        RepeatBlock &block = timeline.repeats[r];
+        int first = block.first + 1, last = block.last + 1, count = block.count;
+        ImGui::PushID(static_cast<int>(r));
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 7);
+        if (ImGui::InputInt("First", &first))
+        {
+            block.first = static_cast<uint32_t>(std::clamp(first, 1, std::max(n_sections, 1)) - 1);
+            block.last = std::max(block.first, block.last);
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 7);
+        if (ImGui::InputInt("Last", &last))
+        {
+            block.last = static_cast<uint32_t>(std::clamp(last, 1, std::max(n_sections, 1)) - 1);
+            block.first = std::min(block.first, block.last);
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 7);
+        if (ImGui::InputInt("Times", &count))
+        {
+            block.count = static_cast<uint32_t>(std::max(count, 1));
+        }
+        ImGui::SameLine();
+        if (block.last < timeline.sections.size())
+        {
+            ImGui::Text("%s - %s", timeline.sections[block.first].name.c_str(), timeline.sections[block.last].name.c_str());
+        }
+        ImGui::SameLine();
+        if (ImGui::SmallButton("Remove"))
+        {
+            timeline.repeats.erase(timeline.repeats.begin() + r);
+            ImGui::PopID();
+            break;
+        }
+        ImGui::PopID();
+    }
+    if (ImGui::Button("Add Repeat") && n_sections > 0)
+    {
+        timeline.repeats.push_back(RepeatBlock{0, static_cast<uint32_t>(n_sections - 1), 2});
+    }
+    ImGui::SetItemTooltip("Run a range of sections several times in a row, e.g. heat and cool cycles. Blocks may nest but not overlap partly.");
+}
+
 void RCT_5_Control::show_timeline_ui(TimeLine &timeline, ImGuiIO &io)
 {
     ImGui::SeparatorText("Timeline Parameters");
@@ -249,15 +626,111 @@ void RCT_5_Control::show_timeline_ui(TimeLine &timeline, ImGuiIO &io)
     ImGui::PopFont();
     imgui_autosizingMultilineInput("Description", &timeline.description, ImVec2(ImGui::CalcItemWidth(), ImGui::GetTextLineHeight() * 2), ImVec2(ImGui::CalcItemWidth(), ImGui::GetTextLineHeight() * 8));
 
-    ImGui::InputScalar("Log Interval", ImGuiDataType_U64, &timeline.logInterval);
-
-    ImGui::Checkbox("Log Temperature (Plate)", &timeline.logTemperaturePlate);
+    // Each channel is read on its own interval
+    bool *log_flags[LOG_CHANNELS] = {&timeline.logSpeed, &timeline.logTemperaturePlate, &timeline.logTemperatureSensor, &timeline.logViscosity};
+    const char *log_labels[LOG_CHANNELS] = {"Log Speed", "Log Temperature (Plate)", "Log Temperature (Sensor)", "Log Viscosity Trend"};
+    for (int c = 0; c < LOG_CHANNELS; c++)
+    {
+        ImGui::PushID(c);
+        ImGui::Checkbox(log_labels[c], log_flags[c]);
+        ImGui::SameLine(ImGui::GetFontSize() * 14);
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8);
+        ImGui::BeginDisabled(!*log_flags[c]);
+        if (ImGui::InputFloat("Interval [s]", &timeline.logIntervals[c], 1.0f, 10.0f, "%.1f"))
+        {
+            timeline.logIntervals[c] = std::max(0.1f, timeline.logIntervals[c]);
+        }
+        if (timeline.adaptiveLogging)
+        {
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8);
+            if (ImGui::InputFloat("Deadband", &timeline.logDeadband[c], 0.1f, 1.0f, "%.1f"))
+            {
+                timeline.logDeadband[c] = std::max(0.0f, timeline.logDeadband[c]);
+            }
+        }
+        ImGui::EndDisabled();
+        ImGui::PopID();
+    }
+    ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8);
+    ImGui::InputScalar("Write Batch", ImGuiDataType_U32, &timeline.logFlush.batch_records);
+    ImGui::SetItemTooltip("The log file is written as soon as this many records are waiting");
     ImGui::SameLine();
-    ImGui::Checkbox("Log Temperature (Sensor)", &timeline.logTemperatureSensor);
+    ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8);
+    ImGui::InputScalar("Max. Write Delay [ms]", ImGuiDataType_U32, &timeline.logFlush.max_delay_ms);
+    ImGui::SetItemTooltip("Longest time a reading waits before it is written to the log file");
     ImGui::SameLine();
-    ImGui::Checkbox("Log Speed", &timeline.logSpeed);
+    ImGui::Checkbox("Journal", &timeline.logFlush.journal);
+    ImGui::SetItemTooltip("Also write a crash safe binary journal next to the log (<log file>.journal)");
+    if (timeline.logFlush.journal)
+    {
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8);
+        ImGui::InputScalar("Sync Interval [ms]", ImGuiDataType_U32, &timeline.logFlush.sync_interval_ms);
+        ImGui::SetItemTooltip("The journal is synced to disk this often. A power cut loses at most this much of the log");
+    }
+    timeline.logFlush.batch_records = std::max(1u, timeline.logFlush.batch_records);
+    timeline.logFlush.max_delay_ms = std::max(10u, timeline.logFlush.max_delay_ms);
+    timeline.logFlush.sync_interval_ms = std::max(10u, timeline.logFlush.sync_interval_ms);
+    ImGui::Checkbox("Adaptive Sampling", &timeline.adaptiveLogging);
+    ImGui::SetItemTooltip("Skip readings within the deadband of the last logged value and sample faster while ramping or values change");
+    if (timeline.adaptiveLogging)
+    {
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8);
+        if (ImGui::InputFloat("Max. Gap [s]", &timeline.logMaxGap, 10.0f, 60.0f, "%.0f"))
+        {
+            timeline.logMaxGap = std::max(1.0f, timeline.logMaxGap);
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8);
+        if (ImGui::InputFloat("Transient Rate", &timeline.logBoost, 1.0f, 2.0f, "x%.0f"))
+        {
+            timeline.logBoost = std::clamp(timeline.logBoost, 1.0f, 100.0f);
+        }
+    }
+
+    // Segmented logs
+    float segment_mb = timeline.logRotation.max_bytes / 1e6f;
+    float segment_h = timeline.logRotation.max_seconds / 3600.0f;
+    ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8);
+    if (ImGui::InputFloat("Segment Size [MB]", &segment_mb, 1.0f, 10.0f, "%.1f"))
+    {
+        timeline.logRotation.max_bytes = static_cast<uint64_t>(std::max(0.0f, segment_mb) * 1e6f);
+    }
+    ImGui::SetItemTooltip("Start a new log segment at this size, 0: no size limit");
     ImGui::SameLine();
-    ImGui::Checkbox("Log Viscosity Trend", &timeline.logViscosity);
+    ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8);
+    if (ImGui::InputFloat("Segment Period [h]", &segment_h, 1.0f, 24.0f, "%.1f"))
+    {
+        timeline.logRotation.max_seconds = static_cast<uint32_t>(std::max(0.0f, segment_h) * 3600);
+    }
+    ImGui::SetItemTooltip("Start a new log segment after this time, 0: no time limit");
+    if (timeline.logRotation.enabled())
+    {
+        ImGui::SameLine();
+        ImGui::Checkbox("Compress Segments", &timeline.logRotation.compress);
+    }
+
+    // Does the schedule fit on the serial line?
+    BandwidthPlan plan = plan_bandwidth(timeline, tx_pacer);
+    size_t n_overloaded = std::count_if(plan.sections.begin(), plan.sections.end(), [](const SectionLoad &sl)
+                                        { return sl.overloaded; });
+    ImGui::Text("Serial budget: %.1f ms per read (%s, %u baud)", plan.command_ms, plan.measured ? "measured" : "estimated", tx_pacer.stats().baudRate);
+    ImGui::SetItemTooltip("Line time of one command, measured on the connected device or estimated from the baud rate");
+    if (std::isfinite(plan.min_log_interval))
+    {
+        ImGui::SameLine();
+        ImGui::Text("|  Shortest sustainable log interval: %.1f s", std::max(0.1, plan.min_log_interval));
+    }
+    if (n_overloaded > 0)
+    {
+        ImGui::SameLine();
+        ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "|  %zu section(s) will fall behind", n_overloaded);
+    }
+
+    ImGui::SeparatorText("Repeats");
+    show_repeat_ui(timeline);
 
     ImGui::SeparatorText("Sections");
     if (ImGui::Button("New Section", ImVec2(-1, 0)))
@@ -267,7 +740,7 @@ void RCT_5_Control::show_timeline_ui(TimeLine &timeline, ImGuiIO &io)
     if (timeline.sections.size() > 0)
     {
         auto available_height = ImGui::GetContentRegionAvail().y - ImGui::GetItemRectSize().y - ImGui::GetStyle().ItemSpacing.y;
-        ImGui::BeginTable("Sections", 8, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable, ImVec2(-1, available_height));
+        ImGui::BeginTable("Sections", 9, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable, ImVec2(-1, available_height));
         ImGui::TableSetupColumn("Name");
         ImGui::TableSetupColumn("Duration");
         ImGui::TableSetupColumn("Temperature Start");
@@ -276,6 +749,7 @@ void RCT_5_Control::show_timeline_ui(TimeLine &timeline, ImGuiIO &io)
         ImGui::TableSetupColumn("Speed End");
         ImGui::TableSetupColumn("Wait (User)");
         ImGui::TableSetupColumn("Wait (Value)");
+        ImGui::TableSetupColumn("Line Load");
         ImGui::TableHeadersRow();
 
         for (size_t i = 0; i < timeline.sections.size(); i++)
@@ -305,6 +779,12 @@ void RCT_5_Control::show_timeline_ui(TimeLine &timeline, ImGuiIO &io)
             ImGui::TableNextColumn();
             ImGui::SetNextItemWidth(-FLT_MIN);
             ImGui::Checkbox(("##Wait(Value)" + std::to_string(i)).c_str(), &timeline.sections[i].wait_value);
+            ImGui::TableNextColumn();
+            const SectionLoad &sl = plan.sections[i];
+            ImVec4 load_color = sl.overloaded ? ImVec4(1, 0.3f, 0.3f, 1) : (sl.load > 0.8 ? ImVec4(1, 0.8f, 0.2f, 1) : ImVec4(0.4f, 1, 0.4f, 1));
+            ImGui::TextColored(load_color, "%.0f %%", sl.load * 100);
+            ImGui::SetItemTooltip("Setpoints: %.0f ms/s of %.0f\nLogging: %.0f ms/s of %.0f\nWaiting for values: %.0f ms/s of %.0f",
+                                  sl.control, tx_pacer.control_share * 1000, sl.telemetry, (1 - tx_pacer.control_share) * 1000, sl.waiting, (1 - tx_pacer.control_share) * 1000);
         }
         ImGui::EndTable();
     }
@@ -317,6 +797,238 @@ void RCT_5_Control::show_timeline_ui(TimeLine &timeline, ImGuiIO &io)
     }
     save_timeline_ui(timeline);
 }
+// Profiles are compiled again only when their text changed, the preview is drawn every frame
+static const Expression &cached_profile(int channel, const std::string &text, std::string &error)
+{
+    static std::string texts[2];
+    static Expression compiled[2];
+    static std::string errors[2];
+    static bool valid[2] = {false, false};
+    if (!valid[channel] || texts[channel] != text)
+    {
+        texts[channel] = text;
+        compiled[channel].compile(text, errors[channel]);
+        valid[channel] = true;
+    }
+    error = errors[channel];
+    return compiled[channel];
+}
+
+static void show_profile_preview(const Section &section)
+{
+    const std::string *texts[2] = {&section.temperatureProfile, &section.speedProfile};
+    const char *labels[2] = {"Temperature [°C]", "Speed [rpm]"};
+    const float limits[2] = {planMaxTemperature, planMaxSpeed};
+    const float ramps[2][2] = {{static_cast<float>(section.temperature[0]), static_cast<float>(section.temperature[1])},
+                               {static_cast<float>(section.speed[0]), static_cast<float>(section.speed[1])}};
+    for (int c = 0; c < 2; c++)
+    {
+        if (texts[c]->empty())
+        {
+            continue;
+        }
+        std::string error;
+        const Expression &expression = cached_profile(c, *texts[c], error);
+        if (!error.empty())
+        {
+            ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "%s profile: %s", c == 0 ? "Temperature" : "Speed", error.c_str());
+            continue;
+        }
+        // Values outside of the device range are sent clipped, the plot shows what the device gets
+        const int n = 512;
+        static double t[n], value[n];
+        double d = static_cast<double>(section.duration);
+        bool clipped = false;
+        for (int k = 0; k < n; k++)
+        {
+            t[k] = d * k / (n - 1);
+            double v = expression.eval(t[k], d);
+            clipped = clipped || !std::isfinite(v) || v < 0 || v > limits[c];
+            value[k] = std::isfinite(v) ? std::min(std::max(v, 0.0), static_cast<double>(limits[c])) : ramps[c][0] + (ramps[c][1] - ramps[c][0]) * k / (n - 1);
+        }
+        if (clipped)
+        {
+            ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "%s profile leaves the range 0 - %.0f, the timeline will not run", c == 0 ? "Temperature" : "Speed", limits[c]);
+        }
+        if (ImPlot::BeginPlot(c == 0 ? "##Temperature Profile" : "##Speed Profile", ImVec2(-1, ImGui::GetTextLineHeight() * 10)))
+        {
+            ImPlot::SetupAxes("t [s]", labels[c], ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+            ImPlot::PlotLine(labels[c], t, value, n);
+            ImPlot::EndPlot();
+        }
+    }
+}
+
+// Profile files are read again only when the path or the file changed, not every frame
+static void show_profile_file_preview(Section &section)
+{
+    static std::string path;
+    static std::filesystem::file_time_type mtime;
+    static ProfileSummary summary;
+    static ProfilePreview preview;
+    static std::string error;
+    if (section.profileFile.empty())
+    {
+        return;
+    }
+    std::string resolved = ProfileFile::resolve(section.profileFile, section.timeline != nullptr ? section.timeline->filePath : "");
+    std::error_code ec;
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(resolved, ec);
+    if (resolved != path || modified != mtime)
+    {
+        path = resolved;
+        mtime = modified;
+        preview = ProfilePreview();
+        if (ProfileFile::scan(resolved, planMaxTemperature, planMaxSpeed, summary, error))
+        {
+            ProfileFile::preview(resolved, 512, preview, error);
+        }
+    }
+    if (!error.empty())
+    {
+        ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "%s", error.c_str());
+        return;
+    }
+    ImGui::Text("%zu points over %.1f s", summary.points, summary.last.t);
+    ImGui::SameLine();
+    if (ImGui::SmallButton("Use profile length"))
+    {
+        section.duration = static_cast<size_t>(std::ceil(summary.last.t));
+    }
+    ImGui::SetItemTooltip("Set the duration of the section to the length of the profile");
+    if (summary.last.t < section.duration)
+    {
+        ImGui::TextDisabled("The last values of the profile hold until the end of the section");
+    }
+    else if (summary.last.t > section.duration)
+    {
+        ImGui::TextDisabled("The section ends before the profile");
+    }
+    const std::vector<double> *t[2] = {&preview.t_temperature, &preview.t_speed};
+    const std::vector<double> *value[2] = {&preview.temperature, &preview.speed};
+    const char *labels[2] = {"Temperature [°C]", "Speed [rpm]"};
+    for (int c = 0; c < 2; c++)
+    {
+        if (ImPlot::BeginPlot(c == 0 ? "##Temperature Profile File" : "##Speed Profile File", ImVec2(-1, ImGui::GetTextLineHeight() * 10)))
+        {
+            ImPlot::SetupAxes("t [s]", labels[c], ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+            ImPlot::PlotLine(labels[c], t[c]->data(), value[c]->data(), static_cast<int>(t[c]->size()));
+            ImPlot::EndPlot();
+        }
+    }
+}
+
+// Live statistics of the running section, the same numbers end up in the log when the section ends
+static void show_section_stats(const SectionStats &stats)
+{
+    if (!ImGui::BeginTable("Section Statistics", 9, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+        return;
+    }
+    const char *columns[] = {"Channel", "Readings", "Mean", "Std", "Min", "Max", "Tracking Error", "Overshoot", "Settled After"};
+    for (const char *column : columns)
+    {
+        ImGui::TableSetupColumn(column);
+    }
+    ImGui::TableHeadersRow();
+    for (int c = 0; c < LOG_CHANNELS; c++)
+    {
+        const ChannelStats &channel = stats.channels[c];
+        if (channel.value.n == 0)
+        {
+            continue;
+        }
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(logChannelInfo[c].name);
+        ImGui::TableNextColumn();
+        ImGui::Text("%llu", (unsigned long long)channel.value.n);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.2f", channel.value.mean);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", channel.value.stddev());
+        ImGui::TableNextColumn();
+        ImGui::Text("%.2f", channel.value.min);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.2f", channel.value.max);
+        ImGui::TableNextColumn();
+        if (channel.error.n > 0)
+        {
+            ImGui::Text("%+.2f ± %.2f", channel.error.mean, channel.error.stddev());
+        }
+        ImGui::TableNextColumn();
+        if (!std::isnan(channel.target))
+        {
+            ImGui::Text("%.2f", channel.overshoot);
+        }
+        ImGui::TableNextColumn();
+        if (!std::isnan(channel.t_settled))
+        {
+            ImGui::Text("%.0f s", channel.t_settled);
+        }
+    }
+    ImGui::EndTable();
+}
+
+static void show_trigger_ui(Section &section)
+{
+    const char *kinds[] = {"above", "below", "% above start", "% below start", "rate below (per min)"};
+    static_assert(sizeof(kinds) / sizeof(kinds[0]) == static_cast<size_t>(TriggerKind::Count), "A label for every trigger kind");
+    for (size_t k = 0; k < section.triggers.size(); k++)
+    {
+        Trigger &trigger = section.triggers[k];
+        ImGui::PushID(static_cast<int>(k));
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8);
+        if (ImGui::BeginCombo("##Channel", logChannelInfo[trigger.channel].name))
+        {
+            for (int c = 0; c < LOG_CHANNELS; c++)
+            {
+                if (ImGui::Selectable(logChannelInfo[c].name, trigger.channel == c))
+                {
+                    trigger.channel = static_cast<uint8_t>(c);
+                }
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 10);
+        if (ImGui::BeginCombo("##Kind", kinds[static_cast<int>(trigger.kind)]))
+        {
+            for (int t = 0; t < static_cast<int>(TriggerKind::Count); t++)
+            {
+                if (ImGui::Selectable(kinds[t], static_cast<int>(trigger.kind) == t))
+                {
+                    trigger.kind = static_cast<TriggerKind>(t);
+                }
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6);
+        ImGui::InputFloat("##Value", &trigger.value, 0, 0, "%g");
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6);
+        if (ImGui::InputFloat("for [s]", &trigger.hold, 0, 0, "%g"))
+        {
+            trigger.hold = std::max(0.0f, trigger.hold);
+        }
+        ImGui::SameLine();
+        if (ImGui::SmallButton("Remove"))
+        {
+            section.triggers.erase(section.triggers.begin() + k);
+            ImGui::PopID();
+            break;
+        }
+        ImGui::PopID();
+    }
+    if (ImGui::Button("Add Trigger"))
+    {
+        section.triggers.push_back(Trigger{LOG_VISCOSITY, TriggerKind::RiseAbove, 20, 0});
+    }
+    ImGui::SetItemTooltip("End the timed part of the section as soon as a reading meets the condition for the given time.\n"
+                          "Rates are the slope over the last readings, e.g. T Sensor rate below 0.05 for 120 s.");
+}
+
 void RCT_5_Control::show_section_ui(Section &section, ImGuiIO &io)
 {
     ImGui::SeparatorText("Section Parameters");
@@ -337,11 +1049,46 @@ void RCT_5_Control::show_section_ui(Section &section, ImGuiIO &io)
     ImGui::SetItemTooltip("Rotation speed at the beginning of the section in RPM");
     ImGui::InputScalar("Speed End", ImGuiDataType_U16, &section.speed[1]);
     ImGui::SetItemTooltip("Rotation speed at the end of the section in RPM");
+    const char *profile_help = "Set value as a function of t, the seconds since the section start, and d, the duration.\n"
+                               "Replaces the linear ramp, e.g. 25 + 60*(1 - exp(-t/300)) or t < 600 ? 80 : 80 + 5*sin(2*pi*t/120)\n"
+                               "Functions: exp log sqrt sin cos tan tanh abs floor ceil min max pow mod clamp";
+    ImGui::InputTextWithHint("Temperature Profile", "T(t), empty for the ramp", &section.temperatureProfile);
+    ImGui::SetItemTooltip("%s", profile_help);
+    ImGui::InputTextWithHint("Speed Profile", "S(t), empty for the ramp", &section.speedProfile);
+    ImGui::SetItemTooltip("%s", profile_help);
+    ImGui::InputTextWithHint("Profile File", "CSV or binary profile, empty for none", &section.profileFile);
+    ImGui::SetItemTooltip("Dense set values streamed from a file while the section runs, one row \"t, temperature, speed\" per point.\n"
+                          "Replaces the ramps, the profiles above still replace their channel. A relative path starts at the timeline file.");
+    show_profile_file_preview(section);
+    show_profile_preview(section);
+    ImGui::SeparatorText("Triggers");
+    show_trigger_ui(section);
     ImGui::Checkbox("Wait (User)", &section.wait_user);
     ImGui::SetItemTooltip("Wait for user input before proceeding to the next section");
     ImGui::SameLine();
     ImGui::Checkbox("Wait (value)", &section.wait_value);
     ImGui::SetItemTooltip("Wait for the actual values to match target values before proceeding to the next section");
+    if (section.wait_value)
+    {
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6);
+        if (ImGui::InputFloat("Band [°C]", &section.settleBand[0], 0, 0, "%g"))
+        {
+            section.settleBand[0] = std::max(0.01f, section.settleBand[0]);
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6);
+        if (ImGui::InputFloat("Band [rpm]", &section.settleBand[1], 0, 0, "%g"))
+        {
+            section.settleBand[1] = std::max(0.01f, section.settleBand[1]);
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6);
+        if (ImGui::InputFloat("Hold [s]", &section.settleHold, 0, 0, "%g"))
+        {
+            section.settleHold = std::clamp(section.settleHold, 0.0f, 86400.0f);
+        }
+        ImGui::SetItemTooltip("The values count as reached when their mean over the hold time is within the band and they no longer drift");
+    }
     ImGui::SameLine();
     ImGui::Checkbox("Beep on completion", &section.b_beep);
     ImGui::SetItemTooltip("Sound a beep at the end of the section");
@@ -459,7 +1206,276 @@ void RCT_5_Control::save_timeline_ui(TimeLine &timeline)
         {
             file_path += ".tml";
         }
-        FileOperations::saveTimeLine(timeline, file_path);
+        std::string error;
+        if (FileOperations::saveTimeLine(timeline, file_path, &error))
+        {
+            timeline.filePath = file_path;
+            statusMessage = "Saved " + file_path;
+        }
+        else
+        {
+            statusMessage = error;
+        }
+    }
+}
+// Local date as YYYY-MM-DD, an empty field is no limit
+static bool parse_date(const std::string &text, bool end_of_day, int64_t &time)
+{
+    if (text.empty())
+    {
+        time = end_of_day ? std::numeric_limits<int64_t>::max() : std::numeric_limits<int64_t>::min();
+        return true;
+    }
+    std::tm tm{};
+    std::istringstream in(text);
+    in >> std::get_time(&tm, "%Y-%m-%d");
+    if (in.fail())
+    {
+        return false;
+    }
+    tm.tm_isdst = -1;
+    time = static_cast<int64_t>(std::mktime(&tm)) + (end_of_day ? 86399 : 0);
+    return true;
+}
+void RCT_5_Control::show_library_ui(mINI::INIStructure &config)
+{
+    bool apply = ImGui::InputText("Folder", &library_folder, ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::SetItemTooltip("Folder with .tml files, subfolders included");
+    ImGui::SameLine();
+    apply |= ImGui::Button("Set");
+    if (apply)
+    {
+        library.set_folder(library_folder);
+        config["Settings"]["Library"] = library_folder;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Rescan"))
+    {
+        library.rescan();
+    }
+    bool changed = ImGui::InputText("Search", &library_search);
+    ImGui::SetItemTooltip("Part of the name or description");
+
+    if (changed || library.generation() != library_generation)
+    {
+        library_generation = library.generation();
+        library_entries = library.search(library_search);
+    }
+    ImGui::Text("%zu of %zu timelines%s", library_entries.size(), library.size(), library.scanning() ? ", scanning..." : "");
+    std::string error = library.error();
+    if (!error.empty())
+    {
+        ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "%s", error.c_str());
+    }
+
+    ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+    if (ImGui::BeginTable("Timelines", 5, flags))
+    {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Name");
+        ImGui::TableSetupColumn("Sections");
+        ImGui::TableSetupColumn("Duration");
+        ImGui::TableSetupColumn("File");
+        ImGui::TableSetupColumn("");
+        ImGui::TableHeadersRow();
+        ImGuiListClipper clipper;
+        clipper.Begin(static_cast<int>(library_entries.size()));
+        while (clipper.Step())
+        {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+            {
+                const LibraryEntry &entry = library_entries[i];
+                ImGui::PushID(i);
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                if (entry.error.empty())
+                {
+                    ImGui::TextUnformatted(entry.name.c_str());
+                    if (!entry.description.empty())
+                    {
+                        ImGui::SetItemTooltip("%s", entry.description.c_str());
+                    }
+                }
+                else
+                {
+                    ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "%s", entry.error.c_str());
+                }
+                ImGui::TableNextColumn();
+                ImGui::Text("%u", entry.sections);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu:%02llu h", static_cast<unsigned long long>(entry.duration / 3600), static_cast<unsigned long long>(entry.duration / 60 % 60));
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(entry.path.c_str());
+                ImGui::SetItemTooltip("%016llx", static_cast<unsigned long long>(entry.hash));
+                ImGui::TableNextColumn();
+                if (entry.error.empty() && ImGui::SmallButton("Open"))
+                {
+                    // The index only holds the summary, the timeline is read now
+                    std::string file = (std::filesystem::path(library.folder()) / entry.path).string();
+                    timelines.push_back(TimeLine(this));
+                    std::string error;
+                    if (FileOperations::loadTimeLine(timelines.back(), file, &error))
+                    {
+                        timelines.back().filePath = file;
+                        statusMessage = "Opened " + file;
+                    }
+                    else
+                    {
+                        timelines.pop_back();
+                        statusMessage = error;
+                    }
+                }
+                ImGui::PopID();
+            }
+        }
+        ImGui::EndTable();
+    }
+}
+
+void RCT_5_Control::show_catalog_ui()
+{
+    RunCatalog &catalog = RunCatalog::instance();
+    bool changed = ImGui::InputText("Timeline", &catalog_filter.timeline);
+    ImGui::SetItemTooltip("Part of the timeline name");
+
+    if (ImGui::BeginCombo("Device", catalog_filter.device.empty() ? "Any" : catalog_filter.device.c_str()))
+    {
+        if (ImGui::Selectable("Any", catalog_filter.device.empty()))
+        {
+            catalog_filter.device.clear();
+            changed = true;
+        }
+        for (const std::string &name : catalog.devices())
+        {
+            if (ImGui::Selectable(name.empty() ? "(none)" : name.c_str(), catalog_filter.device == name))
+            {
+                catalog_filter.device = name;
+                changed = true;
+            }
+        }
+        ImGui::EndCombo();
+    }
+    const char *outcomes[] = {"Any", "Running", "Completed", "Stopped", "Interrupted"};
+    int outcome = catalog_filter.outcome + 1;
+    if (ImGui::Combo("Outcome", &outcome, outcomes, IM_ARRAYSIZE(outcomes)))
+    {
+        catalog_filter.outcome = outcome - 1;
+        changed = true;
+    }
+    float date_width = ImGui::CalcItemWidth() / 2 - ImGui::GetStyle().ItemInnerSpacing.x;
+    ImGui::SetNextItemWidth(date_width);
+    changed |= ImGui::InputTextWithHint("##Since", "YYYY-MM-DD", &catalog_since);
+    ImGui::SameLine(0, ImGui::GetStyle().ItemInnerSpacing.x);
+    ImGui::SetNextItemWidth(date_width);
+    changed |= ImGui::InputTextWithHint("Started##Until", "YYYY-MM-DD", &catalog_until);
+    ImGui::SetItemTooltip("First and last day of the run start, empty for no limit");
+    bool dates_ok = parse_date(catalog_since, false, catalog_filter.since) && parse_date(catalog_until, true, catalog_filter.until);
+    if (ImGui::Button("Same Program"))
+    {
+        catalog_filter.timeline_hash = catalog_filter.timeline_hash == 0 && timeline_index < timelines.size() ? timelines[timeline_index].fingerprint() : 0;
+        changed = true;
+    }
+    ImGui::SetItemTooltip("Only runs of the timeline selected in the Script Runner, with any name");
+    if (catalog_filter.timeline_hash != 0)
+    {
+        ImGui::SameLine();
+        ImGui::Text("Program %016llx", static_cast<unsigned long long>(catalog_filter.timeline_hash));
+    }
+
+    if ((changed && dates_ok) || catalog.generation() != catalog_generation)
+    {
+        catalog_generation = catalog.generation();
+        catalog_runs = catalog.search(catalog_filter);
+    }
+    if (!dates_ok)
+    {
+        ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "Dates are YYYY-MM-DD");
+    }
+    ImGui::Text("%zu of %zu runs", catalog_runs.size(), catalog.size());
+    if (!catalog.error.empty())
+    {
+        ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "%s", catalog.error.c_str());
+    }
+
+    ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+    if (ImGui::BeginTable("Runs", 7, flags))
+    {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Start");
+        ImGui::TableSetupColumn("Duration");
+        ImGui::TableSetupColumn("Timeline");
+        ImGui::TableSetupColumn("Device");
+        ImGui::TableSetupColumn("Outcome");
+        ImGui::TableSetupColumn("Log");
+        ImGui::TableSetupColumn("");
+        ImGui::TableHeadersRow();
+        // Only the visible rows are drawn, the list can hold thousands of runs
+        ImGuiListClipper clipper;
+        clipper.Begin(static_cast<int>(catalog_runs.size()));
+        while (clipper.Step())
+        {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+            {
+                const RunRecord &run = catalog_runs[i];
+                ImGui::PushID(i);
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                std::time_t start = static_cast<std::time_t>(run.start);
+                char start_text[32];
+                std::strftime(start_text, sizeof(start_text), "%Y-%m-%d %H:%M", std::localtime(&start));
+                ImGui::TextUnformatted(start_text);
+                ImGui::TableNextColumn();
+                if (run.end > 0)
+                {
+                    ImGui::Text("%lld min", static_cast<long long>((run.end - run.start + 30) / 60));
+                }
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(run.timeline.c_str());
+                if (!run.timeline_file.empty())
+                {
+                    ImGui::SetItemTooltip("%s", run.timeline_file.c_str());
+                }
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(run.device.c_str());
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(RunCatalog::outcome_name(run.outcome));
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(run.log.c_str());
+                if (!run.segments.empty())
+                {
+                    std::string files;
+                    for (const std::string &file : run.segments)
+                    {
+                        files += file + "\n";
+                    }
+                    ImGui::SetItemTooltip("%s", files.c_str());
+                }
+                ImGui::TableNextColumn();
+                if (!run.timeline_file.empty() && ImGui::SmallButton("Open"))
+                {
+                    // The timeline as it was run, with its log ready to plot
+                    timelines.push_back(TimeLine(this));
+                    std::string error;
+                    if (FileOperations::loadTimeLine(timelines.back(), run.timeline_file, &error))
+                    {
+                        timelines.back().filePath = run.timeline_file;
+                        if (!run.log.empty())
+                        {
+                            timelines.back().logFilePath = run.log;
+                            timelines.back().logData.load(run.log);
+                        }
+                        statusMessage = "Opened " + run.timeline_file;
+                    }
+                    else
+                    {
+                        timelines.pop_back();
+                        statusMessage = error;
+                    }
+                }
+                ImGui::PopID();
+            }
+        }
+        ImGui::EndTable();
     }
 }
 int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *renderer)
@@ -482,15 +1498,24 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
     io.FontGlobalScale = fontscale;
     ImGuiINI::check_ini_setting(ini_cfg, "Appearance", "Style", style_index);
     ImGuiINI::set_style(style_index);
-    ImGuiINI::check_ini_setting(ini_cfg, "Settings", "COM-Port", selectedPortIndex);
+    // The port is stored by its stable device key, an index would point elsewhere after replugging
+    if (ini_cfg.has("Settings") && ini_cfg["Settings"].has("Port-Id"))
+    {
+        selectedPortKey = ini_cfg["Settings"]["Port-Id"];
+    }
+    update_ports();
     ImGuiINI::check_ini_setting(ini_cfg, "Settings", "Baud-Rate", selectedBaudRateIndex);
     ImGuiINI::check_ini_setting(ini_cfg, "Settings", "Reconnect", auto_connect);
+    if (ini_cfg.has("Settings") && ini_cfg["Settings"].has("Library"))
+    {
+        library_folder = ini_cfg["Settings"]["Library"];
+        library.set_folder(library_folder);
+    }
     static bool connected_on_startup = false;
     if (auto_connect && !connected_on_startup)
     {
         connected_on_startup = true;
         connectPort();
-        get_device_name();
     }
 
     fileDialog.SetDirectory(".");
@@ -499,6 +1524,11 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
     while (!done)
 
     {
+        // Pick up hotplug changes and finished connects from the worker threads
+        update_ports();
+        poll_connect();
+        poll_command();
+
         // Poll and handle events (inputs, window resize, etc.)
         SDL_Event event;
         while (SDL_PollEvent(&event))
@@ -582,8 +1612,17 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
                         std::string file_path = fileDialogLoad.GetSelected().string();
                         fileDialogLoad.ClearSelected();
                         timelines.push_back(TimeLine(this));
-                        timeline_mask = (1 << (timelines.size() - 1));
-                        FileOperations::loadTimeLine(timelines[timelines.size() - 1], file_path);
+                        std::string error;
+                        if (FileOperations::loadTimeLine(timelines.back(), file_path, &error))
+                        {
+                            timelines.back().filePath = file_path;
+                            timeline_mask = (1 << (timelines.size() - 1));
+                        }
+                        else
+                        {
+                            timelines.pop_back();
+                            statusMessage = error;
+                        }
                     }
 
                     if (timelines.size() > 0)
@@ -660,7 +1699,7 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
                         {
                             if (ImGui::MenuItem("Delete Section"))
                             {
-                                timelines[index_tl].sections.erase(timelines[index_tl].sections.begin() + index_sec);
+                                timelines[index_tl].removeSection(index_sec);
                                 ImGui::CloseCurrentPopup();
                                 index_sec = -1;
                             }
@@ -773,6 +1812,26 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
                         ImGui::PopFont();
                         ImGui::Text(timelines[timeline_index].name.c_str());
                         ImGui::Text(timelines[timeline_index].sections[timelines[timeline_index].current_section].name.c_str());
+                        const TimeLine &paused = timelines[timeline_index];
+                        const ExecutionPlan *paused_plan = paused.plan.get();
+                        if (paused.adjusting && paused_plan != nullptr && paused.current_section < paused_plan->sections.size() &&
+                            paused_plan->actions[paused_plan->sections[paused.current_section].end - 1].op == PlanOp::Wait)
+                        {
+                            // Mean over the hold time against the band, the ETA comes from an exponential fit
+                            const PlanSection &planned = paused_plan->sections[paused.current_section];
+                            const PlanAction &wait = paused_plan->actions[planned.end - 1];
+                            ImGui::Text("Temperature: %.1f °C, target %.1f ± %.1f °C", paused.settle_mean[0], wait.temperature, planned.settle_band[0]);
+                            ImGui::Text("Speed: %.0f rpm, target %.0f ± %.0f rpm", paused.settle_mean[1], wait.speed, planned.settle_band[1]);
+                            double eta = paused.settle_eta;
+                            if (eta >= 0)
+                            {
+                                ImGui::Text("Settled in about %d:%02d min (stable for %.0f s)", static_cast<int>(eta) / 60, static_cast<int>(eta) % 60, planned.settle_hold);
+                            }
+                            else
+                            {
+                                ImGui::Text("Settled in: estimating...");
+                            }
+                        }
 
                         if (ImGui::Button(btn_text.c_str()))
                         {
@@ -815,6 +1874,24 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
                     ImGui::SameLine();
                     ImGui::SetNextItemWidth(inputTextWidth - buttonWidth);
                     ImGui::InputText("Log Path", &timelines[timeline_index].logFilePath);
+                    if (!timelines[timeline_index].running && !timelines[timeline_index].logFilePath.empty())
+                    {
+                        // Both read the plain log and all of its segments as one stream
+                        if (ImGui::Button("Load Log"))
+                        {
+                            bool loaded = timelines[timeline_index].logData.load(timelines[timeline_index].logFilePath);
+                            statusMessage = loaded ? "Loaded last run of " + timelines[timeline_index].logFilePath : "Log file not found";
+                        }
+                        ImGui::SetItemTooltip("Plot the last run recorded in the log file");
+                        ImGui::SameLine();
+                        if (ImGui::Button("Export Log"))
+                        {
+                            std::filesystem::path log(timelines[timeline_index].logFilePath);
+                            std::string target = (log.parent_path() / (log.stem().string() + "_export.txt")).string();
+                            statusMessage = LogSegments::export_log(log.string(), target) ? "Log exported to " + target : "Log export failed";
+                        }
+                        ImGui::SetItemTooltip("Write the whole log, including all segments, into one text file");
+                    }
 
                     if (timelines[timeline_index].running)
                     {
@@ -822,13 +1899,81 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
                         size_t *current_section = &timelines[timeline_index].current_section;
                         std::chrono::duration<float> time_elapsed = std::chrono::steady_clock::now() - timelines[timeline_index].t_start;
                         std::string time_elapsed_str = std::to_string(std::chrono::duration_cast<std::chrono::seconds>(time_elapsed).count());
-                        status_txt = "Running: " + timelines[timeline_index].name + "   |   Section: " + timelines[timeline_index].sections[*current_section].name + "   |   Time elapsed: " + time_elapsed_str + " s   |   ";
+                        status_txt = "Running: " + timelines[timeline_index].name + "   |   Section: " + timelines[timeline_index].sections[*current_section].name + "   |   ";
+                        // Pass through every repeat block around the current section, outermost first
+                        const ExecutionPlan *run_plan = timelines[timeline_index].plan.get();
+                        const std::vector<uint32_t> &passes = timelines[timeline_index].repeat_passes;
+                        if (run_plan != nullptr && passes.size() == run_plan->repeats.size())
+                        {
+                            std::string repeat_txt;
+                            for (size_t r = run_plan->repeats.size(); r-- > 0;)
+                            {
+                                if (passes[r] > 0)
+                                {
+                                    repeat_txt += (repeat_txt.empty() ? "" : ", ") + std::to_string(passes[r]) + " / " + std::to_string(run_plan->repeats[r].count);
+                                }
+                            }
+                            if (!repeat_txt.empty())
+                            {
+                                status_txt += "Repeat: " + repeat_txt + "   |   ";
+                            }
+                        }
+                        status_txt += "Time elapsed: " + time_elapsed_str + " s   |   ";
                         ImGui::Text(status_txt.c_str());
                         ImGui::SameLine();
                         if (ImGui::Button("Stop Script", ImVec2(-1, 0)))
                         {
                             timelines[timeline_index].stop();
                         }
+                        // The plan holds the timed part of the run, waits for the user or the set values come on top
+                        float fraction = 0;
+                        double remaining = timelines[timeline_index].remaining(fraction);
+                        const ExecutionPlan *plan = timelines[timeline_index].plan.get();
+                        char eta[64];
+                        std::snprintf(eta, sizeof(eta), "%d:%02d:%02d left%s", static_cast<int>(remaining) / 3600, static_cast<int>(remaining) / 60 % 60,
+                                      static_cast<int>(remaining) % 60, plan != nullptr && plan->waits > 0 ? " + waits" : "");
+                        ImGui::ProgressBar(fraction, ImVec2(-1, 0), eta);
+                        if (plan != nullptr && *current_section < plan->sections.size())
+                        {
+                            const PlanSection &planned = plan->sections[*current_section];
+                            std::string ends_on;
+                            for (uint32_t k = planned.trigger_first; k < planned.trigger_end; k++)
+                            {
+                                ends_on += (ends_on.empty() ? "" : "  or  ") + TriggerSet::describe(plan->triggers[k]);
+                            }
+                            if (!ends_on.empty())
+                            {
+                                ImGui::Text("Section ends early on: %s", ends_on.c_str());
+                            }
+                        }
+                        show_section_stats(timelines[timeline_index].section_stats);
+                        std::shared_ptr<LogWriter> writer = timelines[timeline_index].log_writer;
+                        if (writer)
+                        {
+                            ImGui::Text("Log writer: %zu / %zu queued (peak %zu)   |   %llu written in %llu writes, slowest %.1f ms",
+                                        writer->depth(), writer->capacity(), writer->high_water.load(),
+                                        (unsigned long long)writer->written.load(), (unsigned long long)writer->batches.load(), writer->max_write_ms.load());
+                            if (writer->failed || writer->dropped > 0)
+                            {
+                                ImGui::SameLine();
+                                ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "|  %s%llu records lost", writer->failed ? "Log file not writable, " : "", (unsigned long long)writer->dropped.load());
+                            }
+                            if (writer->segment > 0)
+                            {
+                                ImGui::Text("Writing segment %u   |   %zu segment(s) waiting for compression", writer->segment.load(), LogCompressor::instance().pending());
+                            }
+                            if (timelines[timeline_index].logFlush.journal)
+                            {
+                                ImGui::Text("Journal: block %llu written, %llu on disk (%llu syncs)", (unsigned long long)writer->journal_seq.load(),
+                                            (unsigned long long)writer->durable_seq.load(), (unsigned long long)writer->syncs.load());
+                                std::string journal_status = writer->journal_status();
+                                if (!journal_status.empty())
+                                {
+                                    ImGui::SameLine();
+                                    ImGui::Text("|  %s", journal_status.c_str());
+                                }
+                            }
+                        }
                     }
                     else
                     {
@@ -836,9 +1981,10 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
                         {
                             if (ImGui::Button("Run Script"))
                             {
-                                if (timeline_index < timelines.size())
+                                std::string error;
+                                if (timeline_index < timelines.size() && !timelines[timeline_index].execute(&error))
                                 {
-                                    timelines[timeline_index].execute();
+                                    statusMessage = error;
                                 }
                             }
                         }
@@ -847,24 +1993,20 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
                             ImGui::Text("Connect RCT 5 to run script");
                         }
                     }
-                    if (timelines[timeline_index].logData.time.size() > 0)
+                    if (!timelines[timeline_index].logData.empty())
                     {
                         ImGui::SeparatorText("Logging");
                         ImGui::Text("Log of: %s ", timelines[timeline_index].name.c_str());
                         ImGui::SameLine(ImGui::CalcTextSize(status_txt.c_str()).x + ImGui::GetStyle().ItemSpacing.x * 2);
                         if (ImGui::Button("Reset Log Data", ImVec2(-1, 0)))
                         {
-                            timelines[timeline_index].logData.time.clear();
-                            timelines[timeline_index].logData.temperaturePlate.clear();
-                            timelines[timeline_index].logData.temperatureSensor.clear();
-                            timelines[timeline_index].logData.speed.clear();
-                            timelines[timeline_index].logData.viscosity.clear();
+                            timelines[timeline_index].logData.clear();
                         }
                         int n_plots = ((int)(timelines[timeline_index].logTemperaturePlate || timelines[timeline_index].logTemperatureSensor) + (int)(timelines[timeline_index].logSpeed) + (int)(timelines[timeline_index].logViscosity));
                         size_t plot_height = (ImGui::GetContentRegionAvail().y / n_plots) - ImGui::GetStyle().ItemSpacing.y;
                         LogData *logData = &timelines[timeline_index].logData;
 
-                        if (logData->time.size() > 0)
+                        if (!logData->empty())
                         {
                             if (timelines[timeline_index].logTemperaturePlate || timelines[timeline_index].logTemperatureSensor)
                             {
@@ -873,11 +2015,11 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
                                     ImPlot::SetupAxes("", "T [°C]", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
                                     if (timelines[timeline_index].logTemperaturePlate)
                                     {
-                                        ImPlot::PlotLine("Temperature Plate", logData->time.data(), logData->temperaturePlate.data(), logData->time.size());
+                                        plot_series("Temperature Plate", logData->temperaturePlate, timelines[timeline_index].adaptiveLogging);
                                     }
-                                    if (timelines[timeline_index].logTemperatureSensor && v_max(logData->temperatureSensor) >= 1.0)
+                                    if (timelines[timeline_index].logTemperatureSensor && logData->temperatureSensor.max_value() >= 1.0)
                                     {
-                                        ImPlot::PlotLine("Temperature Sensor", logData->time.data(), logData->temperatureSensor.data(), logData->time.size());
+                                        plot_series("Temperature Sensor", logData->temperatureSensor, timelines[timeline_index].adaptiveLogging);
                                     }
                                     ImPlot::EndPlot();
                                 }
@@ -887,7 +2029,7 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
                                 if (ImPlot::BeginPlot("Stirring Speed", ImVec2(-1, plot_height)))
                                 {
                                     ImPlot::SetupAxes("", "Speed [rpm]", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
-                                    ImPlot::PlotLine("Speed", logData->time.data(), logData->speed.data(), logData->time.size());
+                                    plot_series("Speed", logData->speed, timelines[timeline_index].adaptiveLogging);
                                     ImPlot::EndPlot();
                                 }
                             }
@@ -896,7 +2038,7 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
                                 if (ImPlot::BeginPlot("Viscosity trend", ImVec2(-1, plot_height)))
                                 {
                                     ImPlot::SetupAxes("Time [s]", "Viscosity [%]", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
-                                    ImPlot::PlotLine("Viscosity Trend", logData->time.data(), logData->viscosity.data(), logData->time.size());
+                                    plot_series("Viscosity Trend", logData->viscosity, timelines[timeline_index].adaptiveLogging);
                                     ImPlot::EndPlot();
                                 }
                             }
@@ -906,6 +2048,20 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
                 ImGui::EndChild();
                 ImGui::EndTabItem();
             }
+            if (ImGui::BeginTabItem("Library", NULL, ImGuiTabItemFlags_None))
+            {
+                ImGui::BeginChild("Library", ImVec2(-1, -1), ImGuiWindowFlags_None);
+                show_library_ui(ini_cfg);
+                ImGui::EndChild();
+                ImGui::EndTabItem();
+            }
+            if (ImGui::BeginTabItem("Run Catalog", NULL, ImGuiTabItemFlags_None))
+            {
+                ImGui::BeginChild("Run Catalog", ImVec2(-1, -1), ImGuiWindowFlags_None);
+                show_catalog_ui();
+                ImGui::EndChild();
+                ImGui::EndTabItem();
+            }
             if (ImGui::BeginTabItem("Direct Interface", NULL, ImGuiTabItemFlags_None))
             {
                 ImGui::BeginChild("Direct Interface", ImVec2(-1, -1), ImGuiWindowFlags_None);
@@ -946,12 +2102,28 @@ int RCT_5_Control::render_window(SDL_Window *window, ImGuiIO &io, SDL_Renderer *
                         ImGui::InputScalar("Parameter", ImGuiDataType_U16, &namur.parameter);
                     }
 
-                    // Send signal button
+                    // Send signal button, the response is picked up by poll_command() once it arrives
+                    ImGui::BeginDisabled(pending_command.valid());
                     if (ImGui::Button("Send Signal"))
                     {
-                        send_signal(namur.to_string(namur[selectedCommandIndex]));
+                        // Setpoints do not answer, queue them so repeated clicks cannot pile up
+                        if (TxQueue::is_setpoint(namur[selectedCommandIndex]))
+                        {
+                            post_signal(namur.to_string(namur[selectedCommandIndex]));
+                            namur.responseText = "";
+                        }
+                        else
+                        {
+                            pending_command = queue_signal(namur.to_string(namur[selectedCommandIndex]));
+                            namur.responseText = "Waiting for the device ...";
+                        }
                     }
+                    ImGui::EndDisabled();
                 }
+                TxQueueStats queue = tx_queue.stats();
+                ImGui::Text("Transmit queue: %zu pending, peak %zu, %zu setpoints superseded", queue.depth, queue.max_depth, queue.coalesced);
+                TxPacerStats pacing = tx_pacer.stats();
+                ImGui::Text("Line pacing: %.1f ms per command (device %.1f ms), %.1f s spent waiting for budget", tx_pacer.command_ms(), pacing.service_ms, pacing.waited_ms / 1000);
                 // Response text box
                 ImGui::InputText("Response", &namur.responseText, ImGuiInputTextFlags_ReadOnly);
                 ImGui::EndChild();
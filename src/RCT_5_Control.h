@@ -7,9 +7,19 @@
 #include <chrono>
 #include <stdio.h>
 #include <SDL.h>
+#include <map>
+#include <mutex>
+#include <future>
+#include <thread>
 
 #include "NamurCommands.h"
 #include "SerialPort.h" // Include the appropriate header file for SerialPort
+#include "PortDiscovery.h"
+#include "DeviceProbe.h"
+#include "TxQueue.h"
+#include "TxPacer.h"
+#include "RunCatalog.h"
+#include "TimelineLibrary.h"
 #define MINI_CASE_SENSITIVE
 #include "ini.h"
 #include "TimeLine.h"
@@ -22,15 +32,23 @@ class RCT_5_Control
 {
 public:
     RCT_5_Control();
-    // ~RCT_5_Control();
+    ~RCT_5_Control();
     int render_window(SDL_Window *window,ImGuiIO &io, SDL_Renderer* renderer);
-    void send_signal(const std::string &command);
+    std::string send_signal(const std::string &command); // Queue a command and wait for its response, for worker threads
+    void post_signal(const std::string &command);        // Queue a command without waiting, setpoints may be coalesced
     std::string get_response();
     float get_numeric_value();
+    static float parse_numeric(const std::string &response); // Reading in a response, NaN on error text
+    std::vector<std::string> drain_link_events(); // Connection events (drops, retries, reconnects) since the last call
+    SerialError get_last_error();                 // Outcome of the last Direct Interface command
+    std::string get_device();                     // Name the connected device reported, empty without one
     
 private:
     SerialPort *serialPort;
-    std::vector<std::string> availablePorts;
+    PortDiscovery discovery;
+    std::vector<PortInfo> availablePorts;
+    uint64_t ports_generation;   // discovery generation of availablePorts
+    std::string selectedPortKey; // Stable key of the selected device, follows it across re-enumeration
     std::vector<uint32_t> baudRates;
     size_t selectedBaudRateIndex;
     size_t selectedPortIndex;
@@ -41,15 +59,69 @@ private:
 
     NamurCommands namur;
 
+    // Connection supervision
+    std::mutex serial_mutex;                         // Serialises access to the port (GUI and timeline threads)
+    uint64_t port_generation;                        // Counts the ports installed by poll_connect
+    std::mutex event_mutex;                          // Protects link_events
+    std::vector<std::string> link_events;            // Pending connection events for the log
+    std::map<std::string, std::string> replay_state; // Last setpoint / start-stop command per channel
+    bool link_down;                                  // Link is lost and could not be restored yet
+    std::chrono::time_point<std::chrono::steady_clock> t_link_lost;
+    size_t reconnect_timeout_ms;                     // How long to keep trying on the first failure
+    int max_read_retries;                            // Repetitions of a timed out IN_* read
+    SerialError last_error;
+
+    // Transmit queue, drained by tx_thread at the pace of tx_pacer
+    TxQueue tx_queue;
+    TxPacer tx_pacer;
+    std::thread tx_thread;
+    void tx_dispatch();
+    std::future<TxResult> queue_signal(const std::string &command); // Queue a command, the future holds its response
+    TxResult execute_command(const TxRequest &request);
+    SerialError transfer(const std::string &command, const std::string &base_command, bool returnsValue, std::string &response);
+    bool reconnect(std::unique_lock<std::mutex> &lock, size_t timeout_ms); // Releases lock while it backs off
+    void remember_state(const std::string &base_command, const std::string &command);
+    void log_link_event(const std::string &event);
+
+    // Asynchronous connect, the port is opened and queried off the GUI thread
+    struct ConnectResult
+    {
+        SerialPort *port;
+        bool opened;
+        std::string device;
+    };
+    std::future<ConnectResult> pending_connect;
+    std::future<TxResult> pending_command; // Direct Interface command waiting for its response
+    DeviceProbe probe;
+
     void checkAvailablePorts();
+    void update_ports();
     void connectPort();
-    void get_device_name();
+    void poll_connect();
+    void poll_command();
+    void show_probe_ui(mINI::INIStructure &config);
     void show_command_ui();
     void show_connection_ui(mINI::INIStructure &config);
     void show_timeline_ui(TimeLine &timeline, ImGuiIO &io);
     void show_section_ui(Section &section, ImGuiIO &io);
+    void show_catalog_ui();
+    void show_library_ui(mINI::INIStructure &config);
     std::vector<TimeLine> timelines;
     void inline save_timeline_ui(TimeLine &timeline);
+
+    // Run catalog search, redone only when the filter or the catalog changed
+    RunFilter catalog_filter;
+    std::string catalog_since;
+    std::string catalog_until;
+    std::vector<RunRecord> catalog_runs;
+    uint64_t catalog_generation;
+
+    // Recipe folder, indexed in the background; timelines are only loaded when opened
+    TimelineLibrary library;
+    std::string library_folder;
+    std::string library_search;
+    std::vector<LibraryEntry> library_entries;
+    uint64_t library_generation;
     
 };
 #endif // RCT_5_CONTROL_H
\ No newline at end of file
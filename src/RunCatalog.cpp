@@ -0,0 +1,331 @@
+#include "RunCatalog.h"
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+static const char *outcome_names[] = {"running", "completed", "stopped", "interrupted"};
+
+static std::string lower(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c)
+                   { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+// Fields are tab separated, one run per line
+static std::string clean(std::string text)
+{
+    std::replace_if(text.begin(), text.end(), [](char c)
+                    { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+    return text;
+}
+
+RunCatalog &RunCatalog::instance()
+{
+    static RunCatalog catalog;
+    return catalog;
+}
+
+RunCatalog::RunCatalog() : error(), path(), records(), by_id(), by_device(), by_name(), by_hash(), by_outcome(), by_start(), next_id(1), changes(0), mutex() {}
+
+const char *RunCatalog::outcome_name(RunOutcome outcome)
+{
+    return outcome_names[static_cast<int>(outcome)];
+}
+
+uint64_t RunCatalog::hash(const void *data, size_t size, uint64_t seed)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        h = (h ^ p[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+std::string RunCatalog::format(const RunRecord &record)
+{
+    char hash_text[17];
+    std::snprintf(hash_text, sizeof(hash_text), "%016llx", static_cast<unsigned long long>(record.timeline_hash));
+    std::ostringstream line;
+    line << record.id << "\t" << record.start << "\t" << record.end << "\t" << outcome_names[static_cast<int>(record.outcome)] << "\t"
+         << hash_text << "\t" << clean(record.device) << "\t" << clean(record.timeline) << "\t" << clean(record.timeline_file) << "\t"
+         << clean(record.log);
+    for (const std::string &segment : record.segments)
+    {
+        line << "\t" << clean(segment);
+    }
+    return line.str();
+}
+
+bool RunCatalog::parse(const std::string &line, RunRecord &record)
+{
+    std::vector<std::string> fields;
+    std::istringstream in(line);
+    std::string field;
+    while (std::getline(in, field, '\t'))
+    {
+        fields.push_back(field);
+    }
+    if (fields.size() < 9)
+    {
+        return false;
+    }
+    try
+    {
+        record.id = std::stoull(fields[0]);
+        record.start = std::stoll(fields[1]);
+        record.end = std::stoll(fields[2]);
+        record.timeline_hash = std::stoull(fields[4], nullptr, 16);
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+    auto outcome = std::find(std::begin(outcome_names), std::end(outcome_names), fields[3]);
+    if (outcome == std::end(outcome_names))
+    {
+        return false;
+    }
+    record.outcome = static_cast<RunOutcome>(outcome - std::begin(outcome_names));
+    record.device = fields[5];
+    record.timeline = fields[6];
+    record.timeline_file = fields[7];
+    record.log = fields[8];
+    record.segments.assign(fields.begin() + 9, fields.end());
+    return true;
+}
+
+void RunCatalog::store(const RunRecord &record)
+{
+    auto it = by_id.find(record.id);
+    if (it != by_id.end())
+    {
+        // Only the end of a run changes after it was registered
+        RunRecord &old = records[it->second];
+        if (old.outcome != record.outcome)
+        {
+            std::vector<size_t> &from = by_outcome[static_cast<int>(old.outcome)];
+            from.erase(std::find(from.begin(), from.end(), it->second));
+            std::vector<size_t> &to = by_outcome[static_cast<int>(record.outcome)];
+            to.insert(std::upper_bound(to.begin(), to.end(), it->second), it->second);
+        }
+        old.end = record.end;
+        old.outcome = record.outcome;
+        old.segments = record.segments;
+        return;
+    }
+    size_t index = records.size();
+    records.push_back(record);
+    by_id[record.id] = index;
+    by_device[record.device].push_back(index);
+    by_name[lower(record.timeline)].push_back(index);
+    by_hash[record.timeline_hash].push_back(index);
+    by_outcome[static_cast<int>(record.outcome)].push_back(index);
+    std::pair<int64_t, size_t> key(record.start, index);
+    by_start.insert(std::upper_bound(by_start.begin(), by_start.end(), key), key);
+    next_id = std::max(next_id, record.id + 1);
+}
+
+bool RunCatalog::append(const RunRecord &record)
+{
+    std::ofstream out(path, std::ios::app);
+    out << format(record) << '\n';
+    out.flush();
+    if (!out.good())
+    {
+        error = "Could not write run catalog " + path;
+        return false;
+    }
+    return true;
+}
+
+bool RunCatalog::open(const std::string &catalog_path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    path = catalog_path;
+    error.clear();
+    size_t lines = 0;
+    {
+        std::ifstream in(path);
+        std::string line;
+        RunRecord record;
+        while (std::getline(in, line))
+        {
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+            lines++;
+            if (parse(line, record))
+            {
+                store(record);
+            }
+        }
+    }
+    // Runs still open in the file belong to an earlier session that ended without finishing them
+    std::vector<RunRecord> interrupted;
+    for (const RunRecord &record : records)
+    {
+        if (record.outcome == RunOutcome::Running)
+        {
+            interrupted.push_back(record);
+            interrupted.back().outcome = RunOutcome::Interrupted;
+        }
+    }
+    for (const RunRecord &record : interrupted)
+    {
+        store(record);
+    }
+    changes++;
+
+    // Every finished run has two lines, rewrite the file once most of it is outdated
+    if (lines > 2 * records.size() + 64 || !interrupted.empty())
+    {
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            out << "# id\tstart\tend\toutcome\thash\tdevice\ttimeline\ttimeline file\tlog\tsegments..." << '\n';
+            for (const RunRecord &record : records)
+            {
+                out << format(record) << '\n';
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec)
+        {
+            error = "Could not compact run catalog: " + ec.message();
+        }
+    }
+    return error.empty();
+}
+
+uint64_t RunCatalog::begin(RunRecord record)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    record.id = next_id;
+    record.end = 0;
+    record.outcome = RunOutcome::Running;
+    store(record);
+    append(record);
+    changes++;
+    return record.id;
+}
+
+void RunCatalog::finish(uint64_t id, RunOutcome outcome, const std::vector<std::string> &segments)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = by_id.find(id);
+    if (it == by_id.end())
+    {
+        return;
+    }
+    RunRecord record = records[it->second];
+    record.end = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    record.outcome = outcome;
+    record.segments = segments;
+    store(record);
+    append(record);
+    changes++;
+}
+
+std::vector<RunRecord> RunCatalog::search(const RunFilter &filter) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    // Start from the smallest candidate list the filter allows
+    std::vector<size_t> names;
+    const std::vector<size_t> *candidates = nullptr;
+    auto narrow = [&candidates](const std::vector<size_t> *list)
+    {
+        if (candidates == nullptr || list->size() < candidates->size())
+        {
+            candidates = list;
+        }
+    };
+    static const std::vector<size_t> none;
+    if (!filter.device.empty())
+    {
+        auto it = by_device.find(filter.device);
+        narrow(it != by_device.end() ? &it->second : &none);
+    }
+    if (filter.timeline_hash != 0)
+    {
+        auto it = by_hash.find(filter.timeline_hash);
+        narrow(it != by_hash.end() ? &it->second : &none);
+    }
+    if (filter.outcome >= 0 && filter.outcome < 4)
+    {
+        narrow(&by_outcome[filter.outcome]);
+    }
+    if (!filter.timeline.empty())
+    {
+        // There are far fewer distinct timeline names than runs
+        std::string part = lower(filter.timeline);
+        for (const auto &name : by_name)
+        {
+            if (name.first.find(part) != std::string::npos)
+            {
+                names.insert(names.end(), name.second.begin(), name.second.end());
+            }
+        }
+        std::sort(names.begin(), names.end());
+        narrow(&names);
+    }
+    std::vector<size_t> in_time;
+    auto first = std::lower_bound(by_start.begin(), by_start.end(), std::make_pair(filter.since, size_t(0)));
+    auto last = std::upper_bound(by_start.begin(), by_start.end(), std::make_pair(filter.until, SIZE_MAX));
+    if (candidates == nullptr || static_cast<size_t>(last - first) < candidates->size())
+    {
+        for (auto it = first; it != last; ++it)
+        {
+            in_time.push_back(it->second);
+        }
+        std::sort(in_time.begin(), in_time.end());
+        candidates = &in_time;
+    }
+
+    std::string part = lower(filter.timeline);
+    std::vector<RunRecord> result;
+    for (auto it = candidates->rbegin(); it != candidates->rend(); ++it)
+    {
+        const RunRecord &r = records[*it];
+        if ((filter.device.empty() || r.device == filter.device) &&
+            (filter.timeline_hash == 0 || r.timeline_hash == filter.timeline_hash) &&
+            (filter.outcome < 0 || static_cast<int>(r.outcome) == filter.outcome) &&
+            r.start >= filter.since && r.start <= filter.until &&
+            (part.empty() || lower(r.timeline).find(part) != std::string::npos))
+        {
+            result.push_back(r);
+        }
+    }
+    return result;
+}
+
+std::vector<std::string> RunCatalog::devices() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> list;
+    for (const auto &device : by_device)
+    {
+        list.push_back(device.first);
+    }
+    std::sort(list.begin(), list.end());
+    return list;
+}
+
+size_t RunCatalog::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return records.size();
+}
+
+uint64_t RunCatalog::generation() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return changes;
+}
@@ -0,0 +1,85 @@
+#ifndef RUNCATALOG_H
+#define RUNCATALOG_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <limits>
+#include <cstdint>
+
+enum class RunOutcome
+{
+    Running,
+    Completed,
+    Stopped,    // Stopped by the user
+    Interrupted // The program ended during the run
+};
+
+struct RunRecord
+{
+    uint64_t id;
+    std::string timeline;
+    uint64_t timeline_hash;            // Fingerprint of the sections and log settings, equal for the same program
+    std::string timeline_file;         // .tml the timeline was loaded from or saved to, may be empty
+    std::string device;                // Answer to IN_NAME
+    int64_t start;                     // Unix time
+    int64_t end;                       // 0 while running
+    RunOutcome outcome;
+    std::string log;                   // Log file, empty without logging
+    std::vector<std::string> segments; // Files holding the run: the log and/or its segments
+};
+
+struct RunFilter
+{
+    std::string timeline;       // Part of the timeline name, any case
+    std::string device;         // Exact device name, empty for any
+    uint64_t timeline_hash = 0; // 0 for any
+    int outcome = -1;           // RunOutcome, -1 for any
+    int64_t since = std::numeric_limits<int64_t>::min();
+    int64_t until = std::numeric_limits<int64_t>::max();
+};
+
+// Every run the executor started, kept in runs.catalog next to imgui.ini. The file is append
+// only: a run is written when it starts and again when it ends, the last line of an id wins.
+// Searches go through the smallest matching secondary index (device, timeline hash, outcome,
+// timeline name, start time) before the remaining conditions are checked.
+class RunCatalog
+{
+public:
+    static RunCatalog &instance();
+    bool open(const std::string &path); // Loads the catalog, compacts it if most lines are outdated
+
+    uint64_t begin(RunRecord record); // Registers a running run, returns its id
+    void finish(uint64_t id, RunOutcome outcome, const std::vector<std::string> &segments);
+
+    std::vector<RunRecord> search(const RunFilter &filter) const; // Newest first
+    std::vector<std::string> devices() const;
+    size_t size() const;
+    uint64_t generation() const; // Changes with every update, to redo a search only when needed
+    std::string error;
+
+    static const char *outcome_name(RunOutcome outcome);
+    static uint64_t hash(const void *data, size_t size, uint64_t seed = 14695981039346656037ull); // FNV-1a
+
+private:
+    RunCatalog();
+    std::string path;
+    std::vector<RunRecord> records; // In the order they were registered
+    std::unordered_map<uint64_t, size_t> by_id;
+    std::unordered_map<std::string, std::vector<size_t>> by_device;
+    std::unordered_map<std::string, std::vector<size_t>> by_name; // Lower case timeline name
+    std::unordered_map<uint64_t, std::vector<size_t>> by_hash;
+    std::vector<size_t> by_outcome[4];
+    std::vector<std::pair<int64_t, size_t>> by_start; // Sorted by start time
+    uint64_t next_id;
+    uint64_t changes;
+    mutable std::mutex mutex;
+
+    void store(const RunRecord &record); // Adds or replaces a record and indexes it
+    bool append(const RunRecord &record);
+    static std::string format(const RunRecord &record);
+    static bool parse(const std::string &line, RunRecord &record);
+};
+
+#endif // RUNCATALOG_H
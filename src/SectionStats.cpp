@@ -0,0 +1,142 @@
+#include "SectionStats.h"
+#include "TimeLine.h"
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+static_assert(statsChannels == LOG_CHANNELS, "One ChannelStats per log channel");
+
+void RunningStats::clear()
+{
+    n = 0;
+    mean = m2 = 0;
+    min = max = NAN;
+}
+
+void RunningStats::add(double x)
+{
+    n++;
+    double delta = x - mean;
+    mean += delta / n;
+    m2 += delta * (x - mean);
+    min = n == 1 ? static_cast<float>(x) : std::min(min, static_cast<float>(x));
+    max = n == 1 ? static_cast<float>(x) : std::max(max, static_cast<float>(x));
+}
+
+double RunningStats::variance() const
+{
+    return n > 1 ? m2 / (n - 1) : 0;
+}
+
+double RunningStats::stddev() const
+{
+    return std::sqrt(variance());
+}
+
+SectionStats::SectionStats()
+{
+    const float band[2] = {0, 0};
+    reset(NAN, NAN, band);
+}
+
+// Plate and sensor follow the temperature set value, the viscosity trend has none
+static int set_value_index(int channel)
+{
+    return channel == LOG_SPEED ? 1 : (channel == LOG_T_PLATE || channel == LOG_T_SENSOR ? 0 : -1);
+}
+
+void SectionStats::reset(float temperature, float speed, const float band[2])
+{
+    for (int c = 0; c < statsChannels; c++)
+    {
+        ChannelStats &stats = channels[c];
+        stats.value.clear();
+        stats.error.clear();
+        int k = set_value_index(c);
+        stats.target = k < 0 ? NAN : (k == 0 ? temperature : speed);
+        stats.band = k < 0 ? NAN : band[k];
+        stats.first = NAN;
+        stats.overshoot = 0;
+        stats.t_settled = NAN;
+        set_value[c] = NAN;
+    }
+}
+
+void SectionStats::set_values(float temperature, float speed)
+{
+    for (int c = 0; c < statsChannels; c++)
+    {
+        int k = set_value_index(c);
+        set_value[c] = k < 0 ? NAN : (k == 0 ? temperature : speed);
+    }
+}
+
+void SectionStats::add(int channel, double t_section, float value)
+{
+    if (channel < 0 || channel >= statsChannels || std::isnan(value))
+    {
+        return;
+    }
+    ChannelStats &stats = channels[channel];
+    stats.value.add(value);
+    if (std::isnan(stats.target))
+    {
+        return;
+    }
+    if (!std::isnan(set_value[channel]))
+    {
+        stats.error.add(value - set_value[channel]);
+    }
+    if (std::isnan(stats.first))
+    {
+        stats.first = value;
+    }
+    // Approaching from below an overshoot lies above the target and the other way round;
+    // starting at the target any excursion counts
+    float deviation = value - stats.target;
+    float direction = stats.first < stats.target ? 1.0f : (stats.first > stats.target ? -1.0f : 0.0f);
+    stats.overshoot = std::max(stats.overshoot, direction != 0 ? deviation * direction : std::abs(deviation));
+    if (std::abs(deviation) > stats.band)
+    {
+        stats.t_settled = NAN;
+    }
+    else if (std::isnan(stats.t_settled))
+    {
+        stats.t_settled = static_cast<float>(t_section);
+    }
+}
+
+std::string SectionStats::summary() const
+{
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(3);
+    text << "Statistics:" << std::endl;
+    text << "Channel\tReadings\tMean\tStd\tMin\tMax\tTracking error mean\tTracking error std\tOvershoot\tSettled after [s]" << std::endl;
+    for (int c = 0; c < statsChannels; c++)
+    {
+        const ChannelStats &stats = channels[c];
+        if (stats.value.n == 0)
+        {
+            continue;
+        }
+        text << logChannelInfo[c].name << "\t" << stats.value.n << "\t" << stats.value.mean << "\t" << stats.value.stddev() << "\t"
+             << stats.value.min << "\t" << stats.value.max << "\t";
+        if (stats.error.n > 0)
+        {
+            text << stats.error.mean << "\t" << stats.error.stddev();
+        }
+        text << "\t";
+        if (!std::isnan(stats.target))
+        {
+            text << stats.overshoot;
+        }
+        text << "\t";
+        if (!std::isnan(stats.t_settled))
+        {
+            text << stats.t_settled;
+        }
+        text << std::endl;
+    }
+    return text.str();
+}
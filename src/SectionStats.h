@@ -0,0 +1,50 @@
+#ifndef SECTIONSTATS_H
+#define SECTIONSTATS_H
+
+#include <string>
+#include <cstdint>
+
+static const int statsChannels = 4; // LogChannel count, checked in SectionStats.cpp
+
+// Mean and variance by Welford's method, stable over millions of readings
+struct RunningStats
+{
+    uint64_t n;
+    double mean;
+    double m2; // Sum of squared deviations from the mean
+    float min;
+    float max;
+
+    void clear();
+    void add(double x);
+    double variance() const; // Sample variance, 0 below two readings
+    double stddev() const;
+};
+
+struct ChannelStats
+{
+    RunningStats value;
+    RunningStats error; // Reading minus the set value at that time, channels with a set value only
+    float target;       // Set value at the end of the section, NaN for none
+    float band;         // Readings within target +- band count as settled
+    float first;        // First reading, gives the direction of the approach
+    float overshoot;    // Furthest reading beyond the target in the direction of the approach
+    float t_settled;    // Seconds from the section start after which all readings stayed in the band, NaN while outside
+};
+
+// Statistics of the running section per log channel, every reading is added in constant time and memory
+class SectionStats
+{
+public:
+    SectionStats();
+    void reset(float temperature, float speed, const float band[2]); // Set values at the end of the section
+    void set_values(float temperature, float speed);                 // Set values sent right now
+    void add(int channel, double t_section, float value);
+    std::string summary() const; // Block for the log, one row per channel with readings
+    ChannelStats channels[statsChannels];
+
+private:
+    float set_value[statsChannels];
+};
+
+#endif // SECTIONSTATS_H
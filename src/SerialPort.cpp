@@ -1,14 +1,100 @@
 #include "SerialPort.h"
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <string>
 #include <vector>
 
+const char *serial_error_text(SerialError error)
+{
+    switch (error)
+    {
+    case SerialError::None:
+        return "OK";
+    case SerialError::NotOpen:
+        return "Serial port not open";
+    case SerialError::WriteFailed:
+        return "Failed to send signal";
+    case SerialError::Timeout:
+        return "No reply from device (timeout)";
+    case SerialError::LinkLost:
+        return "Serial link lost";
+    }
+    return "Unknown error";
+}
+
+RttEstimator::RttEstimator() : srtt_ms(0), rttvar_ms(0), min_rto_ms(20), max_rto_ms(2000), initialized(false), rto(1000) {}
+
+void RttEstimator::sample(double rtt_ms)
+{
+    if (!initialized)
+    {
+        srtt_ms = rtt_ms;
+        rttvar_ms = rtt_ms / 2;
+        initialized = true;
+    }
+    else
+    {
+        // beta = 1/4, alpha = 1/8
+        rttvar_ms = 0.75 * rttvar_ms + 0.25 * std::abs(srtt_ms - rtt_ms);
+        srtt_ms = 0.875 * srtt_ms + 0.125 * rtt_ms;
+    }
+    rto = srtt_ms + std::max(1.0, 4 * rttvar_ms);
+}
+
+void RttEstimator::backoff()
+{
+    rto *= 2;
+}
+
+int RttEstimator::rto_ms() const
+{
+    return std::clamp(static_cast<int>(std::ceil(rto)), min_rto_ms, max_rto_ms);
+}
+
+SerialError SerialPort::transact(const std::string &command, std::string &reply, bool expectReply)
+{
+    reply.clear();
+    if (!isOpen())
+    {
+        return SerialError::NotOpen;
+    }
+    auto t_sent = std::chrono::steady_clock::now();
+    if (!sendCommand(command))
+    {
+        return linkLost ? SerialError::LinkLost : SerialError::WriteFailed;
+    }
+    if (!expectReply)
+    {
+        return SerialError::None;
+    }
+    reply = readLine(rtt.rto_ms());
+    if (reply.find('\n') == std::string::npos)
+    {
+        if (linkLost)
+        {
+            return SerialError::LinkLost;
+        }
+        rtt.backoff();
+        return SerialError::Timeout;
+    }
+    lastRtt_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_sent).count();
+    rtt.sample(lastRtt_ms);
+    return SerialError::None;
+}
+
+std::string SerialPort::readString()
+{
+    return readLine(readTimeout_ms);
+}
+
 #ifdef _WIN32
 #include <windows.h>
 
 // Windows implementation
 SerialPort::SerialPort(const std::string &portName, int baudRate)
-    : handle(nullptr), portName(portName), baudRate(baudRate) {}
+    : portName(portName), stablePath(portName), baudRate(baudRate), readTimeout_ms(10000),
+      linkLost(false), lastError(0), rtt(), lastRtt_ms(0), handle(nullptr) {}
 
 SerialPort::~SerialPort()
 {
@@ -24,6 +110,7 @@ bool SerialPort::open()
     if (handle == INVALID_HANDLE_VALUE)
     {
         std::cerr << "Error opening serial port" << std::endl;
+        handle = nullptr;
         return false;
     }
 
@@ -47,10 +134,12 @@ bool SerialPort::open()
         return false;
     }
 
+    // ReadFile returns at once when data is waiting and otherwise after 10 ms,
+    // readLine() enforces the actual reply deadline
     GetCommTimeouts(handle, &ct);
-    ct.ReadIntervalTimeout = 100;
-    ct.ReadTotalTimeoutMultiplier = 0;
-    ct.ReadTotalTimeoutConstant = 100;
+    ct.ReadIntervalTimeout = MAXDWORD;
+    ct.ReadTotalTimeoutMultiplier = MAXDWORD;
+    ct.ReadTotalTimeoutConstant = 10;
     ct.WriteTotalTimeoutMultiplier = 0;
     ct.WriteTotalTimeoutConstant = 100;
     SetCommTimeouts(handle, &ct);
@@ -67,6 +156,42 @@ void SerialPort::close()
     }
 }
 
+bool SerialPort::isOpen() const
+{
+    return handle != nullptr;
+}
+
+void SerialPort::flushInput()
+{
+    if (handle != nullptr)
+    {
+        PurgeComm(handle, PURGE_RXCLEAR);
+    }
+}
+
+bool SerialPort::reopen()
+{
+    // COM port names are stable on Windows, the same name comes back after replugging
+    close();
+    if (!open())
+    {
+        return false;
+    }
+    linkLost = false;
+    lastError = 0;
+    return true;
+}
+
+void SerialPort::flagError(int error)
+{
+    lastError = error;
+    if (error == ERROR_BAD_COMMAND || error == ERROR_DEVICE_REMOVED || error == ERROR_ACCESS_DENIED ||
+        error == ERROR_OPERATION_ABORTED || error == ERROR_INVALID_HANDLE || error == ERROR_FILE_NOT_FOUND)
+    {
+        linkLost = true;
+    }
+}
+
 bool SerialPort::sendCommand(const std::string &command)
 {
     std::string upperCommand = command;
@@ -74,8 +199,9 @@ bool SerialPort::sendCommand(const std::string &command)
     upperCommand += " \r\n";
 
     DWORD bytes_written;
-    if (!WriteFile(handle, upperCommand.c_str(), upperCommand.size(), &bytes_written, NULL))
+    if (handle == nullptr || !WriteFile(handle, upperCommand.c_str(), upperCommand.size(), &bytes_written, NULL))
     {
+        flagError(handle == nullptr ? ERROR_INVALID_HANDLE : GetLastError());
         std::cerr << "Error writing to serial port" << std::endl;
         return false;
     }
@@ -83,28 +209,34 @@ bool SerialPort::sendCommand(const std::string &command)
     return true;
 }
 
-std::string SerialPort::readString()
+std::string SerialPort::readLine(int timeout_ms)
 {
     std::string result;
     char buffer;
     unsigned long bytes_read;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
 
     while (true)
     {
-        if (!ReadFile(handle, &buffer, 1, &bytes_read, NULL))
+        if (handle == nullptr || !ReadFile(handle, &buffer, 1, &bytes_read, NULL))
         {
+            flagError(handle == nullptr ? ERROR_INVALID_HANDLE : GetLastError());
             std::cerr << "Error reading from serial port" << std::endl;
             return result;
         }
         if (bytes_read == 0)
         {
-            break;
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                break;
+            }
+            continue;
         }
+        result += buffer;
         if (buffer == '\n')
         {
             break;
         }
-        result += buffer;
     }
 
     return result;
@@ -115,6 +247,7 @@ bool SerialPort::readBytes(unsigned char *buffer)
     unsigned long bytes_read;
     if (!ReadFile(handle, buffer, 1, &bytes_read, NULL))
     {
+        flagError(GetLastError());
         std::cerr << "Error reading from serial port" << std::endl;
         return false;
     }
@@ -151,12 +284,70 @@ std::vector<std::string> listSerialPorts()
 #include <fcntl.h>
 #include <termios.h>
 #include <unistd.h>
+#include <poll.h>
+#include <cerrno>
+#include <chrono>
 #include <cstring>
 #include <iostream>
 #include <filesystem>
 
+// Find the /dev/serial/by-id link of a device node. The by-id name is derived from the
+// USB serial number, so it still points at the same adapter after it re-enumerated
+// as a different ttyUSBx.
+static std::string byIdPath(const std::string &portName)
+{
+    std::error_code ec;
+    if (!std::filesystem::is_directory("/dev/serial/by-id", ec))
+    {
+        return portName;
+    }
+    std::filesystem::path target = std::filesystem::canonical(portName, ec);
+    if (ec)
+    {
+        return portName;
+    }
+    for (const auto &entry : std::filesystem::directory_iterator("/dev/serial/by-id", ec))
+    {
+        std::error_code ec_link;
+        if (std::filesystem::canonical(entry.path(), ec_link) == target && !ec_link)
+        {
+            return entry.path().string();
+        }
+    }
+    return portName;
+}
+
+// termios expects the Bxxx constants, not the plain numeric rate
+static speed_t to_speed(int baudRate)
+{
+    switch (baudRate)
+    {
+    case 4800:
+        return B4800;
+    case 9600:
+        return B9600;
+    case 19200:
+        return B19200;
+    case 38400:
+        return B38400;
+    case 57600:
+        return B57600;
+    case 115200:
+        return B115200;
+    case 230400:
+        return B230400;
+    case 460800:
+        return B460800;
+    case 921600:
+        return B921600;
+    default:
+        return B9600;
+    }
+}
+
 SerialPort::SerialPort(const std::string &portName, int baudRate)
-    : portName(portName), baudRate(baudRate), handle(-1) {}
+    : portName(portName), stablePath(byIdPath(portName)), baudRate(baudRate), readTimeout_ms(10000),
+      linkLost(false), lastError(0), rtt(), lastRtt_ms(0), handle(-1) {}
 
 SerialPort::~SerialPort()
 {
@@ -181,8 +372,8 @@ bool SerialPort::open()
     }
 
     // Set baud rate
-    cfsetispeed(&tty, baudRate);
-    cfsetospeed(&tty, baudRate);
+    cfsetispeed(&tty, to_speed(baudRate));
+    cfsetospeed(&tty, to_speed(baudRate));
 
     // Set 8N1 (8 data bits, no parity, 1 stop bit)
     tty.c_cflag &= ~PARENB; // No parity
@@ -196,8 +387,8 @@ bool SerialPort::open()
     tty.c_oflag &= ~OPOST;
 
     // Set timeouts
-    tty.c_cc[VMIN] = 0;   // Non-blocking read
-    tty.c_cc[VTIME] = 100; // 1 second read timeout
+    tty.c_cc[VMIN] = 0;  // Non-blocking read
+    tty.c_cc[VTIME] = 0; // Reply deadlines are enforced with poll() in readLine()
 
     // Apply the settings
     if (tcsetattr(handle, TCSANOW, &tty) != 0)
@@ -228,10 +419,55 @@ void SerialPort::close()
     }
 }
 
+bool SerialPort::isOpen() const
+{
+    return handle >= 0;
+}
+
+void SerialPort::flushInput()
+{
+    if (handle >= 0)
+    {
+        tcflush(handle, TCIFLUSH);
+    }
+}
+
+bool SerialPort::reopen()
+{
+    close();
+    // Prefer the by-id link, the kernel may have handed out a new ttyUSBx name
+    std::error_code ec;
+    if (stablePath != portName && std::filesystem::exists(stablePath, ec))
+    {
+        std::filesystem::path node = std::filesystem::canonical(stablePath, ec);
+        if (!ec)
+        {
+            portName = node.string();
+        }
+    }
+    if (!open())
+    {
+        return false;
+    }
+    linkLost = false;
+    lastError = 0;
+    return true;
+}
+
+void SerialPort::flagError(int error)
+{
+    lastError = error;
+    if (error == EIO || error == ENXIO || error == ENODEV || error == EBADF || error == EPIPE)
+    {
+        linkLost = true;
+    }
+}
+
 bool SerialPort::sendByte(unsigned char byte)
 {
     if (write(handle, &byte, 1) != 1)
     {
+        flagError(errno);
         printf("Error %i from sendByte: %s\n", errno, strerror(errno));
         return false;
     }
@@ -243,6 +479,7 @@ bool SerialPort::readBytes(unsigned char *buffer)
     int num_bytes = read(handle, buffer, 1);
     if (num_bytes < 0)
     {
+        flagError(errno);
         printf("Error %i from readBytes: %s\n", errno, strerror(errno));
         return false;
     }
@@ -258,6 +495,7 @@ bool SerialPort::sendCommand(const std::string &command)
     ssize_t bytes_written = write(handle, upperCommand.c_str(), upperCommand.size());
     if (bytes_written < 0)
     {
+        flagError(errno);
         printf("Error %i from sendCommand: %s\n", errno, strerror(errno));
         return false;
     }
@@ -265,35 +503,73 @@ bool SerialPort::sendCommand(const std::string &command)
     return true;
 }
 
-std::string SerialPort::readString() {
-    if (handle == -1) {
+std::string SerialPort::readLine(int timeout_ms)
+{
+    if (handle == -1)
+    {
         std::cerr << "Serial port not open" << std::endl;
+        flagError(EBADF);
         return "";
     }
 
     char buffer[256];
     std::string result;
-    int bytesRead;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
 
-    while (true) {
-        bytesRead = ::read(handle, buffer, sizeof(buffer) - 1);
-        if (bytesRead > 0) {
+    while (true)
+    {
+        int remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+        if (remaining <= 0)
+        {
+            // No (complete) reply within the timeout
+            break;
+        }
+        struct pollfd pfd = {handle, POLLIN, 0};
+        int ready = poll(&pfd, 1, remaining);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            flagError(errno);
+            break;
+        }
+        if (ready == 0)
+        {
+            break;
+        }
+        if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL))
+        {
+            // The adapter was unplugged or re-enumerated
+            flagError(EIO);
+            std::cerr << "Serial port hung up" << std::endl;
+            break;
+        }
+        ssize_t bytesRead = ::read(handle, buffer, sizeof(buffer) - 1);
+        if (bytesRead > 0)
+        {
             buffer[bytesRead] = '\0';
             result += buffer;
-            if (result.find('\n') != std::string::npos) {
+            if (result.find('\n') != std::string::npos)
+            {
                 break;
             }
-        } else if (bytesRead == -1) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // No data available, continue reading
-                usleep(1000); // Sleep for 1ms
+        }
+        else if (bytesRead == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
                 continue;
-            } else {
-                std::cerr << "Error reading from serial port: " << strerror(errno) << std::endl;
-                break;
             }
-        } else {
-            // No more data
+            flagError(errno);
+            std::cerr << "Error reading from serial port: " << strerror(errno) << std::endl;
+            break;
+        }
+        else
+        {
+            // Readable but end of file: the tty was hung up
+            flagError(EIO);
             break;
         }
     }
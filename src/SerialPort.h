@@ -10,6 +10,38 @@
 #else
 #define PORT_HANDLE int
 #endif
+
+// Outcome of a command/reply exchange
+enum class SerialError
+{
+    None,
+    NotOpen,     // Port is not open
+    WriteFailed, // Command could not be written
+    Timeout,     // No complete reply before the deadline
+    LinkLost     // Device vanished (unplugged, hub reset)
+};
+const char *serial_error_text(SerialError error);
+
+// Smoothed round trip time and variance as in the TCP retransmission timer (RFC 6298).
+// The reply deadline follows the device instead of a fixed worst case.
+class RttEstimator
+{
+public:
+    RttEstimator();
+    void sample(double rtt_ms); // Round trip of a reply to a command that was sent once
+    void backoff();             // Double the deadline after a timeout
+    int rto_ms() const;         // Current reply deadline
+
+    double srtt_ms;   // Smoothed round trip time
+    double rttvar_ms; // Round trip time variation
+    int min_rto_ms;
+    int max_rto_ms;
+
+private:
+    bool initialized;
+    double rto;
+};
+
 class SerialPort
 {
 public:
@@ -22,14 +54,26 @@ public:
     bool sendCommand(const std::string &command);
     bool readBytes(unsigned char *buffer);
     std::string readString();
+    SerialError transact(const std::string &command, std::string &reply, bool expectReply); // Send and read with the adaptive deadline
+    bool reopen();      // Reopen the same physical device after the link dropped
+    void flushInput();  // Discard unread input, e.g. garbage received at a wrong baud rate
+    bool isOpen() const;
 
     std::string portName;
+    std::string stablePath; // Path that survives re-enumeration (e.g. /dev/serial/by-id/...)
     int baudRate;
+    int readTimeout_ms;     // Maximum time to wait for a complete reply
+    bool linkLost;          // Set when the device vanished (EIO/ENXIO/hangup)
+    int lastError;          // errno / GetLastError() of the last failed operation
+    RttEstimator rtt;       // Reply time statistics of this device
+    double lastRtt_ms;      // Round trip of the last successful transact()
     void checkAvailablePorts();
     std::vector<std::string> availablePorts;
 
 private:
     PORT_HANDLE handle;
+    void flagError(int error);
+    std::string readLine(int timeout_ms);
 };
 std::vector<std::string> listSerialPorts();
 #endif // SERIALPORT_H
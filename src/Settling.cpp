@@ -0,0 +1,116 @@
+#include "Settling.h"
+#include <cmath>
+#include <algorithm>
+
+SettlingDetector::SettlingDetector() : target(0), band(0), hold(0), window(), t0(0), st(0), sv(0), stt(0), stv(0), t_inside(-1) {}
+
+void SettlingDetector::reset(float target, float band, float hold)
+{
+    this->target = target;
+    this->band = band;
+    this->hold = hold;
+    window.clear();
+    st = sv = stt = stv = 0;
+    t_inside = -1;
+}
+
+void SettlingDetector::add(double t, float value)
+{
+    if (std::isnan(value))
+    {
+        return;
+    }
+    if (window.empty())
+    {
+        t0 = t;
+    }
+    double x = t - t0;
+    window.push_back(SettlingSample{x, value});
+    st += x;
+    sv += value;
+    stt += x * x;
+    stv += x * value;
+    // Readings older than the hold time leave the window, the newest one always stays
+    while (window.size() > 1 && x - window.front().t > hold)
+    {
+        const SettlingSample &old = window.front();
+        st -= old.t;
+        sv -= old.value;
+        stt -= old.t * old.t;
+        stv -= old.t * old.value;
+        window.pop_front();
+    }
+    // Long waits move the times far from t0, an hour later the sums start over from the window
+    if (window.front().t > 3600)
+    {
+        double shift = window.front().t;
+        t0 += shift;
+        st = sv = stt = stv = 0;
+        for (SettlingSample &sample : window)
+        {
+            sample.t -= shift;
+            st += sample.t;
+            sv += sample.value;
+            stt += sample.t * sample.t;
+            stv += sample.t * sample.value;
+        }
+        t_inside = t_inside >= 0 ? t_inside - shift : t_inside;
+        x -= shift;
+    }
+    if (std::abs(value - target) > band)
+    {
+        t_inside = -1;
+    }
+    else if (t_inside < 0)
+    {
+        t_inside = x;
+    }
+}
+
+double SettlingDetector::mean() const
+{
+    return window.empty() ? NAN : sv / window.size();
+}
+
+double SettlingDetector::slope() const
+{
+    double n = static_cast<double>(window.size());
+    double d = n * stt - st * st;
+    return n > 1 && d > 1e-12 ? (n * stv - st * sv) / d : 0;
+}
+
+bool SettlingDetector::settled() const
+{
+    if (window.empty() || window.back().t - window.front().t < hold * 0.95)
+    {
+        return false;
+    }
+    return std::abs(mean() - target) <= band && std::abs(slope()) * hold <= band;
+}
+
+double SettlingDetector::eta() const
+{
+    if (window.empty())
+    {
+        return -1;
+    }
+    if (settled())
+    {
+        return 0;
+    }
+    // Error at the newest reading on the fitted line; e' = -e / tau for v = target + e0 * exp(-t / tau)
+    double t_mean = st / window.size();
+    double error = mean() + slope() * (window.back().t - t_mean) - target;
+    double s = slope();
+    double hold_left = t_inside >= 0 ? std::max(0.0, hold - (window.back().t - t_inside)) : hold;
+    if (std::abs(error) <= band)
+    {
+        return hold_left;
+    }
+    if (error * s >= 0)
+    {
+        return -1; // Moving away or not moving
+    }
+    double tau = -error / s;
+    return tau * std::log(std::abs(error) / band) + hold;
+}
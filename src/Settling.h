@@ -0,0 +1,39 @@
+#ifndef SETTLING_H
+#define SETTLING_H
+
+#include <deque>
+#include <cstddef>
+
+struct SettlingSample
+{
+    double t; // Seconds
+    float value;
+};
+
+// Decides when a reading has settled at its target: over the last hold seconds the mean is within
+// band of the target and the drift of the least squares line stays within band as well. The window
+// keeps running sums, a reading costs O(1); it holds the readings of hold seconds.
+class SettlingDetector
+{
+public:
+    SettlingDetector();
+    void reset(float target, float band, float hold);
+    void add(double t, float value); // NaN readings are skipped
+    bool settled() const;
+    // Seconds until settled from an exponential approach to the target fitted to mean and slope,
+    // negative while the readings do not approach the target
+    double eta() const;
+    double mean() const;
+    double slope() const; // Per second
+    float target;
+    float band;
+    float hold;
+
+private:
+    std::deque<SettlingSample> window;
+    double t0; // Window times are relative to the first reading, that keeps the sums exact enough
+    double st, sv, stt, stv;
+    double t_inside; // Since when the newest readings are within band, negative if the newest one is not
+};
+
+#endif // SETTLING_H
@@ -11,23 +11,71 @@
 #include <fstream>
 #include "RCT_5_Control.h"
 #include "Utilities.h"
+#include "LogWriter.h"
+#include "TimeSeries.h"
+#include "ExecutionPlan.h"
+#include "SectionStats.h"
+#include <memory>
+#include <cmath>
 
 // Forward declarations
 class Section;
 class RCT_5_Control;
 
+// Logged channels, index into the per-channel arrays
+enum LogChannel
+{
+    LOG_SPEED,
+    LOG_T_PLATE,
+    LOG_T_SENSOR,
+    LOG_VISCOSITY,
+    LOG_CHANNELS
+};
+struct LogChannelInfo
+{
+    const char *name;    // Column name in the log file
+    const char *command; // NAMUR command reading the channel
+};
+extern const LogChannelInfo logChannelInfo[LOG_CHANNELS];
+
+// Runtime state of a channel for adaptive sampling
+struct LogChannelState
+{
+    float stored;    // Last value written to the log
+    float t_stored;  // Time stamp of the stored value in seconds
+    float previous;  // Last value read, stored or dropped
+    float t_dropped; // Time stamp of the last dropped reading, negative if there is none
+    bool has_stored; // Any value written yet
+};
+
 // Internal LogData class definition
 class LogData
 {
 public:
-    std::vector<float> time;
-    std::vector<float> temperaturePlate;
-    std::vector<float> temperatureSensor;
-    std::vector<float> speed;
-    std::vector<float> viscosity;
+    LogSeries temperaturePlate;
+    LogSeries temperatureSensor;
+    LogSeries speed;
+    LogSeries viscosity;
 
     LogData();
-    void addData(float t, float tp, float ts, float s, float v);
+    void addData(float t, float tp, float ts, float s, float v); // All channels sampled at the same time
+    void addSample(int channel, float t, float v);                 // One channel, see LogChannel
+    LogSeries &channel(int channel);
+    void clear();
+    bool empty() const;
+    bool load(const std::string &logFilePath); // Readings of the last run in a log file, across all segments
+};
+
+// Wait for value: the readings count as settled once they stay this close to the set values for the hold time
+static const float settleDefaultBand[2] = {0.5f, 5.0f}; // °C, rpm
+static const float settleDefaultHold = 30;              // Seconds
+
+// Sections first to last run count times in a row. Blocks may nest, they must not overlap partly.
+struct RepeatBlock
+{
+    uint32_t first;
+    uint32_t last;
+    uint32_t count;
 };
 
 // TimeLine class definition
@@ -35,12 +83,20 @@ class TimeLine
 {
 private:
     void execute_thread();
+    void flush_log(); // Write readings held back by adaptive logging at the end of a run
 
 public:
     std::string name;                                           // Name of the timeline
     std::string description;                                    // Description of the timeline
     std::vector<Section> sections;                              // Sections of the timeline
-    size_t logInterval;                                         // Interval for logging in seconds
+    std::vector<RepeatBlock> repeats;                           // Repeated runs of sections, expanded while the timeline runs
+    float logIntervals[LOG_CHANNELS];                           // Logging interval per channel in seconds, see LogChannel
+    bool adaptiveLogging;                                       // Drop readings within the deadband, sample faster on transients
+    float logDeadband[LOG_CHANNELS];                            // Change from the last stored value that is logged, per channel
+    float logMaxGap;                                            // Longest time without a stored value in seconds (adaptive logging)
+    float logBoost;                                             // Sample rate multiplier while ramping or values move (adaptive logging)
+    LogFlushPolicy logFlush;                                    // When the log writer thread writes to the file
+    LogRotation logRotation;                                    // Splitting the log into segments
     bool logTemperaturePlate;                                   // Log temperature plate readings
     bool logSpeed;                                              // Log speed readings
     bool logViscosity;                                          // Log viscosity readings
@@ -48,39 +104,56 @@ public:
     std::vector<std::string> logCommands;                       // Commands to execute for logging
     std::thread *communication_thread;                          // Thread for communication with the device
     std::string logFilePath;                                    // Path of the log file
+    std::string filePath;                                       // .tml the timeline was loaded from or saved to
+    uint64_t run_id;                                            // Run catalog entry of the current run
     RCT_5_Control *rct;                                         // Pointer to the RCT_5_Control object
     bool b_stop;                                                // Stop the timeline manually
     bool waiting;                                               // Waiting for user input
     bool adjusting;                                               // Waiting for user input
+    double settle_eta;                                          // Wait for value: seconds until the readings settle, negative while unknown
+    float settle_mean[2];                                       // Wait for value: mean temperature and speed over the hold time
     bool running;                                               // Run status the timeline
     size_t current_section;                                     // Current section index
+    std::vector<uint32_t> repeat_passes;                        // Pass through each block of plan->repeats, from 1, 0 outside of the block
+    uint64_t done_ms;                                           // Timed part of the sections finished in this run
     LogData logData;                                            // Log data for the timeline
-    std::chrono::time_point<std::chrono::steady_clock> t_start; // Start time of the section
-    TimeLine(std::string name, RCT_5_Control *rct) : name(name), description(), sections(),
-                                                     logInterval(10), logTemperaturePlate(true), logSpeed(true),
+    std::chrono::time_point<std::chrono::steady_clock> t_start; // Start time of the run, time zero of the log
+    std::chrono::time_point<std::chrono::steady_clock> t_section; // Start time of the current section
+    std::shared_ptr<const ExecutionPlan> plan;                  // Compiled timeline of the current or last run
+    SectionStats section_stats;                                 // Readings of the current or last section against its set values
+    std::chrono::time_point<std::chrono::steady_clock> t_next_log[LOG_CHANNELS]; // Next due reading per channel
+    LogChannelState log_state[LOG_CHANNELS];                                     // Adaptive sampling state per channel
+    std::shared_ptr<LogWriter> log_writer;                                       // Writes the log of the current run, null without a log file
+    TimeLine(std::string name, RCT_5_Control *rct) : name(name), description(), sections(), repeats(),
+                                                     logIntervals{10, 10, 10, 10}, adaptiveLogging(false), logDeadband{5, 0.2f, 0.2f, 1},
+                                                     logMaxGap(600), logBoost(4), logFlush(), logRotation(), logTemperaturePlate(true), logSpeed(true),
                                                      logViscosity(true), logTemperatureSensor(true),
-                                                     communication_thread(nullptr), logFilePath(name + ".log"),
-                                                     rct(rct), b_stop(false), waiting(false), adjusting(false), running(false),
-                                                     current_section(0), logData(), t_start() {}
-    TimeLine(RCT_5_Control *rct) : name(""), description(), sections(), logInterval(10), logTemperaturePlate(true), logSpeed(true),
-                                   logViscosity(true), logTemperatureSensor(true), communication_thread(nullptr), logFilePath(),
-                                   rct(rct), b_stop(false), waiting(false), adjusting(false), running(false), current_section(0), logData(), t_start() {}
+                                                     communication_thread(nullptr), logFilePath(name + ".log"), filePath(), run_id(0),
+                                                     rct(rct), b_stop(false), waiting(false), adjusting(false), settle_eta(-1), settle_mean{NAN, NAN}, running(false),
+                                                     current_section(0), repeat_passes(), done_ms(0), logData(), t_start(), t_section(), plan() {}
+    TimeLine(RCT_5_Control *rct) : name(""), description(), sections(), repeats(), logIntervals{10, 10, 10, 10}, adaptiveLogging(false), logDeadband{5, 0.2f, 0.2f, 1},
+                                   logMaxGap(600), logBoost(4), logFlush(), logRotation(), logTemperaturePlate(true), logSpeed(true),
+                                   logViscosity(true), logTemperatureSensor(true), communication_thread(nullptr), logFilePath(), filePath(), run_id(0),
+                                   rct(rct), b_stop(false), waiting(false), adjusting(false), settle_eta(-1), settle_mean{NAN, NAN}, running(false), current_section(0), repeat_passes(), done_ms(0), logData(), t_start(), t_section(), plan() {}
     ~TimeLine();
     void addSection(const Section &section);
-    void execute();
+    void removeSection(size_t index); // Also shrinks or drops the repeat blocks around it
+    bool execute(std::string *error = nullptr); // Compiles the plan and starts the run, fails on an invalid timeline
     void stop();
+    bool logs(int channel) const; // Channel is enabled for logging
+    bool logging() const;         // Any channel is logged to a file
+    uint8_t log_columns() const;  // Channels with a column in the log, one bit per LogChannel
+    uint64_t fingerprint() const; // Hash of everything that defines the program, not its name
+    double remaining(float &fraction) const; // Seconds left in the timed part of the run and the fraction done
 };
 
 // Section class definition
 class Section
 {
 private:
-    std::vector<float> temperatures;
-    std::vector<float> speeds;
-    size_t interval;
-    // SerialPort *serialPort;
-    void compile_section();
-    void handle_logging(std::ofstream &logFile, size_t ms_passed, std::chrono::time_point<std::chrono::steady_clock> &t_last_log);
+    void handle_logging(bool ramping, TriggerSet *triggers = nullptr);
+    void read_triggers(TriggerSet &triggers); // Reads the trigger channels the log did not read recently
+    void send_commands(const ExecutionPlan &plan, const PlanSection &planned, size_t &action, PlanOp op, const char *title);
 
 public:
     TimeLine *timeline;
@@ -91,13 +164,22 @@ public:
     std::string description;                      // Description of the section
     bool wait_user;                               // Wait for user input before proceeding to the next section
     bool wait_value;                              // Wait for read value to match the set value
+    float settleBand[2];                          // Wait for value: allowed deviation of temperature and speed
+    float settleHold;                             // Wait for value: seconds the readings have to stay within the band
     bool b_beep;                                  // Sound a beep at end beginning of the section
     std::vector<std::string> preSectionCommands;  // Commands to execute before the section
     std::vector<std::string> postSectionCommands; // Commands to execute after the section
+    std::string temperatureProfile;               // Temperature as an expression in t (see Expression.h), empty for the ramp
+    std::string speedProfile;                     // Speed as an expression in t, empty for the ramp
+    std::string profileFile;                      // Dense profile streamed from a file (see ProfileFile.h), relative to the .tml
+    std::vector<Trigger> triggers;                // End the timed part early when one of them fires
 
-    Section(std::string name, TimeLine *timeline) : temperatures(), speeds(), timeline(timeline), duration(60), temperature{30, 30}, speed{0, 0}, name(name), description(), wait_user(false), wait_value(false), b_beep(false) {}
-    Section() : temperatures(), speeds(), timeline(nullptr) , duration(0), temperature{0, 0}, speed{0, 0}, name(""), description(""), wait_user(false), wait_value(false), b_beep(false){}
-    void execute_section();
+    Section(std::string name, TimeLine *timeline) : timeline(timeline), duration(60), temperature{30, 30}, speed{0, 0}, name(name), description(), wait_user(false), wait_value(false),
+                                                    settleBand{settleDefaultBand[0], settleDefaultBand[1]}, settleHold(settleDefaultHold), b_beep(false) {}
+    Section() : timeline(nullptr), duration(0), temperature{0, 0}, speed{0, 0}, name(""), description(""), wait_user(false), wait_value(false),
+                settleBand{settleDefaultBand[0], settleDefaultBand[1]}, settleHold(settleDefaultHold), b_beep(false) {}
+    void execute_section(const ExecutionPlan &plan, const PlanSection &planned); // Runs the actions compiled for this section
+    double set_value_rate() const; // OUT_SP writes per second while the section runs
     void sound_beep();
 };
 
@@ -0,0 +1,446 @@
+#include "TimeSeries.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+
+static void put_bits(SeriesBlock &block, uint64_t value, int n)
+{
+    for (int i = n - 1; i >= 0; i--)
+    {
+        if ((block.n_bits & 7) == 0)
+        {
+            block.bits.push_back(0);
+        }
+        if ((value >> i) & 1)
+        {
+            block.bits.back() |= 0x80 >> (block.n_bits & 7);
+        }
+        block.n_bits++;
+    }
+}
+
+class BitReader
+{
+public:
+    BitReader(const SeriesBlock &block) : data(block.bits.data()), pos(0) {}
+    uint64_t read(int n)
+    {
+        uint64_t value = 0;
+        for (int i = 0; i < n; i++, pos++)
+        {
+            value = (value << 1) | ((data[pos >> 3] >> (7 - (pos & 7))) & 1);
+        }
+        return value;
+    }
+
+private:
+    const uint8_t *data;
+    size_t pos;
+};
+
+static uint32_t float_bits(float v)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits)
+{
+    float v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static int leading_zeros(uint32_t x)
+{
+    int n = 0;
+    for (uint32_t bit = 0x80000000u; bit && !(x & bit); bit >>= 1)
+    {
+        n++;
+    }
+    return n;
+}
+
+static int trailing_zeros(uint32_t x)
+{
+    int n = 0;
+    for (uint32_t bit = 1; bit && !(x & bit); bit <<= 1)
+    {
+        n++;
+    }
+    return n;
+}
+
+// Readings are logged with one decimal. Stored as tenths they are integers in float,
+// whose XOR with the previous value leaves only a few meaningful bits.
+static bool tenths(float v, float &q)
+{
+    if (std::isnan(v))
+    {
+        q = v;
+        return true;
+    }
+    q = std::round(v * 10.0f);
+    return std::abs(q) < 16777216.0f && q / 10.0f == v;
+}
+
+// Sign extension of an n bit two's complement value
+static int64_t sign_extend(uint64_t value, int n)
+{
+    uint64_t sign = uint64_t(1) << (n - 1);
+    return static_cast<int64_t>((value ^ sign) - sign);
+}
+
+LogSeries::LogSeries() : blocks(), count(0), t_held(0), v_last(NAN), prev_ms(0), prev_delta(0), prev_bits(0), prev_lead(0), prev_trail(0),
+                         mutex(), cache(), cache_count(0), cache_min(0), cache_max(0), cache_points(0)
+{
+}
+
+LogSeries::LogSeries(const LogSeries &other) : LogSeries()
+{
+    *this = other;
+}
+
+LogSeries &LogSeries::operator=(const LogSeries &other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+    std::scoped_lock lock(mutex, other.mutex);
+    blocks = other.blocks;
+    count = other.count;
+    t_held = other.t_held;
+    v_last = other.v_last;
+    prev_ms = other.prev_ms;
+    prev_delta = other.prev_delta;
+    prev_bits = other.prev_bits;
+    prev_lead = other.prev_lead;
+    prev_trail = other.prev_trail;
+    cache = SeriesView();
+    cache_count = 0;
+    return *this;
+}
+
+void LogSeries::add(float t, float v)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int64_t ms = std::llround(static_cast<double>(t) * (1000 / tick_ms));
+    float q;
+    bool scaled = tenths(v, q);
+    // A value that is not a whole number of tenths starts a block with plain floats.
+    // Values are encoded the way their block is, tenths in a plain block stay plain.
+    bool start = blocks.empty() || blocks.back().count >= block_points || (blocks.back().scaled && !scaled);
+    uint32_t bits = float_bits((start ? scaled : blocks.back().scaled) ? q : v);
+    if (start)
+    {
+        if (!blocks.empty())
+        {
+            seal(blocks.back());
+        }
+        // The first point of a block is stored as is
+        blocks.emplace_back();
+        SeriesBlock &block = blocks.back();
+        put_bits(block, static_cast<uint64_t>(ms), 64);
+        put_bits(block, bits, 32);
+        block.t_first = t;
+        block.v_min = block.v_max = v;
+        block.scaled = scaled;
+        prev_delta = 0;
+        prev_lead = 33; // No previous meaningful bits window yet
+        prev_trail = 0;
+    }
+    else
+    {
+        SeriesBlock &block = blocks.back();
+        int64_t delta = ms - prev_ms;
+        int64_t dod = delta - prev_delta;
+        if (dod == 0)
+        {
+            put_bits(block, 0, 1);
+        }
+        else if (dod >= -64 && dod <= 63)
+        {
+            put_bits(block, 0x2, 2);
+            put_bits(block, static_cast<uint64_t>(dod), 7);
+        }
+        else if (dod >= -256 && dod <= 255)
+        {
+            put_bits(block, 0x6, 3);
+            put_bits(block, static_cast<uint64_t>(dod), 9);
+        }
+        else if (dod >= -2048 && dod <= 2047)
+        {
+            put_bits(block, 0xE, 4);
+            put_bits(block, static_cast<uint64_t>(dod), 12);
+        }
+        else
+        {
+            put_bits(block, 0xF, 4);
+            put_bits(block, static_cast<uint64_t>(dod), 64);
+        }
+        prev_delta = delta;
+
+        uint32_t x = bits ^ prev_bits;
+        if (x == 0)
+        {
+            put_bits(block, 0, 1);
+        }
+        else
+        {
+            int lead = std::min(leading_zeros(x), 31);
+            int trail = trailing_zeros(x);
+            if (lead >= prev_lead && trail >= prev_trail)
+            {
+                // Fits into the previous window of meaningful bits
+                put_bits(block, 0x2, 2);
+                put_bits(block, x >> prev_trail, 32 - prev_lead - prev_trail);
+            }
+            else
+            {
+                int length = 32 - lead - trail;
+                put_bits(block, 0x3, 2);
+                put_bits(block, static_cast<uint64_t>(lead), 5);
+                put_bits(block, static_cast<uint64_t>(length - 1), 5);
+                put_bits(block, x >> trail, length);
+                prev_lead = lead;
+                prev_trail = trail;
+            }
+        }
+        if (!std::isnan(v))
+        {
+            block.v_min = std::isnan(block.v_min) ? v : std::min(block.v_min, v);
+            block.v_max = std::isnan(block.v_max) ? v : std::max(block.v_max, v);
+        }
+    }
+    SeriesBlock &block = blocks.back();
+    block.count++;
+    block.t_last = t;
+    prev_ms = ms;
+    prev_bits = bits;
+    v_last = v;
+    t_held = t;
+    count++;
+}
+
+void LogSeries::decode_block(const SeriesBlock &block, std::vector<float> &time, std::vector<float> &value)
+{
+    if (block.count == 0)
+    {
+        return;
+    }
+    BitReader in(block);
+    float scale = block.scaled ? 10.0f : 1.0f;
+    float ticks_per_s = 1000 / tick_ms;
+    int64_t ms = static_cast<int64_t>(in.read(64));
+    uint32_t bits = static_cast<uint32_t>(in.read(32));
+    int64_t delta = 0;
+    int lead = 0, trail = 0;
+    time.push_back(ms / ticks_per_s);
+    value.push_back(bits_float(bits) / scale);
+    for (uint32_t i = 1; i < block.count; i++)
+    {
+        int64_t dod = 0;
+        if (in.read(1))
+        {
+            if (!in.read(1))
+            {
+                dod = sign_extend(in.read(7), 7);
+            }
+            else if (!in.read(1))
+            {
+                dod = sign_extend(in.read(9), 9);
+            }
+            else if (!in.read(1))
+            {
+                dod = sign_extend(in.read(12), 12);
+            }
+            else
+            {
+                dod = static_cast<int64_t>(in.read(64));
+            }
+        }
+        delta += dod;
+        ms += delta;
+
+        if (in.read(1))
+        {
+            if (in.read(1))
+            {
+                lead = static_cast<int>(in.read(5));
+                int length = static_cast<int>(in.read(5)) + 1;
+                trail = 32 - lead - length;
+            }
+            bits ^= static_cast<uint32_t>(in.read(32 - lead - trail)) << trail;
+        }
+        time.push_back(ms / ticks_per_s);
+        value.push_back(bits_float(bits) / scale);
+    }
+}
+
+void LogSeries::seal(SeriesBlock &block)
+{
+    // Min/max preview of the block for zoomed out plots
+    std::vector<float> time, value;
+    decode_block(block, time, value);
+    for (size_t start = 0; start < time.size(); start += preview_bucket)
+    {
+        size_t end = std::min(time.size(), start + static_cast<size_t>(preview_bucket));
+        size_t i_min = start, i_max = start;
+        for (size_t i = start; i < end; i++)
+        {
+            if (std::isnan(value[i_min]) || value[i] < value[i_min])
+            {
+                i_min = i;
+            }
+            if (std::isnan(value[i_max]) || value[i] > value[i_max])
+            {
+                i_max = i;
+            }
+        }
+        size_t first = std::min(i_min, i_max), second = std::max(i_min, i_max);
+        block.preview_t.push_back(time[first]);
+        block.preview_v.push_back(value[first]);
+        if (second != first)
+        {
+            block.preview_t.push_back(time[second]);
+            block.preview_v.push_back(value[second]);
+        }
+    }
+    block.bits.shrink_to_fit();
+}
+
+void LogSeries::hold(float t)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    t_held = t;
+}
+
+void LogSeries::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    blocks.clear();
+    count = 0;
+    t_held = 0;
+    v_last = NAN;
+    cache = SeriesView();
+    cache_count = 0;
+}
+
+size_t LogSeries::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return count;
+}
+
+float LogSeries::last_time() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return blocks.empty() ? 0 : blocks.back().t_last;
+}
+
+float LogSeries::last_value() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return v_last;
+}
+
+float LogSeries::held_until() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return t_held;
+}
+
+float LogSeries::max_value() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    float v = NAN;
+    for (const SeriesBlock &block : blocks)
+    {
+        if (!std::isnan(block.v_max))
+        {
+            v = std::isnan(v) ? block.v_max : std::max(v, block.v_max);
+        }
+    }
+    return v;
+}
+
+size_t LogSeries::memory() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t bytes = blocks.capacity() * sizeof(SeriesBlock);
+    for (const SeriesBlock &block : blocks)
+    {
+        bytes += block.bits.capacity() + (block.preview_t.capacity() + block.preview_v.capacity()) * sizeof(float);
+    }
+    return bytes;
+}
+
+void LogSeries::decode(std::vector<float> &time, std::vector<float> &value) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    time.clear();
+    value.clear();
+    time.reserve(count);
+    value.reserve(count);
+    for (const SeriesBlock &block : blocks)
+    {
+        decode_block(block, time, value);
+    }
+}
+
+const SeriesView &LogSeries::window(double t_min, double t_max, size_t max_points) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (cache_count == count && cache_min == t_min && cache_max == t_max && cache_points == max_points)
+    {
+        return cache;
+    }
+    cache_count = count;
+    cache_min = t_min;
+    cache_max = t_max;
+    cache_points = max_points;
+    cache.time.clear();
+    cache.value.clear();
+
+    // Blocks overlapping the window, plus one on each side so lines run to the edges
+    size_t first = 0, last = blocks.size();
+    while (first + 1 < blocks.size() && blocks[first + 1].t_first <= t_min)
+    {
+        first++;
+    }
+    first = first > 0 ? first - 1 : 0;
+    for (size_t i = first; i < blocks.size(); i++)
+    {
+        if (blocks[i].t_first > t_max)
+        {
+            last = std::min(blocks.size(), i + 1);
+            break;
+        }
+    }
+    size_t n = 0;
+    for (size_t i = first; i < last; i++)
+    {
+        n += blocks[i].count;
+    }
+
+    // Too many points for the plot: sealed blocks contribute their min/max preview,
+    // the open block at the end is decoded in full
+    cache.decimated = n > max_points;
+    for (size_t i = first; i < last; i++)
+    {
+        const SeriesBlock &block = blocks[i];
+        if (cache.decimated && !block.preview_t.empty())
+        {
+            cache.time.insert(cache.time.end(), block.preview_t.begin(), block.preview_t.end());
+            cache.value.insert(cache.value.end(), block.preview_v.begin(), block.preview_v.end());
+        }
+        else
+        {
+            decode_block(block, cache.time, cache.value);
+        }
+    }
+    return cache;
+}
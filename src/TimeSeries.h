@@ -0,0 +1,81 @@
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+// Decoded part of a series, e.g. for the plot window
+struct SeriesView
+{
+    std::vector<float> time;
+    std::vector<float> value;
+    bool decimated = false; // Min/max per bucket instead of every point
+};
+
+// Block of a compressed series. Time stamps (in ticks of 10 ms, the resolution of the log file)
+// are stored as delta-of-delta, values as the XOR with the previous value (Gorilla, Pelkonen
+// et al. 2015). Readings at a steady interval and repeated values cost a bit or two each.
+struct SeriesBlock
+{
+    std::vector<uint8_t> bits;
+    bool scaled = false;           // Values are stored in tenths
+    size_t n_bits = 0;
+    uint32_t count = 0;
+    float t_first = 0, t_last = 0;
+    float v_min = 0, v_max = 0;    // Ignoring NaN
+    std::vector<float> preview_t;  // Min and max of every preview bucket, filled when the block is sealed
+    std::vector<float> preview_v;
+};
+
+// Samples of one channel with their own time stamps, compressed in blocks
+class LogSeries
+{
+public:
+    static const uint32_t block_points = 1024;  // Points per block
+    static const uint32_t preview_bucket = 128; // Points per min/max pair of the block preview
+    static constexpr float tick_ms = 10;        // Time resolution
+
+    LogSeries();
+    LogSeries(const LogSeries &other);
+    LogSeries &operator=(const LogSeries &other);
+
+    void add(float t, float v);
+    void hold(float t); // A reading at t was dropped, the last value holds until t
+    void clear();
+    size_t size() const;
+    float last_time() const;
+    float last_value() const;
+    float held_until() const; // Time of the last reading, stored or dropped
+    float max_value() const;  // Largest value, ignoring NaN
+    size_t memory() const;    // Bytes used by the compressed blocks
+
+    // Points between t_min and t_max (plus one on each side), decimated to about max_points.
+    // The result is cached until the series or the window changes; only for one reader thread.
+    const SeriesView &window(double t_min, double t_max, size_t max_points = 8192) const;
+    void decode(std::vector<float> &time, std::vector<float> &value) const; // Every point
+
+private:
+    std::vector<SeriesBlock> blocks;
+    size_t count;
+    float t_held;
+    float v_last;
+    // Encoder state of the last block
+    int64_t prev_ms; // In ticks
+    int64_t prev_delta;
+    uint32_t prev_bits;
+    int prev_lead;
+    int prev_trail;
+
+    mutable std::mutex mutex;
+    mutable SeriesView cache;
+    mutable size_t cache_count;
+    mutable double cache_min, cache_max;
+    mutable size_t cache_points;
+
+    static void decode_block(const SeriesBlock &block, std::vector<float> &time, std::vector<float> &value);
+    static void seal(SeriesBlock &block);
+};
+
+#endif // TIMESERIES_H
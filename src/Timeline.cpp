@@ -1,22 +1,155 @@
 #include "TimeLine.h"
 #include "beeper.h"
+#include "LogSegments.h"
+#include "RunCatalog.h"
+#include "Settling.h"
 #include <cmath>
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+
+const LogChannelInfo logChannelInfo[LOG_CHANNELS] = {
+    {"Speed", "IN_PV_4"},
+    {"T Plate", "IN_PV_2"},
+    {"T Sensor", "IN_PV_1"},
+    {"Viscosity", "IN_PV_5"}};
 
 void LogData::addData(float t, float tp, float ts, float s, float v)
 {
-    time.push_back(t);
-    temperaturePlate.push_back(tp);
-    temperatureSensor.push_back(ts);
-    speed.push_back(s);
-    viscosity.push_back(v);
+    speed.add(t, s);
+    temperaturePlate.add(t, tp);
+    temperatureSensor.add(t, ts);
+    viscosity.add(t, v);
+}
+void LogData::addSample(int channel, float t, float v)
+{
+    this->channel(channel).add(t, v);
+}
+LogSeries &LogData::channel(int channel)
+{
+    switch (channel)
+    {
+    case LOG_SPEED:
+        return speed;
+    case LOG_T_PLATE:
+        return temperaturePlate;
+    case LOG_T_SENSOR:
+        return temperatureSensor;
+    default:
+        return viscosity;
+    }
+}
+void LogData::clear()
+{
+    speed.clear();
+    temperaturePlate.clear();
+    temperatureSensor.clear();
+    viscosity.clear();
 }
-LogData::LogData() : time(), temperaturePlate(), temperatureSensor(), speed(), viscosity()
+bool LogData::empty() const
+{
+    return speed.size() == 0 && temperaturePlate.size() == 0 && temperatureSensor.size() == 0 && viscosity.size() == 0;
+}
+static std::vector<std::string> split_tabs(const std::string &line)
+{
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (start <= line.size())
+    {
+        size_t end = line.find('\t', start);
+        if (end == std::string::npos)
+        {
+            end = line.size();
+        }
+        fields.push_back(line.substr(start, end - start));
+        start = end + 1;
+    }
+    return fields;
+}
+
+static float parse_cell(const std::string &cell)
+{
+    try
+    {
+        return std::stof(cell);
+    }
+    catch (const std::exception &)
+    {
+        return NAN;
+    }
+}
+
+bool LogData::load(const std::string &logFilePath)
+{
+    LogData loaded;
+    std::vector<int> channels; // Channel of every value column, -1 if unknown
+    bool legacy = false;       // Files before per-channel intervals have one time column
+    bool header = false;
+    bool in_data = false;
+    bool found = LogSegments::read(logFilePath, [&](const std::string &line)
+                                   {
+        if (line.rfind("TimeLine: ", 0) == 0)
+        {
+            loaded.clear();
+            in_data = false;
+            return;
+        }
+        if (line == "LOGDATA")
+        {
+            header = true;
+            return;
+        }
+        if (header)
+        {
+            std::vector<std::string> names = split_tabs(line);
+            legacy = !names.empty() && names[0] == "Time";
+            channels.clear();
+            for (size_t i = legacy ? 1 : 0; i < names.size(); i += legacy ? 1 : 2)
+            {
+                const std::string &name = legacy ? names[i] : (i + 1 < names.size() ? names[i + 1] : "");
+                int channel = -1;
+                for (int c = 0; c < LOG_CHANNELS; c++)
+                {
+                    if (name == logChannelInfo[c].name)
+                    {
+                        channel = c;
+                    }
+                }
+                channels.push_back(channel);
+            }
+            header = false;
+            in_data = true;
+            return;
+        }
+        if (line.empty())
+        {
+            in_data = false;
+            return;
+        }
+        if (!in_data || line[0] == '#')
+        {
+            return;
+        }
+        std::vector<std::string> cells = split_tabs(line);
+        for (size_t k = 0; k < channels.size(); k++)
+        {
+            size_t t_col = legacy ? 0 : 2 * k;
+            size_t v_col = legacy ? k + 1 : 2 * k + 1;
+            if (channels[k] < 0 || v_col >= cells.size() || cells[t_col].empty())
+            {
+                continue;
+            }
+            loaded.addSample(channels[k], parse_cell(cells[t_col]), parse_cell(cells[v_col]));
+        } });
+    if (found)
+    {
+        *this = loaded;
+    }
+    return found;
+}
+
+LogData::LogData() : temperaturePlate(), temperatureSensor(), speed(), viscosity()
 {
-    time.reserve(256);
-    temperaturePlate.reserve(256);
-    temperatureSensor.reserve(256);
-    speed.reserve(256);
-    viscosity.reserve(256);
 }
 TimeLine::~TimeLine()
 {
@@ -32,6 +165,49 @@ void TimeLine::addSection(const Section &section)
     sections.push_back(section);
 }
 
+void TimeLine::removeSection(size_t index)
+{
+    if (index >= sections.size())
+    {
+        return;
+    }
+    sections.erase(sections.begin() + index);
+    // A block of only the removed section goes with it, the others move up or get shorter
+    std::vector<RepeatBlock> kept;
+    for (RepeatBlock block : repeats)
+    {
+        if (block.first == index && block.last == index)
+        {
+            continue;
+        }
+        block.first -= block.first > index;
+        block.last -= block.last >= index;
+        kept.push_back(block);
+    }
+    repeats.swap(kept);
+}
+
+bool TimeLine::logs(int channel) const
+{
+    switch (channel)
+    {
+    case LOG_SPEED:
+        return logSpeed;
+    case LOG_T_PLATE:
+        return logTemperaturePlate;
+    case LOG_T_SENSOR:
+        return logTemperatureSensor;
+    case LOG_VISCOSITY:
+        return logViscosity;
+    }
+    return false;
+}
+
+bool TimeLine::logging() const
+{
+    return (logTemperaturePlate || logSpeed || logViscosity || logTemperatureSensor) && logFilePath != "";
+}
+
 void Section::sound_beep()
 {
     if (timeline->current_section == timeline->sections.size() - 1)
@@ -46,41 +222,220 @@ void Section::sound_beep()
     }
 }
 
-void TimeLine::execute()
+bool TimeLine::execute(std::string *error)
 {
+    // Everything is compiled and checked before the device is touched
+    std::string problem;
+    std::shared_ptr<const ExecutionPlan> compiled = ExecutionPlan::compile(*this, problem);
+    if (!compiled)
+    {
+        if (error != nullptr)
+        {
+            *error = problem;
+        }
+        return false;
+    }
+    plan = compiled;
     b_stop = false;
     current_section = 0;
+    repeat_passes.assign(plan->repeats.size(), 0);
+    // The worker thread only queues log records, the file is written by the log writer thread
+    log_writer = logFilePath.empty() ? nullptr : std::make_shared<LogWriter>(logFilePath, logFlush, logRotation);
+    RunRecord run{};
+    run.timeline = name;
+    run.timeline_hash = fingerprint();
+    run.timeline_file = filePath;
+    run.device = rct->get_device();
+    run.start = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    run.log = logFilePath;
+    run_id = RunCatalog::instance().begin(run);
     communication_thread = new std::thread([this]
                                            { execute_thread(); });
     running = true;
+    return true;
 }
 
 void TimeLine::execute_thread()
 {
-    int idx = -1;
+    int64_t t_run = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
     if (!logFilePath.empty())
     {
         std::chrono::time_point<std::chrono::system_clock> current_date_time = std::chrono::system_clock::now();
         std::time_t time = std::chrono::system_clock::to_time_t(current_date_time);
-        std::ofstream logFile;
-        logFile.open(logFilePath, std::ios::app);
-        logFile << "TimeLine: " << name << std::endl;
-        logFile << "Start time: " << std::ctime(&time) << std::endl;
-        logFile << std::endl
-                << std::endl;
-        logFile.close();
+        log_writer->marker(LogMarker::RunStart, 0, name);
+        log_writer->text("TimeLine: " + name);
+        log_writer->text("Start time: " + std::string(std::ctime(&time)) + "\n\n");
     }
     t_start = std::chrono::steady_clock::now();
-    for (Section &section : sections)
+    // Stagger the first reading of each channel, so their reads interleave instead of bunching up
+    size_t n_logged = 0;
+    for (int c = 0; c < LOG_CHANNELS; c++)
     {
-        current_section = ++idx;
-        section.execute_section();
+        n_logged += logs(c);
     }
+    size_t k = 0;
+    for (int c = 0; c < LOG_CHANNELS; c++)
+    {
+        float offset = logs(c) ? logIntervals[c] * k++ / n_logged : 0;
+        t_next_log[c] = t_start + std::chrono::microseconds(static_cast<int64_t>(offset * 1e6));
+        log_state[c] = LogChannelState{NAN, 0, NAN, -1, false};
+    }
+    // Repeat blocks jump back when their last section ends, the sections themselves exist once
+    std::vector<uint32_t> iterations(plan->repeats.size(), 0);
+    done_ms = 0;
+    for (size_t i = 0; i < plan->sections.size() && !b_stop;)
+    {
+        t_section = std::chrono::steady_clock::now();
+        current_section = i;
+        for (size_t r = 0; r < plan->repeats.size(); r++)
+        {
+            bool inside = plan->repeats[r].first <= i && i <= plan->repeats[r].last;
+            repeat_passes[r] = inside ? iterations[r] + 1 : 0;
+        }
+        sections[i].execute_section(*plan, plan->sections[i]);
+        done_ms += plan->sections[i].duration_ms;
+        int32_t r = -1;
+        size_t next = plan->next_section(i, iterations, r);
+        if (r >= 0 && log_writer && !b_stop)
+        {
+            log_writer->text("Repeat " + std::to_string(iterations[r] + 1) + " of " + std::to_string(plan->repeats[r].count) + ": sections " +
+                             std::to_string(plan->repeats[r].first + 1) + " - " + std::to_string(plan->repeats[r].last + 1));
+        }
+        i = next;
+    }
+    flush_log();
     rct->send_signal("STOP_1");
     rct->send_signal("STOP_4");
+    std::vector<std::string> files;
+    if (log_writer)
+    {
+        log_writer->close();
+        // The plain log and the segments written since the run started
+        if (!logRotation.enabled() && std::filesystem::exists(logFilePath))
+        {
+            files.push_back(std::filesystem::path(logFilePath).filename().string());
+        }
+        for (const LogSegment &segment : LogSegments::load_index(logFilePath))
+        {
+            if (segment.t_end >= t_run)
+            {
+                files.push_back(segment.file);
+            }
+        }
+    }
+    RunCatalog::instance().finish(run_id, b_stop ? RunOutcome::Stopped : RunOutcome::Completed, files);
     running = false;
 }
 
+uint8_t TimeLine::log_columns() const
+{
+    static_assert(LOG_CHANNELS <= LOG_MAX_COLUMNS, "Log rows hold LOG_MAX_COLUMNS channels");
+    uint8_t columns = 0;
+    for (int c = 0; c < LOG_CHANNELS; c++)
+    {
+        columns |= logs(c) << c;
+    }
+    return columns;
+}
+
+uint64_t TimeLine::fingerprint() const
+{
+    uint64_t h = RunCatalog::hash(nullptr, 0);
+    auto add = [&h](const void *data, size_t size)
+    {
+        h = RunCatalog::hash(data, size, h);
+    };
+    auto add_text = [&add](const std::string &text)
+    {
+        add(text.c_str(), text.size() + 1);
+    };
+    for (const Section &section : sections)
+    {
+        add(&section.duration, sizeof(section.duration));
+        add(section.temperature, sizeof(section.temperature));
+        add(section.speed, sizeof(section.speed));
+        add(&section.wait_user, sizeof(section.wait_user));
+        add(&section.wait_value, sizeof(section.wait_value));
+        for (const std::string &command : section.preSectionCommands)
+        {
+            add_text(command);
+        }
+        add_text("|");
+        for (const std::string &command : section.postSectionCommands)
+        {
+            add_text(command);
+        }
+        add_text("|");
+        // Only sections with a profile hash it, fingerprints of earlier runs stay the same
+        if (!section.temperatureProfile.empty() || !section.speedProfile.empty())
+        {
+            add_text(section.temperatureProfile);
+            add_text(section.speedProfile);
+        }
+        if (!section.profileFile.empty())
+        {
+            add_text(section.profileFile);
+        }
+        if (!section.triggers.empty())
+        {
+            add_text(TriggerSet::to_text(section.triggers));
+        }
+        if (section.wait_value && (section.settleBand[0] != settleDefaultBand[0] || section.settleBand[1] != settleDefaultBand[1] || section.settleHold != settleDefaultHold))
+        {
+            add(section.settleBand, sizeof(section.settleBand));
+            add(&section.settleHold, sizeof(section.settleHold));
+        }
+    }
+    // Only timelines with repeats hash them, fingerprints of earlier runs stay the same
+    if (!repeats.empty())
+    {
+        add(repeats.data(), repeats.size() * sizeof(RepeatBlock));
+    }
+    uint8_t columns = log_columns();
+    add(&columns, sizeof(columns));
+    add(logIntervals, sizeof(logIntervals));
+    return h;
+}
+
+double TimeLine::remaining(float &fraction) const
+{
+    fraction = 0;
+    if (!plan || plan->total_ms == 0 || current_section >= plan->sections.size())
+    {
+        return 0;
+    }
+    // Waits are open ended, the current section counts as done while it waits
+    const PlanSection &planned = plan->sections[current_section];
+    double in_section = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_section).count();
+    double done = done_ms / 1000.0 + std::min(std::max(in_section, 0.0), planned.duration_ms / 1000.0);
+    double total = plan->total_ms / 1000.0;
+    fraction = static_cast<float>(done / total);
+    return total - done;
+}
+
+void TimeLine::flush_log()
+{
+    if (!adaptiveLogging || !logging())
+    {
+        return;
+    }
+    // Store the last reading of every channel, so the held values end where the run ended
+    for (int c = 0; c < LOG_CHANNELS; c++)
+    {
+        LogChannelState &state = log_state[c];
+        if (logs(c) && state.t_dropped >= 0)
+        {
+            float t[LOG_MAX_COLUMNS] = {};
+            float value[LOG_MAX_COLUMNS] = {};
+            t[c] = state.t_dropped;
+            value[c] = state.previous;
+            log_writer->row(log_columns(), 1 << c, t, value);
+            logData.addSample(c, state.t_dropped, state.previous);
+            state.t_dropped = -1;
+        }
+    }
+}
+
 void TimeLine::stop()
 {
     b_stop = true;
@@ -92,259 +447,372 @@ void TimeLine::stop()
     }
     running = false;
 }
-void Section::compile_section()
+double Section::set_value_rate() const
 {
-    // determine if ramping is needed
-    bool b_ramp = temperature[0] != temperature[1] || speed[0] != speed[1];
-    // Value set interval in milliseconds
-    interval = b_ramp ? 100 : duration * 1000;
-    // Compute amount of steps
-    size_t steps = b_ramp ? (duration * 1000) / 100 : 2;
-    if (steps > 2048)
-    {
-        steps = 2048;
-        interval = duration * 1000 / steps;
-    }
-    // Resize vectors for temperatures and speeds
-    temperatures.resize(steps);
-    speeds.resize(steps);
-    // Compute step size for temperature and speed
-    float temperature_step = static_cast<float>(temperature[1] - temperature[0]) / static_cast<float>(steps - 1);
-    float speed_step = static_cast<float>(speed[1] - speed[0]) / static_cast<float>(steps - 1);
-    // Fill vectors with values
-    for (size_t i = 0; i < steps; i++)
-    {
-        temperatures[i] = static_cast<float>(temperature[0]) + i * temperature_step;
-        speeds[i] = static_cast<float>(speed[0]) + i * speed_step;
+    if (duration == 0)
+    {
+        return 0;
     }
+    // Every channel is sent when its rounded value changes, at most every 100 ms, plus once at the start.
+    // A profile is assumed to change on every step.
+    bool file = !profileFile.empty();
+    double temperature_rate = temperatureProfile.empty() && !file ? std::min(10.0, std::abs(temperature[1] - temperature[0]) / static_cast<double>(duration)) : 10.0;
+    double speed_rate = speedProfile.empty() && !file ? std::min(10.0, std::abs(speed[1] - speed[0]) / static_cast<double>(duration)) : 10.0;
+    return temperature_rate + speed_rate + 2.0 / duration;
 }
-void Section::handle_logging(std::ofstream &logFile, size_t ms_passed, std::chrono::time_point<std::chrono::steady_clock> &t_last_log)
+void Section::read_triggers(TriggerSet &triggers)
 {
-    logFile.open(timeline->logFilePath, std::ios::app);
-    logFile << ftos(static_cast<float>(ms_passed) / 1000, 2) << "\t";
-    timeline->logData.time.push_back(static_cast<float>(ms_passed) / 1000);
-    if (timeline->logSpeed)
-    {
-        timeline->rct->send_signal("IN_PV_4");
-        std::string response = timeline->rct->get_response();
-        logFile << response << "\t";
-        timeline->logData.speed.push_back(std::stof(response));
-    }
-    if (timeline->logTemperaturePlate)
-    {
-        timeline->rct->send_signal("IN_PV_2");
-        std::string response = timeline->rct->get_response();
-        logFile << response << "\t";
-        timeline->logData.temperaturePlate.push_back(std::stof(response));
-    }
-    if (timeline->logTemperatureSensor)
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - timeline->t_start).count();
+    for (int c = 0; c < LOG_CHANNELS && triggers.fired < 0; c++)
     {
-        timeline->rct->send_signal("IN_PV_1");
-        std::string response = timeline->rct->get_response();
-        logFile << response << "\t";
-        timeline->logData.temperatureSensor.push_back(std::stof(response));
-    }
-    if (timeline->logViscosity)
-    {
-        timeline->rct->send_signal("IN_PV_5");
-        std::string response = timeline->rct->get_response();
-        logFile << response << "\t";
-        timeline->logData.viscosity.push_back(std::stof(response));
+        if (triggers.uses(c) && (triggers.t_read[c] < 0 || t - triggers.t_read[c] >= triggerReadInterval))
+        {
+            float value = RCT_5_Control::parse_numeric(timeline->rct->send_signal(logChannelInfo[c].command));
+            auto t_now = std::chrono::steady_clock::now();
+            triggers.update(c, std::chrono::duration<double>(t_now - timeline->t_start).count(), value);
+            timeline->section_stats.add(c, std::chrono::duration<double>(t_now - timeline->t_section).count(), value);
+        }
     }
-    logFile << std::endl;
-    logFile.close();
-    t_last_log = std::chrono::steady_clock::now();
 }
 
-void Section::execute_section()
+void Section::handle_logging(bool ramping, TriggerSet *triggers)
 {
-    compile_section();
-    bool b_log = (timeline->logTemperaturePlate || timeline->logSpeed || timeline->logViscosity || timeline->logTemperatureSensor) && timeline->logFilePath != "";
-    std::ofstream logFile;
-    if (b_log)
+    // Read only the channels that are due, each one runs on its own interval
+    auto t_now = std::chrono::steady_clock::now();
+    bool due[LOG_CHANNELS];
+    bool any_due = false;
+    for (int c = 0; c < LOG_CHANNELS; c++)
+    {
+        due[c] = timeline->logs(c) && t_now >= timeline->t_next_log[c];
+        any_due = any_due || due[c];
+    }
+    if (!any_due)
     {
-        logFile.open(timeline->logFilePath, std::ios::app);
-        logFile << "Section: " << name << std::endl;
-        logFile << "Duration: " << duration << " s" << std::endl;
-        logFile << "Temperature: " << temperature[0] << " -> " << temperature[1] << " °C" << std::endl;
-        logFile << "Speed: " << speed[0] << " -> " << speed[1] << " RPM" << std::endl;
-        logFile << std::endl;
+        return;
     }
 
-    if (preSectionCommands.size() > 0)
+    // Readings of this pass, plus the dropped readings that end a held value.
+    // Every channel has its own time column, so the held readings of all channels fit into one row.
+    float t_row[LOG_MAX_COLUMNS] = {}, v_row[LOG_MAX_COLUMNS] = {};
+    float t_held[LOG_MAX_COLUMNS] = {}, v_held[LOG_MAX_COLUMNS] = {};
+    uint8_t stored = 0, held = 0;
+    for (int c = 0; c < LOG_CHANNELS; c++)
     {
-        if (b_log)
+        if (!due[c])
         {
-            logFile << "Pre-section commands:" << std::endl;
+            continue;
         }
-        for (const std::string &command : preSectionCommands)
+        // Failed reads are stored as NaN, which leaves a visible gap in log and plot
+        float value = RCT_5_Control::parse_numeric(timeline->rct->send_signal(logChannelInfo[c].command));
+        float t = std::chrono::duration<float>(std::chrono::steady_clock::now() - timeline->t_start).count();
+        if (triggers != nullptr)
         {
-            timeline->rct->send_signal(command);
-            if (b_log)
+            triggers->update(c, t, value);
+        }
+        timeline->section_stats.add(c, std::chrono::duration<double>(std::chrono::steady_clock::now() - timeline->t_section).count(), value);
+        LogSeries &series = timeline->logData.channel(c);
+        LogChannelState &state = timeline->log_state[c];
+        float deadband = timeline->logDeadband[c];
+
+        bool store = true;
+        bool transient = false;
+        if (timeline->adaptiveLogging)
+        {
+            // Readings within the deadband of the stored value are dropped, the stored value holds.
+            // A change of the NaN state is always stored, as is a reading after logMaxGap.
+            bool nan_changed = std::isnan(value) != std::isnan(state.stored);
+            store = !state.has_stored || nan_changed || std::abs(value - state.stored) > deadband || t - state.t_stored >= timeline->logMaxGap;
+            transient = ramping || timeline->adjusting || std::abs(value - state.previous) > deadband;
+            // The last dropped reading marks where the held value ended, store it before the step
+            if (store && state.t_dropped >= 0 && state.has_stored && !nan_changed && std::abs(value - state.stored) > deadband)
             {
-                logFile << command << "\t" << timeline->rct->get_response() << std::endl;
+                t_held[c] = state.t_dropped;
+                v_held[c] = state.previous;
+                held |= 1 << c;
+                series.add(state.t_dropped, state.previous);
             }
+            state.previous = value;
+        }
+        if (store)
+        {
+            t_row[c] = t;
+            v_row[c] = value;
+            stored |= 1 << c;
+            series.add(t, value);
+            state.stored = value;
+            state.t_stored = t;
+            state.t_dropped = -1;
+            state.has_stored = true;
+        }
+        else
+        {
+            series.hold(t);
+            state.t_dropped = t;
+        }
+
+        // Fixed rate schedule, readings missed while the line was busy are skipped
+        float interval = transient ? timeline->logIntervals[c] / std::max(1.0f, timeline->logBoost) : timeline->logIntervals[c];
+        auto period = std::chrono::microseconds(static_cast<int64_t>(std::max(0.1f, interval) * 1e6));
+        while (timeline->t_next_log[c] <= t_now)
+        {
+            timeline->t_next_log[c] += period;
         }
     }
-    // Start the heater and motor if needed
-    if (temperature[0] != 0 || temperature[0] != 0)
+
+    // Connection drops, retries and reconnects since the last row
+    for (const std::string &event : timeline->rct->drain_link_events())
     {
-        timeline->rct->send_signal("START_1");
+        timeline->log_writer->event(event);
     }
-    if (speed[0] != 0 || speed[0] != 0)
+    uint8_t columns = timeline->log_columns();
+    if (held)
     {
-        timeline->rct->send_signal("START_4");
+        timeline->log_writer->row(columns, held, t_held, v_held);
     }
-    // Write header for log file numeric data
+    if (stored)
+    {
+        timeline->log_writer->row(columns, stored, t_row, v_row);
+    }
+}
+
+void Section::send_commands(const ExecutionPlan &plan, const PlanSection &planned, size_t &action, PlanOp op, const char *title)
+{
+    bool b_log = timeline->logging();
+    for (bool first = true; action < planned.end && plan.actions[action].op == op; action++, first = false)
+    {
+        if (b_log && first)
+        {
+            timeline->log_writer->text(title);
+        }
+        const std::string &command = plan.commands[plan.actions[action].arg];
+        std::string response = timeline->rct->send_signal(command);
+        if (b_log)
+        {
+            timeline->log_writer->text(command + "\t" + response);
+        }
+    }
+}
+
+void Section::execute_section(const ExecutionPlan &plan, const PlanSection &planned)
+{
+    bool b_log = timeline->logging();
+    LogWriter *logWriter = timeline->log_writer.get();
+    size_t action = planned.first + 1; // After PlanOp::SectionStart
     if (b_log)
     {
-        logFile << std::endl
-                << "LOGDATA" << std::endl;
-        logFile << "Time\t";
-        if (timeline->logSpeed)
+        logWriter->marker(LogMarker::SectionStart, static_cast<int32_t>(timeline->current_section), name);
+        std::ostringstream header;
+        header << "Section: " << name << std::endl;
+        header << "Duration: " << duration << " s" << std::endl;
+        header << "Temperature: " << temperature[0] << " -> " << temperature[1] << " °C" << std::endl;
+        header << "Speed: " << speed[0] << " -> " << speed[1] << " RPM" << std::endl;
+        logWriter->text(header.str());
+    }
+    send_commands(plan, planned, action, PlanOp::Command, "Pre-section commands:");
+    // Start the heater and motor if needed
+    if (plan.actions[action].op == PlanOp::Start)
+    {
+        if (plan.actions[action].arg & 1)
         {
-            logFile << "Speed\t";
+            timeline->rct->send_signal("START_1");
         }
-        if (timeline->logTemperaturePlate)
+        if (plan.actions[action].arg & 2)
         {
-            logFile << "T Plate\t";
+            timeline->rct->send_signal("START_4");
         }
-        if (timeline->logTemperatureSensor)
+        action++;
+    }
+    // Write header for log file numeric data
+    if (b_log)
+    {
+        logWriter->text("");
+        if (timeline->adaptiveLogging)
         {
-            logFile << "T Sensor\t";
+            logWriter->text("# Adaptive sampling: an empty cell holds the last value of its channel");
         }
-        if (timeline->logViscosity)
+        logWriter->text("LOGDATA");
+        // Every channel has its own time column, channels that were not due are left empty
+        std::string columns;
+        for (int c = 0; c < LOG_CHANNELS; c++)
         {
-            logFile << "Viscosity\t";
+            if (timeline->logs(c))
+            {
+                columns += "Time " + std::string(logChannelInfo[c].name) + "\t" + logChannelInfo[c].name + "\t";
+            }
         }
-        logFile << std::endl;
-        logFile.close();
+        logWriter->text(columns);
     }
 
-    std::chrono::time_point<std::chrono::steady_clock> t_now;
-    std::chrono::time_point<std::chrono::steady_clock> t_last_interval;
-    std::chrono::time_point<std::chrono::steady_clock> t_last_log;
+    // Set values are computed from the ramp at the elapsed time, on a 100 ms grid from the section
+    // start. A value is sent when its rounded value changes, the last one exactly at the end.
     std::chrono::time_point<std::chrono::steady_clock> t_start_section = std::chrono::steady_clock::now();
-    size_t ms_duration = duration * 1000;
-    size_t logInterval_ms = timeline->logInterval * 1000;
-    size_t ms_passed = 0;
-    size_t ms_passed_interval = 0;
-    size_t ms_passed_log = 0;
-    size_t ms_passed_section = 0;
-    size_t step = 0;
-
-    while ((ms_passed_section < ms_duration || step < temperatures.size()) && !timeline->b_stop)
+    timeline->t_section = t_start_section;
+    timeline->section_stats.reset(planned.end_temperature, planned.end_speed, planned.settle_band);
+    bool b_ramp = temperature[0] != temperature[1] || speed[0] != speed[1] || planned.profile >= 0;
+    size_t point = action;
+    while (plan.actions[action].op == PlanOp::Setpoint)
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
-        t_now = std::chrono::steady_clock::now();
-        ms_passed = std::chrono::duration_cast<std::chrono::milliseconds>(t_now - timeline->t_start).count();
-        ms_passed_interval = std::chrono::duration_cast<std::chrono::milliseconds>(t_now - t_last_interval).count();
-        ms_passed_section = std::chrono::duration_cast<std::chrono::milliseconds>(t_now - t_start_section).count();
-        if (step == 0 || ms_passed_interval >= interval)
+        action++;
+    }
+    uint32_t t_end = plan.actions[action].t_ms; // PlanOp::SectionEnd
+    // A profile file is streamed while the section runs, it was checked when the plan was compiled
+    ProfileReader reader;
+    ProfileReader *profile_reader = nullptr;
+    if (planned.profile >= 0 && !plan.profiles[planned.profile].file.empty())
+    {
+        if (reader.open(plan.profiles[planned.profile].file))
         {
-            timeline->rct->send_signal("OUT_SP_1 " + std::to_string(std::round(temperatures[step])));
-            timeline->rct->send_signal("OUT_SP_4 " + std::to_string(std::round(speeds[step])));
-            step++;
-            t_last_interval = std::chrono::steady_clock::now();
+            profile_reader = &reader;
         }
-
-        ms_passed_log = std::chrono::duration_cast<std::chrono::milliseconds>(t_now - t_last_log).count();
-        if (b_log && ms_passed_log >= logInterval_ms)
+        else if (b_log)
         {
-            handle_logging(logFile, ms_passed, t_last_log);
+            logWriter->event(reader.error + ", the section runs the ramp");
         }
     }
-    
-    if (!timeline->b_stop)
+    int64_t tick = -1;
+    float sent_temperature = NAN, sent_speed = NAN;
+    // Triggers see every reading of the log, channels the log reads less often are read for them
+    TriggerSet triggers;
+    triggers.reset(plan.triggers.data() + planned.trigger_first, plan.triggers.data() + planned.trigger_end);
+    bool b_triggers = planned.trigger_end > planned.trigger_first;
+    while (!timeline->b_stop)
     {
-        if (postSectionCommands.size() > 0)
+        auto ms_passed_section = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t_start_section).count();
+        bool end = ms_passed_section >= t_end;
+        if (end || ms_passed_section / 100 != tick)
         {
-            if (b_log)
+            tick = ms_passed_section / 100;
+            float set_temperature, set_speed;
+            plan.set_values(planned, point, end ? t_end : static_cast<uint32_t>(tick * 100), set_temperature, set_speed, profile_reader);
+            set_temperature = std::round(set_temperature);
+            set_speed = std::round(set_speed);
+            timeline->section_stats.set_values(set_temperature, set_speed);
+            // Posted: a value the device could not take in time is superseded by the next one
+            if (set_temperature != sent_temperature)
             {
-                logFile.open(timeline->logFilePath, std::ios::app);
-                logFile << std::endl
-                        << "Post-section commands:" << std::endl;
+                timeline->rct->post_signal("OUT_SP_1 " + std::to_string(set_temperature));
+                sent_temperature = set_temperature;
             }
-            for (const std::string &command : postSectionCommands)
+            if (set_speed != sent_speed)
             {
-                timeline->rct->send_signal(command);
-                if (b_log)
-                {
-                    logFile << command << "\t" << timeline->rct->get_response() << std::endl;
-                }
+                timeline->rct->post_signal("OUT_SP_4 " + std::to_string(set_speed));
+                sent_speed = set_speed;
             }
+        }
+        if (end)
+        {
+            action++;
+            break;
+        }
+        if (b_log)
+        {
+            handle_logging(b_ramp, b_triggers ? &triggers : nullptr);
+        }
+        if (b_triggers)
+        {
+            read_triggers(triggers);
+        }
+        if (triggers.fired >= 0)
+        {
             if (b_log)
             {
-                logFile.close();
+                logWriter->text("Trigger: " + TriggerSet::describe(plan.triggers[planned.trigger_first + triggers.fired]) + " after " +
+                                std::to_string(ms_passed_section / 1000) + " s");
             }
+            action++; // The timed part ends here, the set values stay where they are
+            break;
         }
-        if (b_beep && wait_user && !wait_value)
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    if (!timeline->b_stop)
+    {
+        send_commands(plan, planned, action, PlanOp::PostCommand, "\nPost-section commands:");
+        const PlanAction *wait = action < planned.end && plan.actions[action].op == PlanOp::Wait ? &plan.actions[action] : nullptr;
+        bool wait_for_user = wait != nullptr && (wait->arg & 1);
+        bool wait_for_value = wait != nullptr && (wait->arg & 2);
+        if (b_beep && wait_for_user && !wait_for_value)
         {
             sound_beep();
         }
-        if ((wait_user || wait_value) && !timeline->b_stop)
+        if (wait != nullptr && !timeline->b_stop)
         {
             timeline->waiting = true;
-            static bool adjustment_flag = true;
+            // Single readings are noisy, the values count as reached once they stay within the band for the hold time
+            SettlingDetector settle[2];
+            settle[0].reset(wait->temperature, planned.settle_band[0], planned.settle_hold);
+            settle[1].reset(wait->speed, planned.settle_band[1], planned.settle_hold);
+            timeline->settle_eta = -1;
+            bool beeped = false;
             while (timeline->waiting)
             {
-                t_now = std::chrono::steady_clock::now();
-                ms_passed = std::chrono::duration_cast<std::chrono::milliseconds>(t_now - timeline->t_start).count();
-                ms_passed_log = std::chrono::duration_cast<std::chrono::milliseconds>(t_now - t_last_log).count();
-                if (b_log && ms_passed_log >= logInterval_ms)
+                if (b_log)
                 {
-                    handle_logging(logFile, ms_passed, t_last_log);
+                    handle_logging(false);
                 }
-                if (wait_value)
+                if (wait_for_value)
                 {
                     // Read from external sensor first. It returns 0 if no sensor is connected
-                    timeline->rct->send_signal("IN_PV_1");
-                    float T_value = timeline->rct->get_numeric_value();
-                    float T_dif = std::abs(T_value - temperature[1]);
+                    float T_value = RCT_5_Control::parse_numeric(timeline->rct->send_signal("IN_PV_1"));
                     // If Difference is as large as set temperature means the sensor value is 0
                     // ->  read from plate sensor
-                    if (std::abs(T_dif - temperature[1]) < 0.1)
+                    int T_channel = LOG_T_SENSOR;
+                    if (std::abs(std::abs(T_value - wait->temperature) - wait->temperature) < 0.1)
                     {
-                        timeline->rct->send_signal("IN_PV_2");
-                        T_value = timeline->rct->get_numeric_value();
-                        T_dif = std::abs(T_value - temperature[1]);
+                        T_value = RCT_5_Control::parse_numeric(timeline->rct->send_signal("IN_PV_2"));
+                        T_channel = LOG_T_PLATE;
                     }
-                    bool T_diff_ok = T_dif < 0.1;
-                    timeline->rct->send_signal("IN_PV_4");
-                    float S_value = timeline->rct->get_numeric_value();
-                    bool S_diff_ok = std::abs(S_value - speed[1]) < 0.1;
-                    if (!T_diff_ok || !S_diff_ok)
+                    float S_value = RCT_5_Control::parse_numeric(timeline->rct->send_signal("IN_PV_4"));
+                    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - timeline->t_start).count();
+                    double t_in_section = std::chrono::duration<double>(std::chrono::steady_clock::now() - timeline->t_section).count();
+                    // Logged channels already reach the statistics through handle_logging()
+                    if (!(b_log && timeline->logs(T_channel)))
+                    {
+                        timeline->section_stats.add(T_channel, t_in_section, T_value);
+                    }
+                    if (!(b_log && timeline->logs(LOG_SPEED)))
+                    {
+                        timeline->section_stats.add(LOG_SPEED, t_in_section, S_value);
+                    }
+                    settle[0].add(t, T_value);
+                    settle[1].add(t, S_value);
+                    double eta[2] = {settle[0].eta(), settle[1].eta()};
+                    timeline->settle_eta = eta[0] >= 0 && eta[1] >= 0 ? std::max(eta[0], eta[1]) : -1;
+                    timeline->settle_mean[0] = static_cast<float>(settle[0].mean());
+                    timeline->settle_mean[1] = static_cast<float>(settle[1].mean());
+                    if (!settle[0].settled() || !settle[1].settled())
                     {
                         timeline->adjusting = true;
                     }
                     else
                     {
                         timeline->adjusting = false;
-                        if (!wait_user)
+                        if (!wait_for_user)
                         {
                             timeline->waiting = false;
                         }
-                        if (adjustment_flag)
+                        if (!beeped)
                         {
                             sound_beep();
-                            adjustment_flag = false;
+                            beeped = true;
                         }
                     }
                 }
                 std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                duration += 0.1;
             }
         }
-        if (b_beep && !wait_user && !timeline->b_stop && !wait_value)
+        if (b_beep && !wait_for_user && !timeline->b_stop && !wait_for_value)
         {
             sound_beep();
         }
     }
     if (b_log)
     {
-        logFile.open(timeline->logFilePath, std::ios::app);
-        logFile << std::endl
-                << std::endl;
-        logFile.close();
+        for (const std::string &event : timeline->rct->drain_link_events())
+        {
+            logWriter->event(event);
+        }
+        logWriter->text(timeline->section_stats.summary());
+        logWriter->text("\n");
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,262 @@
+#include "TimelineFile.h"
+#include "LogJournal.h"
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile() : error(), base(nullptr), length(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) {}
+#else
+MappedFile::MappedFile() : error(), base(nullptr), length(0) {}
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+    error.clear();
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER file_size;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size))
+    {
+        error = "Could not open " + path;
+        close();
+        return false;
+    }
+    length = static_cast<size_t>(file_size.QuadPart);
+    if (length > 0)
+    {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        base = mapping ? static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+        if (base == nullptr)
+        {
+            error = "Could not map " + path;
+            close();
+            return false;
+        }
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        error = "Could not open " + path + ": " + std::strerror(errno);
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        return false;
+    }
+    length = static_cast<size_t>(st.st_size);
+    if (length > 0)
+    {
+        void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            error = "Could not map " + path + ": " + std::strerror(errno);
+            length = 0;
+            ::close(fd);
+            return false;
+        }
+        base = static_cast<const char *>(p);
+    }
+    ::close(fd); // The mapping stays valid
+#endif
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (base != nullptr)
+    {
+        UnmapViewOfFile(base);
+    }
+    if (mapping != nullptr)
+    {
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file);
+    }
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (base != nullptr)
+    {
+        munmap(const_cast<char *>(base), length);
+    }
+#endif
+    base = nullptr;
+    length = 0;
+}
+
+bool TimelineView::is_tml(const char *data, size_t size)
+{
+    return size >= sizeof(tmlMagic) && std::memcmp(data, tmlMagic, sizeof(tmlMagic)) == 0;
+}
+
+static bool in_bounds(uint64_t offset, uint64_t length, uint64_t size)
+{
+    return offset <= size && length <= size - offset;
+}
+
+bool TimelineView::open(const std::string &path)
+{
+    error.clear();
+    if (!file.open(path))
+    {
+        error = file.error;
+        return false;
+    }
+    const char *data = file.data();
+    size_t size = file.size();
+    if (!is_tml(data, size) || size < sizeof(TmlHeader))
+    {
+        error = "Not a timeline file";
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.byte_order != tmlByteOrder)
+    {
+        error = "Timeline file of a different byte order";
+        return false;
+    }
+    if (header.version > tmlVersion)
+    {
+        error = "Timeline file version " + std::to_string(header.version) + " is from a newer release";
+        return false;
+    }
+    if (header.version < tmlMinVersion || header.header_size < sizeof(TmlHeader) || header.section_size < tmlSectionMinSize)
+    {
+        error = "Unsupported timeline file version " + std::to_string(header.version);
+        return false;
+    }
+    if (header.file_size != size)
+    {
+        error = "Timeline file is truncated";
+        return false;
+    }
+    // Table sizes are checked with 64 bit arithmetic, a damaged count cannot wrap around
+    if (!in_bounds(header.section_offset, uint64_t(header.section_count) * header.section_size, size) ||
+        !in_bounds(header.command_offset, uint64_t(header.command_count) * sizeof(TmlString), size) ||
+        !in_bounds(header.pool_offset, header.pool_size, size) || header.section_offset < header.header_size ||
+        !in_bounds(repeat_offset(), uint64_t(header.repeat_count) * sizeof(TmlRepeat), header.pool_offset))
+    {
+        error = "Timeline file tables out of bounds";
+        return false;
+    }
+    const size_t crc_end = offsetof(TmlHeader, crc) + sizeof(header.crc);
+    uint32_t crc = crc32(data, offsetof(TmlHeader, crc));
+    crc = crc32(data + crc_end, size - crc_end, crc);
+    if (crc != header.crc)
+    {
+        error = "Timeline file is damaged (CRC mismatch)";
+        return false;
+    }
+    auto valid = [this](const TmlString &s)
+    {
+        return in_bounds(s.offset, s.length, header.pool_size);
+    };
+    bool ok = valid(header.name) && valid(header.description) && valid(header.log_path);
+    for (uint32_t i = 0; ok && i < header.command_count; i++)
+    {
+        TmlString s;
+        std::memcpy(&s, data + header.command_offset + i * sizeof(TmlString), sizeof(s));
+        ok = valid(s);
+    }
+    for (uint32_t i = 0; ok && i < header.section_count; i++)
+    {
+        TmlSection s = section(i);
+        ok = valid(s.name) && valid(s.description) && valid(s.temperature_profile) && valid(s.speed_profile) && valid(s.profile_file) && valid(s.triggers) &&
+             in_bounds(s.pre_first, s.pre_count, header.command_count) && in_bounds(s.post_first, s.post_count, header.command_count);
+    }
+    for (uint32_t i = 0; ok && i < header.repeat_count; i++)
+    {
+        TmlRepeat r = repeat(i);
+        ok = r.first <= r.last && r.last < header.section_count && r.count > 0;
+    }
+    if (!ok)
+    {
+        error = "Timeline file has invalid references";
+        return false;
+    }
+    return true;
+}
+
+std::string_view TimelineView::string(const TmlString &s) const
+{
+    return std::string_view(file.data() + header.pool_offset + s.offset, s.length);
+}
+
+std::string_view TimelineView::name() const
+{
+    return string(header.name);
+}
+
+std::string_view TimelineView::description() const
+{
+    return string(header.description);
+}
+
+std::string_view TimelineView::log_path() const
+{
+    return string(header.log_path);
+}
+
+const TmlSettings &TimelineView::settings() const
+{
+    return header.settings;
+}
+
+uint32_t TimelineView::sections() const
+{
+    return header.section_count;
+}
+
+TmlSection TimelineView::section(uint32_t index) const
+{
+    // Records of newer versions are longer, the known part is at the front; older ones are shorter
+    TmlSection s{};
+    std::memcpy(&s, file.data() + header.section_offset + uint64_t(index) * header.section_size, std::min<size_t>(sizeof(s), header.section_size));
+    return s;
+}
+
+std::string_view TimelineView::command(uint32_t index) const
+{
+    TmlString s;
+    std::memcpy(&s, file.data() + header.command_offset + uint64_t(index) * sizeof(TmlString), sizeof(s));
+    return string(s);
+}
+
+uint64_t TimelineView::repeat_offset() const
+{
+    return header.command_offset + uint64_t(header.command_count) * sizeof(TmlString);
+}
+
+uint32_t TimelineView::repeats() const
+{
+    return header.repeat_count;
+}
+
+TmlRepeat TimelineView::repeat(uint32_t index) const
+{
+    TmlRepeat r;
+    std::memcpy(&r, file.data() + repeat_offset() + uint64_t(index) * sizeof(TmlRepeat), sizeof(r));
+    return r;
+}
@@ -0,0 +1,158 @@
+#ifndef TIMELINEFILE_H
+#define TIMELINEFILE_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+// Read only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+    const char *data() const { return base; }
+    size_t size() const { return length; }
+    std::string error;
+
+private:
+    const char *base;
+    size_t length;
+#ifdef _WIN32
+    void *file;
+    void *mapping;
+#endif
+};
+
+// Timeline file, versions 2 and 3. All numbers are little endian, the tables are 8 byte aligned:
+//   TmlHeader | TmlSection[section_count] | TmlString[command_count] | TmlRepeat[repeat_count] | string pool
+// Strings are (offset, length) pairs into the pool, the commands of a section are a run of the
+// command table. Records may grow in later versions: readers use section_size and ignore the rest.
+// Version 3 adds the repeat table. A reader that skipped it would run the repeated sections once,
+// so files with repeats are written as version 3 and all others still as version 2.
+static const char tmlMagic[4] = {'R', 'T', 'M', 'L'};
+static const uint16_t tmlVersion = 3;        // Newest version this release reads
+static const uint16_t tmlMinVersion = 2;
+static const uint16_t tmlRepeatVersion = 3;  // First version with the repeat table
+static const uint32_t tmlByteOrder = 0x01020304;
+
+struct TmlString
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct TmlSettings
+{
+    float log_intervals[4];
+    float log_deadband[4];
+    float log_max_gap;
+    float log_boost;
+    uint32_t batch_records;
+    uint32_t max_delay_ms;
+    uint32_t sync_interval_ms;
+    uint32_t rotation_seconds;
+    uint64_t rotation_bytes;
+    uint8_t log_channels; // One bit per LogChannel
+    uint8_t adaptive;
+    uint8_t journal;
+    uint8_t compress;
+    uint32_t reserved;
+};
+
+struct TmlHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t byte_order;
+    uint32_t section_count;
+    uint32_t section_size;
+    uint32_t command_count;
+    uint64_t file_size;
+    uint64_t section_offset;
+    uint64_t command_offset;
+    uint64_t pool_offset;
+    uint64_t pool_size;
+    TmlString name;
+    TmlString description;
+    TmlString log_path;
+    TmlSettings settings;
+    uint32_t repeat_count; // Version 3, zero in version 2 files
+    uint32_t crc; // CRC-32 of the whole file without this field
+};
+
+struct TmlSection
+{
+    TmlString name;
+    TmlString description;
+    uint32_t duration;
+    uint16_t temperature[2];
+    uint16_t speed[2];
+    uint8_t wait_user;
+    uint8_t wait_value;
+    uint8_t beep;
+    uint8_t reserved;
+    uint32_t pre_first;
+    uint32_t pre_count;
+    uint32_t post_first;
+    uint32_t post_count;
+    // Added after the first version 2 files, zero when reading those
+    TmlString temperature_profile;
+    TmlString speed_profile;
+    TmlString profile_file;
+    TmlString triggers; // TriggerSet::to_text
+    float settle_band[2]; // All zero in older files, the defaults apply then
+    float settle_hold;
+    uint32_t padding;
+};
+
+struct TmlRepeat
+{
+    uint32_t first; // Section indices, inclusive
+    uint32_t last;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+static const uint32_t tmlSectionMinSize = 48; // Section records of the first version 2 files
+
+static_assert(sizeof(TmlString) == 8 && sizeof(TmlSettings) == 72 && sizeof(TmlHeader) == 168 && sizeof(TmlSection) == 96 &&
+                  sizeof(TmlRepeat) == 16,
+              "Timeline file records are written as is");
+
+
+// Validated, zero copy view of a version 2 timeline file. open() checks the whole file in one
+// pass (sizes, table bounds, every string reference, CRC), afterwards nothing is checked again
+// and the strings point into the mapping.
+class TimelineView
+{
+public:
+    static bool is_tml(const char *data, size_t size); // Starts with the version 2 magic
+    bool open(const std::string &path);
+
+    std::string_view name() const;
+    std::string_view description() const;
+    std::string_view log_path() const;
+    const TmlSettings &settings() const;
+    uint32_t sections() const;
+    TmlSection section(uint32_t index) const;
+    std::string_view string(const TmlString &s) const;
+    std::string_view command(uint32_t index) const;
+    uint32_t repeats() const;
+    TmlRepeat repeat(uint32_t index) const;
+    std::string error;
+
+private:
+    uint64_t repeat_offset() const; // Right after the command table
+    MappedFile file;
+    TmlHeader header;
+};
+
+#endif // TIMELINEFILE_H
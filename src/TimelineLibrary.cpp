@@ -0,0 +1,371 @@
+#include "TimelineLibrary.h"
+#include "TimelineFile.h"
+#include "FileOperations.h"
+#include "RunCatalog.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+
+const char *TimelineLibrary::indexName = ".rct5_library";
+static const char *indexFormat = "# rct5 library index 2";
+
+static std::string lower(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c)
+                   { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+// Fields are tab separated, one file per line
+static std::string clean(std::string text)
+{
+    std::replace_if(text.begin(), text.end(), [](char c)
+                    { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+    return text;
+}
+
+TimelineLibrary::TimelineLibrary() : dir(), entries(), last_error(), mutex(), wake(), wake_requested(false), worker(), running(false), busy(false), gen(0) {}
+
+TimelineLibrary::~TimelineLibrary()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+void TimelineLibrary::set_folder(const std::string &folder)
+{
+    // The stored index is read here, the list is complete before the first scan finished
+    std::vector<LibraryEntry> list;
+    if (!folder.empty())
+    {
+        load_index(folder, list); // A new folder has none yet
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        dir = folder;
+        entries.swap(list);
+        last_error.clear();
+        wake_requested = true;
+    }
+    gen++;
+    if (!running.exchange(true))
+    {
+        worker = std::thread([this]
+                             { scan_thread(); });
+    }
+    wake.notify_all();
+}
+
+std::string TimelineLibrary::folder()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return dir;
+}
+
+void TimelineLibrary::rescan()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake_requested = true;
+    }
+    wake.notify_all();
+}
+
+std::vector<LibraryEntry> TimelineLibrary::search(const std::string &text)
+{
+    std::string part = lower(text);
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<LibraryEntry> result;
+    for (const LibraryEntry &entry : entries)
+    {
+        if (part.empty() || lower(entry.name).find(part) != std::string::npos ||
+            lower(entry.description).find(part) != std::string::npos)
+        {
+            result.push_back(entry);
+        }
+    }
+    return result;
+}
+
+size_t TimelineLibrary::size()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+uint64_t TimelineLibrary::generation() const
+{
+    return gen;
+}
+
+bool TimelineLibrary::scanning() const
+{
+    return busy;
+}
+
+std::string TimelineLibrary::error()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return last_error;
+}
+
+void TimelineLibrary::scan_thread()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running)
+    {
+        wake_requested = false;
+        std::string folder = dir;
+        if (!folder.empty())
+        {
+            lock.unlock();
+            busy = true;
+            scan(folder);
+            busy = false;
+            lock.lock();
+        }
+        // Files copied into the folder by others show up after at most one interval
+        wake.wait_for(lock, std::chrono::seconds(10), [this]
+                      { return wake_requested || !running; });
+    }
+}
+
+void TimelineLibrary::scan(const std::string &folder)
+{
+    std::vector<LibraryEntry> old;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        old = entries;
+    }
+    std::vector<LibraryEntry> list;
+    std::error_code ec;
+    auto options = std::filesystem::directory_options::skip_permission_denied;
+    for (auto it = std::filesystem::recursive_directory_iterator(folder, options, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+    {
+        if (!running)
+        {
+            return;
+        }
+        std::error_code file_ec;
+        if (!it->is_regular_file(file_ec) || it->path().extension() != ".tml")
+        {
+            continue;
+        }
+        LibraryEntry entry;
+        entry.path = it->path().lexically_relative(folder).generic_string();
+        entry.size = it->file_size(file_ec);
+        auto written = it->last_write_time(file_ec);
+        entry.mtime = std::chrono::duration_cast<std::chrono::seconds>(written.time_since_epoch()).count();
+        auto known = std::lower_bound(old.begin(), old.end(), entry.path, [](const LibraryEntry &e, const std::string &path)
+                                      { return e.path < path; });
+        bool have = known != old.end() && known->path == entry.path;
+        if (have && known->mtime == entry.mtime && known->size == entry.size)
+        {
+            list.push_back(*known);
+            continue;
+        }
+        read_entry(it->path().string(), entry, have ? &*known : nullptr);
+        list.push_back(entry);
+    }
+    std::sort(list.begin(), list.end(), [](const LibraryEntry &a, const LibraryEntry &b)
+              { return a.path < b.path; });
+
+    bool changed = list.size() != old.size();
+    for (size_t i = 0; !changed && i < list.size(); i++)
+    {
+        changed = list[i].path != old[i].path || list[i].mtime != old[i].mtime || list[i].size != old[i].size;
+    }
+    std::string error;
+    if (ec)
+    {
+        error = "Could not read " + folder + ": " + ec.message();
+    }
+    else if (changed && !save_index(folder, list))
+    {
+        error = "Could not write the library index in " + folder;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (dir != folder)
+    {
+        return; // The folder was changed during the scan
+    }
+    last_error = error;
+    if (changed)
+    {
+        entries.swap(list);
+        gen++;
+    }
+}
+
+// Run time of the sections with every repeat block counted, as the execution plan counts it
+static uint64_t run_duration(const std::vector<uint64_t> &durations, const std::vector<RepeatBlock> &repeats)
+{
+    double total = 0;
+    for (size_t i = 0; i < durations.size(); i++)
+    {
+        double passes = 1;
+        for (const RepeatBlock &repeat : repeats)
+        {
+            if (repeat.first <= i && i <= repeat.last)
+            {
+                passes *= repeat.count;
+            }
+        }
+        total += passes * durations[i];
+    }
+    return total < 1.8e19 ? static_cast<uint64_t>(total) : UINT64_MAX;
+}
+
+bool TimelineLibrary::read_entry(const std::string &file, LibraryEntry &entry, const LibraryEntry *known)
+{
+    entry.hash = 0;
+    entry.sections = 0;
+    entry.duration = 0;
+    MappedFile mapped;
+    if (!mapped.open(file))
+    {
+        entry.error = mapped.error;
+        return false;
+    }
+    entry.hash = RunCatalog::hash(mapped.data(), mapped.size());
+    if (known != nullptr && known->error.empty() && known->hash == entry.hash)
+    {
+        // Touched or copied over with the same content
+        entry.name = known->name;
+        entry.description = known->description;
+        entry.sections = known->sections;
+        entry.duration = known->duration;
+        return true;
+    }
+    if (TimelineView::is_tml(mapped.data(), mapped.size()))
+    {
+        // Only the header and the section table are touched
+        TimelineView view;
+        if (!view.open(file))
+        {
+            entry.error = view.error;
+            return false;
+        }
+        entry.name = view.name();
+        entry.description = view.description();
+        entry.sections = view.sections();
+        std::vector<uint64_t> durations;
+        for (uint32_t i = 0; i < entry.sections; i++)
+        {
+            durations.push_back(view.section(i).duration);
+        }
+        std::vector<RepeatBlock> repeats;
+        for (uint32_t i = 0; i < view.repeats(); i++)
+        {
+            TmlRepeat repeat = view.repeat(i);
+            repeats.push_back(RepeatBlock{repeat.first, repeat.last, repeat.count});
+        }
+        entry.duration = run_duration(durations, repeats);
+        return true;
+    }
+    // Files of earlier releases have no header, they are read completely once
+    TimeLine timeline(nullptr);
+    if (!FileOperations::loadTimeLine(timeline, file, &entry.error))
+    {
+        return false;
+    }
+    entry.name = timeline.name;
+    entry.description = timeline.description;
+    entry.sections = static_cast<uint32_t>(timeline.sections.size());
+    std::vector<uint64_t> durations;
+    for (const Section &section : timeline.sections)
+    {
+        durations.push_back(section.duration);
+    }
+    entry.duration = run_duration(durations, timeline.repeats);
+    return true;
+}
+
+bool TimelineLibrary::load_index(const std::string &folder, std::vector<LibraryEntry> &list)
+{
+    std::ifstream in(std::filesystem::path(folder) / indexName);
+    if (!in)
+    {
+        return false;
+    }
+    std::string line;
+    // Indexes without the format line count durations without repeats, their files are read again
+    if (!std::getline(in, line) || line != indexFormat)
+    {
+        return false;
+    }
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::vector<std::string> fields;
+        std::istringstream fields_in(line);
+        std::string field;
+        while (std::getline(fields_in, field, '\t'))
+        {
+            fields.push_back(field);
+        }
+        fields.resize(std::max<size_t>(fields.size(), 9));
+        LibraryEntry entry;
+        try
+        {
+            entry.path = fields[0];
+            entry.mtime = std::stoll(fields[1]);
+            entry.size = std::stoull(fields[2]);
+            entry.hash = std::stoull(fields[3], nullptr, 16);
+            entry.sections = static_cast<uint32_t>(std::stoul(fields[4]));
+            entry.duration = std::stoull(fields[5]);
+        }
+        catch (const std::exception &)
+        {
+            continue; // The entry is read again on the next scan
+        }
+        entry.name = fields[6];
+        entry.description = fields[7];
+        entry.error = fields[8];
+        list.push_back(entry);
+    }
+    std::sort(list.begin(), list.end(), [](const LibraryEntry &a, const LibraryEntry &b)
+              { return a.path < b.path; });
+    return true;
+}
+
+bool TimelineLibrary::save_index(const std::string &folder, const std::vector<LibraryEntry> &list)
+{
+    std::filesystem::path path = std::filesystem::path(folder) / indexName;
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << indexFormat << '\n';
+        out << "# path\tmtime\tsize\thash\tsections\tduration\tname\tdescription\terror" << '\n';
+        for (const LibraryEntry &entry : list)
+        {
+            char hash_text[17];
+            std::snprintf(hash_text, sizeof(hash_text), "%016llx", static_cast<unsigned long long>(entry.hash));
+            out << clean(entry.path) << "\t" << entry.mtime << "\t" << entry.size << "\t" << hash_text << "\t" << entry.sections << "\t"
+                << entry.duration << "\t" << clean(entry.name) << "\t" << clean(entry.description) << "\t" << clean(entry.error) << '\n';
+        }
+        out.flush();
+        if (!out.good())
+        {
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    return !ec;
+}
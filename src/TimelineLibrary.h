@@ -0,0 +1,66 @@
+#ifndef TIMELINELIBRARY_H
+#define TIMELINELIBRARY_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+// Summary of one .tml file, enough to browse and search without loading it
+struct LibraryEntry
+{
+    std::string path;     // Relative to the library folder
+    int64_t mtime;        // Modification time, seconds of the filesystem clock
+    uint64_t size;        // File size in bytes
+    uint64_t hash;        // FNV-1a of the file content
+    std::string name;
+    std::string description;
+    uint32_t sections;
+    uint64_t duration;    // Run time in seconds, repeat blocks included
+    std::string error;    // Why the file could not be read, the entry is kept to show it
+};
+
+// Recipe folder indexed by a background thread. The index is kept in the folder (.rct5_library)
+// so the list is there immediately on the next start; the scan then only reads files whose size
+// or modification time changed, and skips parsing if the content hash is still the same.
+class TimelineLibrary
+{
+public:
+    TimelineLibrary();
+    ~TimelineLibrary();
+
+    void set_folder(const std::string &folder); // Loads the stored index and starts (re)scanning
+    std::string folder();
+    void rescan();                              // Scan now instead of waiting for the next interval
+    std::vector<LibraryEntry> search(const std::string &text); // Part of name or description, any case
+    size_t size();
+    uint64_t generation() const;                // Changes with every update of the index
+    bool scanning() const;
+    std::string error();
+
+    static const char *indexName;
+
+private:
+    std::string dir;
+    std::vector<LibraryEntry> entries; // Sorted by path
+    std::string last_error;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool wake_requested;
+    std::thread worker;
+    std::atomic<bool> running;
+    std::atomic<bool> busy;
+    std::atomic<uint64_t> gen;
+
+    void scan_thread();
+    void scan(const std::string &folder);
+    bool load_index(const std::string &folder, std::vector<LibraryEntry> &list);
+    bool save_index(const std::string &folder, const std::vector<LibraryEntry> &list);
+    // known is the previous entry of the file, its summary is kept if the content hash is the same
+    static bool read_entry(const std::string &file, LibraryEntry &entry, const LibraryEntry *known);
+};
+
+#endif // TIMELINELIBRARY_H
@@ -0,0 +1,190 @@
+#include "Trigger.h"
+#include "TimeLine.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+static_assert(LOG_CHANNELS <= triggerMaxChannels, "Every log channel can drive a trigger");
+
+void TriggerSet::reset(const Trigger *begin, const Trigger *end)
+{
+    first = begin;
+    last = end;
+    states.assign(end - begin, TriggerState{NAN, -1, 0, 0, 0, 0, 0, 0, 0, NAN});
+    std::fill(t_read, t_read + triggerMaxChannels, -1.0);
+    fired = -1;
+}
+
+bool TriggerSet::uses(int channel) const
+{
+    return std::any_of(first, last, [channel](const Trigger &trigger)
+                       { return trigger.channel == channel; });
+}
+
+// The rate is the slope of a least squares line through the readings, older ones weigh exp(-age / tau)
+static double rate_time_constant(const Trigger &trigger)
+{
+    return std::max(10.0, trigger.hold / 2.0);
+}
+
+int TriggerSet::update(int channel, double t, float value)
+{
+    if (channel >= 0 && channel < triggerMaxChannels)
+    {
+        t_read[channel] = t;
+    }
+    if (std::isnan(value))
+    {
+        return -1; // A failed read neither breaks nor completes a hold time
+    }
+    for (const Trigger *trigger = first; trigger != last; ++trigger)
+    {
+        if (trigger->channel != channel)
+        {
+            continue;
+        }
+        TriggerState &state = states[trigger - first];
+        if (std::isnan(state.baseline))
+        {
+            state.baseline = value;
+            state.t_first = t;
+            state.t_last = t;
+        }
+        bool condition = false;
+        switch (trigger->kind)
+        {
+        case TriggerKind::Above:
+            condition = value > trigger->value;
+            break;
+        case TriggerKind::Below:
+            condition = value < trigger->value;
+            break;
+        case TriggerKind::RiseAbove:
+            condition = value >= state.baseline + std::abs(state.baseline) * trigger->value / 100;
+            break;
+        case TriggerKind::FallBelow:
+            condition = value <= state.baseline - std::abs(state.baseline) * trigger->value / 100;
+            break;
+        default:
+        {
+            // The sums are kept around the newest reading, they stay small on long runs
+            double tau = rate_time_constant(*trigger);
+            double dt = t - state.t_last;
+            double decay = std::exp(-dt / tau);
+            state.wtt = (state.wtt - 2 * dt * state.wt + dt * dt * state.w) * decay;
+            state.wtv = (state.wtv - dt * state.wv) * decay;
+            state.wt = (state.wt - dt * state.w) * decay;
+            state.w = state.w * decay + 1;
+            state.wv = state.wv * decay + value;
+            double d = state.w * state.wtt - state.wt * state.wt;
+            state.rate = d > 1e-9 ? 60 * (state.w * state.wtv - state.wt * state.wv) / d : NAN;
+            // The first tau seconds the line rests on too few readings
+            condition = t - state.t_first >= tau && std::abs(state.rate) < trigger->value;
+            break;
+        }
+        }
+        state.t_last = t;
+        if (!condition)
+        {
+            state.t_holds = -1;
+            continue;
+        }
+        if (state.t_holds < 0)
+        {
+            state.t_holds = t;
+        }
+        if (t - state.t_holds >= trigger->hold)
+        {
+            fired = fired < 0 ? static_cast<int>(trigger - first) : fired;
+            return static_cast<int>(trigger - first);
+        }
+    }
+    return -1;
+}
+
+std::string TriggerSet::describe(const Trigger &trigger)
+{
+    const char *name = trigger.channel < LOG_CHANNELS ? logChannelInfo[trigger.channel].name : "?";
+    char text[128];
+    switch (trigger.kind)
+    {
+    case TriggerKind::Above:
+        std::snprintf(text, sizeof(text), "%s above %g", name, trigger.value);
+        break;
+    case TriggerKind::Below:
+        std::snprintf(text, sizeof(text), "%s below %g", name, trigger.value);
+        break;
+    case TriggerKind::RiseAbove:
+        std::snprintf(text, sizeof(text), "%s %g %% above its start", name, trigger.value);
+        break;
+    case TriggerKind::FallBelow:
+        std::snprintf(text, sizeof(text), "%s %g %% below its start", name, trigger.value);
+        break;
+    default:
+        std::snprintf(text, sizeof(text), "%s changes less than %g per min", name, trigger.value);
+        break;
+    }
+    std::string description = text;
+    if (trigger.hold > 0)
+    {
+        std::snprintf(text, sizeof(text), " for %g s", trigger.hold);
+        description += text;
+    }
+    return description;
+}
+
+std::string TriggerSet::to_text(const std::vector<Trigger> &triggers)
+{
+    std::string text;
+    char item[96];
+    for (const Trigger &trigger : triggers)
+    {
+        std::snprintf(item, sizeof(item), "%s%u,%u,%.9g,%.9g", text.empty() ? "" : ";", static_cast<unsigned>(trigger.channel),
+                      static_cast<unsigned>(trigger.kind), trigger.value, trigger.hold);
+        text += item;
+    }
+    return text;
+}
+
+bool TriggerSet::from_text(const std::string &text, std::vector<Trigger> &triggers)
+{
+    triggers.clear();
+    std::vector<Trigger> parsed;
+    const char *p = text.c_str();
+    while (*p != '\0')
+    {
+        char *end = nullptr;
+        unsigned long channel = std::strtoul(p, &end, 10);
+        if (end == p || *end != ',')
+        {
+            return false;
+        }
+        p = end + 1;
+        unsigned long kind = std::strtoul(p, &end, 10);
+        if (end == p || *end != ',')
+        {
+            return false;
+        }
+        p = end + 1;
+        float value = std::strtof(p, &end);
+        if (end == p || *end != ',')
+        {
+            return false;
+        }
+        p = end + 1;
+        float hold = std::strtof(p, &end);
+        if (end == p || (*end != ';' && *end != '\0'))
+        {
+            return false;
+        }
+        p = *end == ';' ? end + 1 : end;
+        if (channel >= LOG_CHANNELS || kind >= static_cast<unsigned long>(TriggerKind::Count))
+        {
+            return false;
+        }
+        parsed.push_back(Trigger{static_cast<uint8_t>(channel), static_cast<TriggerKind>(kind), value, hold});
+    }
+    triggers.swap(parsed);
+    return true;
+}
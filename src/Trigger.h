@@ -0,0 +1,66 @@
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Readings of a trigger channel come at least this often, from the log or read for the trigger
+static const float triggerReadInterval = 1.0f;
+static const int triggerMaxChannels = 8;
+
+enum class TriggerKind : uint8_t
+{
+    Above,     // Reading above value
+    Below,     // Reading below value
+    RiseAbove, // Reading value % above the first reading of the section
+    FallBelow, // Reading value % below the first reading of the section
+    RateBelow, // Rate of change below value per minute, either direction
+    Count
+};
+
+// Ends the timed part of a section early, e.g. "Viscosity 20 % above its start" or
+// "T Sensor changes less than 0.05 K/min for 120 s"
+struct Trigger
+{
+    uint8_t channel; // LogChannel
+    TriggerKind kind;
+    float value;
+    float hold; // Seconds the condition has to hold
+};
+
+// Evaluation state of one trigger, updated in constant time per reading
+struct TriggerState
+{
+    float baseline;   // First reading of the section, NaN before
+    double t_holds;   // Start of the current run of true conditions, negative for none
+    double t_first;   // First reading of the section
+    double t_last;
+    // Exponentially weighted least squares of value over time, times relative to t_last
+    double w, wt, wv, wtt, wtv;
+    double rate;      // Per minute, NaN until there are enough readings
+};
+
+class TriggerSet
+{
+public:
+    // Evaluation starts over for a new section
+    void reset(const Trigger *begin, const Trigger *end);
+    // Feeds a reading, returns the index of the first trigger that fired, -1 for none
+    int update(int channel, double t, float value);
+    bool uses(int channel) const;
+    int fired = -1; // First trigger that fired since reset()
+    double t_read[triggerMaxChannels]; // Time of the last reading per channel, negative for none
+    std::vector<TriggerState> states;
+
+    static std::string describe(const Trigger &trigger);
+    // Compact text form for the timeline file, "channel,kind,value,hold" separated by ';'
+    static std::string to_text(const std::vector<Trigger> &triggers);
+    static bool from_text(const std::string &text, std::vector<Trigger> &triggers); // Empty list on errors
+
+private:
+    const Trigger *first = nullptr;
+    const Trigger *last = nullptr;
+};
+
+#endif // TRIGGER_H
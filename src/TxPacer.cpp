@@ -0,0 +1,108 @@
+#include "TxPacer.h"
+#include <algorithm>
+
+TokenBucket::TokenBucket() : rate(1000), capacity(100), tokens(100), t_last(std::chrono::steady_clock::now()) {}
+
+void TokenBucket::configure(double rate_ms_per_s, double capacity_ms)
+{
+    refill();
+    rate = rate_ms_per_s;
+    capacity = capacity_ms;
+    tokens = std::min(tokens, capacity);
+}
+
+void TokenBucket::refill()
+{
+    auto t_now = std::chrono::steady_clock::now();
+    double elapsed_s = std::chrono::duration<double>(t_now - t_last).count();
+    tokens = std::min(capacity, tokens + elapsed_s * rate);
+    t_last = t_now;
+}
+
+double TokenBucket::wait_ms(double cost_ms)
+{
+    refill();
+    // A command larger than the bucket may go once the bucket is full
+    double needed = std::min(cost_ms, capacity) - tokens;
+    return needed <= 0 ? 0 : needed / rate * 1000;
+}
+
+void TokenBucket::consume(double cost_ms)
+{
+    refill();
+    tokens -= cost_ms;
+}
+
+TxPacer::TxPacer() : control_share(0.4), baudRate(9600), service_ms(5), waited_ms(0), n_samples(0), control(), telemetry(), t_blocked(), blocked{false, false}, mutex()
+{
+    update_buckets();
+}
+
+double TxPacer::wire_ms(size_t bytes) const
+{
+    // 8N1: start bit, 8 data bits, stop bit
+    return bytes * 10.0 * 1000.0 / baudRate;
+}
+
+double TxPacer::command_ms(size_t command_bytes, size_t reply_bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return wire_ms(command_bytes + reply_bytes) + service_ms;
+}
+
+void TxPacer::update_buckets()
+{
+    // Bursts: a setpoint pair for control, one round of the four log channels for telemetry
+    double cost = wire_ms(20) + service_ms;
+    control.configure(control_share * 1000, 2 * cost);
+    telemetry.configure((1 - control_share) * 1000, 4 * cost);
+}
+
+void TxPacer::configure(uint32_t baudRate)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->baudRate = baudRate > 0 ? baudRate : 9600;
+    update_buckets();
+}
+
+double TxPacer::try_acquire(const std::string &command, bool telemetry_traffic)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    // Reads are charged for the reply as well, " \r\n" is appended to every command
+    double cost = wire_ms(command.size() + 3 + (telemetry_traffic ? 8 : 0)) + service_ms;
+    TokenBucket &bucket = telemetry_traffic ? telemetry : control;
+    double wait = bucket.wait_ms(cost);
+    auto t_now = std::chrono::steady_clock::now();
+    if (wait > 0)
+    {
+        if (!blocked[telemetry_traffic])
+        {
+            blocked[telemetry_traffic] = true;
+            t_blocked[telemetry_traffic] = t_now;
+        }
+        return wait;
+    }
+    if (blocked[telemetry_traffic])
+    {
+        blocked[telemetry_traffic] = false;
+        waited_ms += std::chrono::duration<double, std::milli>(t_now - t_blocked[telemetry_traffic]).count();
+    }
+    bucket.consume(cost);
+    return 0;
+}
+
+void TxPacer::record(const std::string &command, size_t reply_bytes, double rtt_ms)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    // Whatever the line time does not explain is spent in the device
+    double sample = std::max(0.0, rtt_ms - wire_ms(command.size() + 3 + reply_bytes));
+    service_ms = n_samples == 0 ? sample : 0.875 * service_ms + 0.125 * sample;
+    n_samples++;
+    update_buckets();
+}
+
+TxPacerStats TxPacer::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return TxPacerStats{baudRate, service_ms, waited_ms, n_samples};
+}
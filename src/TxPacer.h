@@ -0,0 +1,68 @@
+#ifndef TXPACER_H
+#define TXPACER_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Classic token bucket, tokens are milliseconds of serial line time
+class TokenBucket
+{
+public:
+    TokenBucket();
+    void configure(double rate_ms_per_s, double capacity_ms);
+    double wait_ms(double cost_ms); // Time until cost_ms tokens are available
+    void consume(double cost_ms);
+
+    double rate;     // Refill rate in ms of line time per second
+    double capacity; // Burst size in ms of line time
+
+private:
+    double tokens;
+    std::chrono::time_point<std::chrono::steady_clock> t_last;
+    void refill();
+};
+
+// Consistent copy of the pacer state for display
+struct TxPacerStats
+{
+    uint32_t baudRate;
+    double service_ms; // Smoothed device processing time per command
+    double waited_ms;  // Total time commands waited for tokens
+    size_t n_samples;  // Number of measured round trips behind service_ms
+};
+
+// Paces commands to what the line and the device can sustain.
+// A command costs its transmission time (10 bits per byte at the configured baud rate, request
+// and reply) plus the measured device service time. Control (setpoints, start/stop, modes)
+// and telemetry (IN_* reads) draw from separate buckets, so logging cannot starve a ramp.
+class TxPacer
+{
+public:
+    TxPacer();
+    void configure(uint32_t baudRate);
+    // Takes the budget of the command and returns 0, or returns the time until the budget permits it
+    double try_acquire(const std::string &command, bool telemetry);
+    void record(const std::string &command, size_t reply_bytes, double rtt_ms); // Update the device service time
+    double command_ms(size_t command_bytes = 12, size_t reply_bytes = 8);     // Expected line time of one command
+    TxPacerStats stats();
+
+    double control_share; // Fraction of the line reserved for control traffic
+
+private:
+    uint32_t baudRate;
+    double service_ms;
+    double waited_ms;
+    size_t n_samples;
+    TokenBucket control;
+    TokenBucket telemetry;
+    // Start of the current wait for budget per bucket, unset while the bucket serves commands
+    std::chrono::time_point<std::chrono::steady_clock> t_blocked[2];
+    bool blocked[2];
+    std::mutex mutex;
+    void update_buckets();
+    double wire_ms(size_t bytes) const;
+};
+
+#endif // TXPACER_H
@@ -0,0 +1,104 @@
+#include "TxQueue.h"
+#include <algorithm>
+
+TxQueue::TxQueue() : max_depth(0), coalesced(0), control(), telemetry(), mutex(), cv(), closed(false) {}
+
+bool TxQueue::is_setpoint(const std::string &base_command)
+{
+    return base_command == "OUT_SP_1" || base_command == "OUT_SP_4";
+}
+
+bool TxQueue::is_telemetry(const std::string &base_command)
+{
+    return base_command.rfind("IN_", 0) == 0;
+}
+
+bool TxQueue::is_barrier(const std::string &base_command)
+{
+    // Measured values do not depend on the order of setpoint writes, everything else does
+    return !is_setpoint(base_command) && base_command.rfind("IN_PV_", 0) != 0;
+}
+
+void TxQueue::push(TxRequest request)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (request.posted && is_setpoint(request.base_command))
+        {
+            for (auto it = control.rbegin(); it != control.rend(); ++it)
+            {
+                if (it->base_command == request.base_command)
+                {
+                    if (it->posted)
+                    {
+                        it->command = request.command;
+                        coalesced++;
+                        return;
+                    }
+                    // Somebody waits for that exact write, keep it
+                    break;
+                }
+                if (is_barrier(it->base_command))
+                {
+                    break;
+                }
+            }
+        }
+        std::deque<TxRequest> &queue = is_telemetry(request.base_command) ? telemetry : control;
+        queue.push_back(std::move(request));
+        max_depth = std::max(max_depth, control.size() + telemetry.size());
+    }
+    cv.notify_one();
+}
+
+bool TxQueue::pop(TxRequest &request, const std::function<double(const TxRequest &)> &wait_ms)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        if (closed && control.empty() && telemetry.empty())
+        {
+            return false;
+        }
+        double wait = -1;
+        for (std::deque<TxRequest> *queue : {&control, &telemetry})
+        {
+            if (queue->empty())
+            {
+                continue;
+            }
+            double w = wait_ms(queue->front());
+            if (w <= 0)
+            {
+                request = std::move(queue->front());
+                queue->pop_front();
+                return true;
+            }
+            wait = wait < 0 ? w : std::min(wait, w);
+        }
+        // Nothing may go yet, a new request can wake us earlier
+        if (wait < 0)
+        {
+            cv.wait(lock);
+        }
+        else
+        {
+            cv.wait_for(lock, std::chrono::microseconds(static_cast<int64_t>(wait * 1000) + 1));
+        }
+    }
+}
+
+void TxQueue::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+    }
+    cv.notify_all();
+}
+
+TxQueueStats TxQueue::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return TxQueueStats{control.size() + telemetry.size(), max_depth, coalesced};
+}
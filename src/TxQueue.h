@@ -0,0 +1,72 @@
+#ifndef TXQUEUE_H
+#define TXQUEUE_H
+
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include "SerialPort.h"
+
+// Outcome of a queued command
+struct TxResult
+{
+    SerialError error;
+    std::string response;
+};
+
+// Command waiting for the serial line
+struct TxRequest
+{
+    std::string command;      // Full command, e.g. "OUT_SP_1 50"
+    std::string base_command; // Command without parameter, e.g. "OUT_SP_1"
+    bool returnsValue;        // Device answers this command
+    bool posted;              // Fire-and-forget, may be superseded by a newer value
+    std::shared_ptr<std::promise<TxResult>> done; // Completion for blocking callers (null if posted)
+    std::chrono::time_point<std::chrono::steady_clock> t_queued;
+};
+
+// Consistent copy of the queue counters for display
+struct TxQueueStats
+{
+    size_t depth;     // Pending requests
+    size_t max_depth; // High-water mark of the queue
+    size_t coalesced; // Number of superseded setpoint writes
+};
+
+// Commands for one device, control (setpoints, start/stop, modes) and telemetry (IN_* reads)
+// in separate FIFOs. Control is served first, a read never holds up a write behind it.
+// A posted setpoint write replaces a still pending posted write to the same channel, as long as
+// no START/STOP/mode or other control command is queued in between. Only the latest value is
+// relevant, so queue depth stays bounded when commands are produced faster than the line drains.
+class TxQueue
+{
+public:
+    TxQueue();
+
+    void push(TxRequest request);
+    // Blocks until a request is available and wait_ms(request) returns 0 for it, false once closed.
+    // wait_ms returns the time until a request may go, the queue looks at the other FIFO meanwhile.
+    bool pop(TxRequest &request, const std::function<double(const TxRequest &)> &wait_ms);
+    void close();
+    TxQueueStats stats();
+
+    static bool is_setpoint(const std::string &base_command);
+    static bool is_telemetry(const std::string &base_command);
+
+private:
+    size_t max_depth;
+    size_t coalesced;
+    std::deque<TxRequest> control;
+    std::deque<TxRequest> telemetry;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool closed;
+
+    static bool is_barrier(const std::string &base_command);
+};
+
+#endif // TXQUEUE_H
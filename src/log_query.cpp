@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string>
+#include <chrono>
+#include <ctime>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <iomanip>
+#include "LogQuery.h"
+
+// Command line access to the zone map of a log, works while the controller is writing it.
+//   log_query <log> runs
+//   log_query <log> aggregate <channel> [range]
+//   log_query <log> crossings <channel> <threshold> [range]
+// range: --run <n|last> --section <n> --since <date> --until <date> --from <s> --to <s>
+// Dates are unix times or YYYY-MM-DD [HH:MM] in local time.
+
+// Log columns in the order of LogChannel (TimeLine.h)
+static const char *channel_names[] = {"speed", "tplate", "tsensor", "viscosity"};
+
+static int parse_channel(const char *text)
+{
+    for (int c = 0; c < 4; c++)
+    {
+        if (std::strcmp(text, channel_names[c]) == 0)
+        {
+            return c;
+        }
+    }
+    char *end;
+    long c = std::strtol(text, &end, 10);
+    return (*end == 0 && c >= 0 && c < LOG_MAX_COLUMNS) ? static_cast<int>(c) : -1;
+}
+
+static bool parse_time(const std::string &text, bool end_of_day, int64_t &stamp)
+{
+    if (text.find('-') == std::string::npos)
+    {
+        char *end;
+        stamp = std::strtoll(text.c_str(), &end, 10);
+        return *end == 0;
+    }
+    std::tm tm{};
+    std::istringstream in(text);
+    in >> std::get_time(&tm, "%Y-%m-%d");
+    if (in.fail())
+    {
+        return false;
+    }
+    bool has_clock = !(in >> std::ws).eof();
+    if (has_clock && !(in >> std::get_time(&tm, "%H:%M")))
+    {
+        return false;
+    }
+    tm.tm_isdst = -1;
+    stamp = static_cast<int64_t>(std::mktime(&tm)) + (end_of_day && !has_clock ? 86399 : 0);
+    return true;
+}
+
+static std::string format_time(int64_t stamp)
+{
+    std::time_t time = static_cast<std::time_t>(stamp);
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", std::localtime(&time));
+    return text;
+}
+
+static int usage()
+{
+    printf("Usage: log_query <log> runs\n"
+           "       log_query <log> aggregate <channel> [range]\n"
+           "       log_query <log> crossings <channel> <threshold> [range]\n"
+           "channel: speed, tplate, tsensor, viscosity or the column number\n"
+           "range:   --run <n|last> --section <n> --since <date> --until <date> --from <s> --to <s>\n");
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        return usage();
+    }
+    auto t_start = std::chrono::steady_clock::now();
+    LogQuery query;
+    if (!query.open(argv[1]))
+    {
+        printf("Error: %s\n", query.error.c_str());
+        return 1;
+    }
+    std::string command = argv[2];
+    if (command == "runs")
+    {
+        for (const LogRun &run : query.runs())
+        {
+            printf("%4d  %s  %7.0f s  %3d sections  %8llu records  %s\n", run.number, format_time(run.start).c_str(), run.t_end,
+                   run.sections, static_cast<unsigned long long>(run.records), run.name.c_str());
+        }
+        return 0;
+    }
+
+    int first_option = command == "crossings" ? 5 : 4;
+    if ((command != "aggregate" && command != "crossings") || argc < first_option)
+    {
+        return usage();
+    }
+    int channel = parse_channel(argv[3]);
+    if (channel < 0)
+    {
+        return usage();
+    }
+    LogRange range;
+    for (int i = first_option; i + 1 < argc; i += 2)
+    {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        bool ok = true;
+        if (option == "--run")
+        {
+            range.run = value == "last" ? (query.runs().empty() ? -1 : query.runs().back().number) : std::atoi(value.c_str());
+        }
+        else if (option == "--section")
+        {
+            range.section = std::atoi(value.c_str());
+        }
+        else if (option == "--since")
+        {
+            ok = parse_time(value, false, range.since);
+        }
+        else if (option == "--until")
+        {
+            ok = parse_time(value, true, range.until);
+        }
+        else if (option == "--from")
+        {
+            range.t_from = std::strtof(value.c_str(), nullptr);
+        }
+        else if (option == "--to")
+        {
+            range.t_to = std::strtof(value.c_str(), nullptr);
+        }
+        else
+        {
+            ok = false;
+        }
+        if (!ok)
+        {
+            printf("Invalid option %s %s\n", option.c_str(), value.c_str());
+            return 1;
+        }
+    }
+
+    if (command == "aggregate")
+    {
+        LogAggregate result = query.aggregate(channel, range);
+        printf("count %llu  min %.2f  max %.2f  mean %.3f\n", static_cast<unsigned long long>(result.count), result.min, result.max, result.mean());
+    }
+    else
+    {
+        float threshold = std::strtof(argv[4], nullptr);
+        for (const LogCrossing &c : query.crossings(channel, threshold, range))
+        {
+            printf("run %d  section %d  t %.2f s  %.2f  %s\n", c.run, c.section, c.t, c.value, c.rising ? "rising" : "falling");
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+    printf("%llu zones from summaries, %llu decoded, %.1f ms\n", static_cast<unsigned long long>(query.zones_summarized),
+           static_cast<unsigned long long>(query.zones_decoded), ms);
+    return 0;
+}